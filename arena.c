@@ -0,0 +1,137 @@
+#include <stdlib.h>
+#include "arena.h"
+
+/**
+ * @return the size class of a block of the given size (ARENA_CLASSES if it
+ * is larger than ARENA_MAX_BLOCK).
+ */
+static int arena_class (size_t size)
+{
+  if (size > ARENA_MAX_BLOCK)
+    return ARENA_CLASSES;
+  int cls = 0;
+  for (size_t block = ARENA_MIN_BLOCK; block < size; block <<= 1)
+    cls++;
+  return cls;
+}
+
+/**
+ * Allocates a new slab with data of the given size, and links it to the
+ * arena.
+ * @return the slab's data, NULL if failed.
+ */
+static unsigned char *arena_new_slab (arena *arena, size_t size)
+{
+  arena_slab *slab = malloc (sizeof (*slab) + size);
+  if (slab == NULL)
+    return NULL;
+  slab->size = size;
+  slab->next = arena->slabs;
+  arena->slabs = slab;
+  return slab->data;
+}
+
+/**
+ * Allocates dynamically a new (empty) arena.
+ * @return pointer to dynamically allocated arena.
+ * @if_fail return NULL.
+ */
+arena *arena_alloc (void)
+{
+  arena *a = malloc (sizeof (*a));
+  if (a == NULL)
+    return NULL;
+
+  a->slabs = NULL;
+  a->heap_elements = 0;
+  for (int i = 0; i < ARENA_CLASSES; i++)
+    {
+      a->cursor[i] = NULL;
+      a->left[i] = 0;
+      a->free_lists[i] = NULL;
+    }
+  return a;
+}
+
+/**
+ * Frees an arena, and all the blocks it handed out.
+ * @param p_arena pointer to dynamically allocated pointer to arena.
+ */
+void arena_free (arena **p_arena)
+{
+  if (p_arena != NULL && *p_arena != NULL)
+    {
+      arena_slab *slab = (*p_arena)->slabs;
+      while (slab != NULL)
+        {
+          arena_slab *next = slab->next;
+          free (slab);
+          slab = next;
+        }
+      free (*p_arena);
+      *p_arena = NULL;
+    }
+}
+
+/**
+ * Allocates a block of at least size bytes from the arena (aligned to 16
+ * bytes for the size classes, and to the slab alignment for larger ones).
+ * @param arena an arena.
+ * @param size the size of the block.
+ * @return pointer to the block, NULL if failed.
+ */
+void *arena_malloc (arena *arena, size_t size)
+{
+  if (arena == NULL || size == 0)
+    return NULL;
+
+  int cls = arena_class (size);
+  if (cls == ARENA_CLASSES)
+    return arena_new_slab (arena, size);
+
+  // reuse a released block of the class:
+  void *block = arena->free_lists[cls];
+  if (block != NULL)
+    {
+      arena->free_lists[cls] = *((void **) block);
+      return block;
+    }
+
+  // carve the block from the class' current slab, or from a new one:
+  size_t block_size = ARENA_MIN_BLOCK << cls;
+  if (arena->left[cls] < block_size)
+    {
+      arena->cursor[cls] = arena_new_slab (arena, ARENA_SLAB_SIZE);
+      if (arena->cursor[cls] == NULL)
+        {
+          arena->left[cls] = 0;
+          return NULL;
+        }
+      arena->left[cls] = ARENA_SLAB_SIZE;
+    }
+  block = arena->cursor[cls];
+  arena->cursor[cls] += block_size;
+  arena->left[cls] -= block_size;
+  return block;
+}
+
+/**
+ * Releases a block back to the arena, to be reused by arena_malloc.
+ * Blocks larger than ARENA_MAX_BLOCK are reclaimed only by arena_free.
+ * @param arena the arena the block was allocated from.
+ * @param block the block to be released.
+ * @param size the size the block was allocated with.
+ */
+void arena_release (arena *arena, void *block, size_t size)
+{
+  if (arena == NULL || block == NULL)
+    return;
+
+  int cls = arena_class (size);
+  if (cls == ARENA_CLASSES)
+    return;
+
+  // the released block stores the link of its class' free list
+  *((void **) block) = arena->free_lists[cls];
+  arena->free_lists[cls] = block;
+}
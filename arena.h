@@ -0,0 +1,87 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdlib.h>
+
+/**
+ * @def ARENA_SLAB_SIZE
+ * The size (in bytes) of each slab the arena carves blocks from.
+ */
+#define ARENA_SLAB_SIZE 65536UL
+
+/**
+ * @def ARENA_MIN_BLOCK
+ * The smallest size class of the arena, classes double up to
+ * ARENA_MAX_BLOCK. Blocks larger than ARENA_MAX_BLOCK get a slab of their own.
+ */
+#define ARENA_MIN_BLOCK 16UL
+#define ARENA_MAX_BLOCK 2048UL
+
+/**
+ * @def ARENA_CLASSES
+ * The number of size classes (16, 32, ..., 2048).
+ */
+#define ARENA_CLASSES 8
+
+/**
+ * @struct arena_slab - a dynamically allocated chunk of memory.
+ * @param next the next slab of the arena.
+ * @param size the size of the slab's data.
+ * @param data the memory the blocks are carved from.
+ */
+typedef struct arena_slab {
+    struct arena_slab *next;
+    size_t size;
+    _Alignas (16) unsigned char data[];
+} arena_slab;
+
+/**
+ * @struct arena - a size-classed slab allocator.
+ * Blocks are carved from slabs, released blocks are recycled through a free
+ * list per size class, and freeing the arena frees only its slabs.
+ * @param slabs all the slabs of the arena.
+ * @param cursor, left the unused tail of the current slab of each class.
+ * @param free_lists the released blocks of each class.
+ * @param heap_elements a counter its users may keep of elements they
+ * allocated outside the arena (see pair_alloc_in).
+ */
+typedef struct arena {
+    arena_slab *slabs;
+    unsigned char *cursor[ARENA_CLASSES];
+    size_t left[ARENA_CLASSES];
+    void *free_lists[ARENA_CLASSES];
+    size_t heap_elements;
+} arena;
+
+/**
+ * Allocates dynamically a new (empty) arena.
+ * @return pointer to dynamically allocated arena.
+ * @if_fail return NULL.
+ */
+arena *arena_alloc (void);
+
+/**
+ * Frees an arena, and all the blocks it handed out.
+ * @param p_arena pointer to dynamically allocated pointer to arena.
+ */
+void arena_free (arena **p_arena);
+
+/**
+ * Allocates a block of at least size bytes from the arena (aligned to 16
+ * bytes for the size classes, and to the slab alignment for larger ones).
+ * @param arena an arena.
+ * @param size the size of the block.
+ * @return pointer to the block, NULL if failed.
+ */
+void *arena_malloc (arena *arena, size_t size);
+
+/**
+ * Releases a block back to the arena, to be reused by arena_malloc.
+ * Blocks larger than ARENA_MAX_BLOCK are reclaimed only by arena_free.
+ * @param arena the arena the block was allocated from.
+ * @param block the block to be released.
+ * @param size the size the block was allocated with.
+ */
+void arena_release (arena *arena, void *block, size_t size);
+
+#endif //ARENA_H_
@@ -0,0 +1,1112 @@
+#include "test_pairs.h"
+#include "hash_funcs.h"
+#include "hashmap.h"
+#include "hashmap_typed.h"
+#include "concurrent_hashmap.h"
+#include "hashmap_snapshot.h"
+#include "markov_chain.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+ * Hash map benchmarks.
+ * Build: gcc -O2 bench.c hashmap.c vector.c pair.c arena.c concurrent_hashmap.c \
+ *        hashmap_snapshot.c markov_chain.c corpus.c symtab.c -pthread -lm \
+ *        -o bench
+ * Usage: bench [word-list-file]
+ *        bench --suite [max-size] [chained|open-addressing|compact]
+ */
+
+#define BENCH_KEYS 100000
+#define BENCH_KEY_LEN 48
+
+/**
+ * Number of hash_func and key_cmp calls made by the counted funcs below.
+ */
+size_t hash_calls = 0;
+size_t cmp_calls = 0;
+
+/**
+ * String hash func, counts its calls.
+ */
+size_t counted_hash_string (const void *elem)
+{
+  hash_calls++;
+  return hash_string (elem);
+}
+
+/**
+ * Compares the string key of the pair, counts its calls.
+ */
+int counted_str_key_cmp (const_keyT key_1, const_keyT key_2)
+{
+  cmp_calls++;
+  return str_key_cmp (key_1, key_2);
+}
+
+/**
+ * string -> int pairs, compared by the counted compare func.
+ */
+const pair_type counted_cmp_str_int_type = {
+    0, sizeof (int), str_key_cpy, int_value_cpy,
+    counted_str_key_cmp, int_value_cmp, str_key_free, int_value_free,
+    NULL, NULL};
+
+/**
+ * Prints the hash_func / key_cmp calls made per operation since the last
+ * call, and resets the counters.
+ */
+void report_calls (const char *backend, const char *op, size_t ops)
+{
+  printf ("%-16s %-12s hash_func/op %6.3f   key_cmp/op %6.3f\n", backend, op,
+          (double) hash_calls / (double) ops,
+          (double) cmp_calls / (double) ops);
+  hash_calls = 0;
+  cmp_calls = 0;
+}
+
+/**
+ * Counts the hash_func and key_cmp calls per insert (resizes included),
+ * hit lookup and miss lookup, over long string keys.
+ */
+void bench_calls (hashmap_backend backend, const char *name)
+{
+  char (*keys)[BENCH_KEY_LEN] = malloc (BENCH_KEYS * sizeof (*keys));
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    snprintf (keys[j], BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+
+  hashmap *map = hashmap_alloc_backend (counted_hash_string, backend);
+  hash_calls = 0;
+  cmp_calls = 0;
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      pair *p = pair_alloc (keys[j], &j, &counted_cmp_str_int_type);
+      hashmap_insert_move (map, p);
+    }
+  report_calls (name, "insert", BENCH_KEYS);
+
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    hashmap_at (map, keys[j]);
+  report_calls (name, "at (hit)", BENCH_KEYS);
+
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      keys[j][0] = 'A';
+      hashmap_at (map, keys[j]);
+    }
+  report_calls (name, "at (miss)", BENCH_KEYS);
+
+  hashmap_free (&map);
+  free (keys);
+}
+
+/**
+ * @return a monotonic time stamp, in seconds.
+ */
+double now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Times building a map of BENCH_KEYS string -> int pairs and freeing it,
+ * with and without an arena.
+ */
+void bench_build_and_free (hashmap_backend backend, const char *name)
+{
+  char key[BENCH_KEY_LEN];
+  for (int use_arena = 0; use_arena < 2; ++use_arena)
+    {
+      double start = now_seconds ();
+      hashmap *map = use_arena ? hashmap_alloc_arena (hash_string, backend)
+                               : hashmap_alloc_backend (hash_string, backend);
+      for (int j = 0; j < BENCH_KEYS; ++j)
+        {
+          snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+          pair *p = pair_alloc (key, &j, &str_int_type);
+          hashmap_insert_move (map, p);
+        }
+      double built = now_seconds ();
+      hashmap_free (&map);
+      double freed = now_seconds ();
+      printf ("%-16s %-12s build %8.2f ms   free %8.2f ms\n", name,
+              use_arena ? "arena" : "malloc", (built - start) * 1e3,
+              (freed - built) * 1e3);
+    }
+}
+
+/**
+ * Inserts every line of a word list file to a chained map, and reports the
+ * max bucket chain length hash_string produces.
+ */
+void bench_hash_distribution (const char *path)
+{
+  FILE *words = fopen (path, "r");
+  if (words == NULL)
+    {
+      fprintf (stderr, "cannot open word list %s\n", path);
+      return;
+    }
+  hashmap *map = hashmap_alloc (hash_string);
+  char line[256];
+  int value = 0;
+  while (fgets (line, sizeof (line), words) != NULL)
+    {
+      line[strcspn (line, "\r\n")] = '\0';
+      pair *p = pair_alloc (line, &value, &str_int_type);
+      if (!hashmap_insert_move (map, p))
+        pair_free ((void **) &p);
+    }
+  fclose (words);
+
+  size_t max_chain = 0, used = 0;
+  for (size_t i = 0; i < map->capacity; i++)
+    if (map->buckets[i] != NULL && map->buckets[i]->size > 0)
+      {
+        used++;
+        if (map->buckets[i]->size > max_chain)
+          max_chain = map->buckets[i]->size;
+      }
+  printf ("hash_string over %s: %zu words, %zu/%zu buckets used, "
+          "max chain %zu\n", path, map->size, used, map->capacity, max_chain);
+  hashmap_free (&map);
+}
+
+/**
+ * Times looking BENCH_KEYS string keys up one at a time, and in batches of
+ * 40 (a tweet's worth of tokens), in a map too large for the cache.
+ */
+void bench_batch_lookup (hashmap_backend backend, const char *name)
+{
+  enum { BATCH = 40 };
+  char (*keys)[BENCH_KEY_LEN] = malloc (BENCH_KEYS * sizeof (*keys));
+  hashmap *map = hashmap_alloc_backend (hash_string, backend);
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      snprintf (keys[j], BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+      pair *p = pair_alloc (keys[j], &j, &str_int_type);
+      hashmap_insert_move (map, p);
+    }
+
+  // visit the keys in a scattered order, as tokens of a corpus would be
+  const_keyT *order = malloc (BENCH_KEYS * sizeof (*order));
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    order[j] = keys[(size_t) j * 7919 % BENCH_KEYS];
+
+  double start = now_seconds ();
+  size_t found = 0;
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    found += hashmap_at (map, order[j]) != NULL;
+  double single = now_seconds ();
+  valueT values[BATCH];
+  for (int j = 0; j < BENCH_KEYS; j += BATCH)
+    found += hashmap_at_batch (map, order + j, BENCH_KEYS - j < BATCH
+                               ? (size_t) (BENCH_KEYS - j) : BATCH, values);
+  double batched = now_seconds ();
+  printf ("%-16s %-12s at %8.2f ms   at_batch %8.2f ms   (%zu)\n", name,
+          "lookup", (single - start) * 1e3, (batched - single) * 1e3, found);
+
+  free (order);
+  hashmap_free (&map);
+  free (keys);
+}
+
+static int scan_all_keys (const_keyT key)
+{
+  (void) key;
+  return 1;
+}
+
+static void scan_no_op (valueT value)
+{
+  (void) value;
+}
+
+/**
+ * Times a full apply_if scan, and an iteration, over a map that grew to
+ * BENCH_KEYS pairs and then lost 90% of them.
+ */
+void bench_scan (hashmap_backend backend, const char *name)
+{
+  char key[BENCH_KEY_LEN];
+  hashmap *map = hashmap_alloc_backend (hash_string, backend);
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+      pair *p = pair_alloc (key, &j, &str_int_type);
+      hashmap_insert_move (map, p);
+    }
+  // keep every 10th pair
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    if (j % 10)
+      {
+        snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+        hashmap_erase (map, key);
+      }
+
+  double start = now_seconds ();
+  int applied = 0;
+  for (int round = 0; round < 100; ++round)
+    applied += hashmap_apply_if (map, scan_all_keys, scan_no_op);
+  double scanned = now_seconds ();
+  size_t iterated = 0;
+  for (int round = 0; round < 100; ++round)
+    {
+      hashmap_iter iter = hashmap_iter_begin (map);
+      while (hashmap_iter_next (&iter) != NULL)
+        iterated++;
+    }
+  double done = now_seconds ();
+  printf ("%-16s %-12s apply_if %8.3f ms   iter %8.3f ms   (%d, %zu)\n",
+          name, "scan", (scanned - start) * 10, (done - scanned) * 10,
+          applied / 100, iterated / 100);
+  hashmap_free (&map);
+}
+
+/**
+ * Times rebuilding a map of BENCH_KEYS string -> int pairs against opening
+ * a snapshot of it, and their lookups.
+ */
+void bench_snapshot (void)
+{
+  const char *path = "bench.snapshot";
+  const hashmap_codec int_codec = {NULL, sizeof (int)};
+  char key[BENCH_KEY_LEN];
+
+  double start = now_seconds ();
+  hashmap *map = hashmap_alloc_backend (hash_string, HASHMAP_COMPACT);
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+      pair *p = pair_alloc (key, &j, &str_int_type);
+      hashmap_insert_move (map, p);
+    }
+  double built = now_seconds ();
+  hashmap_save (map, path, &hashmap_string_codec, &int_codec);
+  double saved = now_seconds ();
+  hashmap_snapshot *snapshot = hashmap_open_mmap (path,
+                                                  &hashmap_string_codec);
+  double opened = now_seconds ();
+
+  long sum = 0;
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+      sum += *(int *) hashmap_at (map, key);
+    }
+  double looked = now_seconds ();
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      snprintf (key, BENCH_KEY_LEN, "a-long-shared-prefix-of-a-key-%d", j);
+      sum -= *(const int *) hashmap_snapshot_at (snapshot, key);
+    }
+  double snapshot_looked = now_seconds ();
+
+  printf ("%-16s %-12s build %8.2f ms   save %8.2f ms   open %8.3f ms\n",
+          "snapshot", "startup", (built - start) * 1e3, (saved - built) * 1e3,
+          (opened - saved) * 1e3);
+  printf ("%-16s %-12s at %8.2f ms   snapshot_at %8.2f ms   (%ld)\n",
+          "snapshot", "lookup", (looked - opened) * 1e3,
+          (snapshot_looked - looked) * 1e3, sum);
+  hashmap_snapshot_close (&snapshot);
+  hashmap_free (&map);
+  remove (path);
+}
+
+static inline size_t int_hash (int key)
+{
+  return (size_t) key;
+}
+
+static inline int int_eq (int a, int b)
+{
+  return a == b;
+}
+
+HASHMAP_DECLARE (int_map, int, int, int_hash, int_eq)
+
+/**
+ * An int -> int pair type, for the generic maps (the int value funcs serve
+ * the keys too).
+ */
+const pair_type int_int_type = {
+    sizeof (int), sizeof (int), int_value_cpy, int_value_cpy,
+    int_value_cmp, int_value_cmp, int_value_free, int_value_free,
+    NULL, NULL
+};
+
+/**
+ * Times BENCH_KEYS int -> int inserts and lookups, on a generic
+ * open-addressing map, and on a HASHMAP_DECLARE map of the same layout.
+ */
+void bench_typed_int (void)
+{
+  double start = now_seconds ();
+  hashmap *map = hashmap_alloc_backend (hash_int, HASHMAP_OPEN_ADDRESSING);
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    {
+      pair *p = pair_alloc (&j, &j, &int_int_type);
+      hashmap_insert_move (map, p);
+    }
+  double built = now_seconds ();
+  long sum = 0;
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    sum += *(int *) hashmap_at (map, &j);
+  double looked = now_seconds ();
+  hashmap_free (&map);
+  printf ("%-16s %-12s insert %8.2f ms   at %8.2f ms   (%ld)\n", "int -> int",
+          "generic", (built - start) * 1e3, (looked - built) * 1e3, sum);
+
+  start = now_seconds ();
+  int_map *typed = int_map_alloc ();
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    int_map_insert (typed, j, j);
+  built = now_seconds ();
+  sum = 0;
+  for (int j = 0; j < BENCH_KEYS; ++j)
+    sum += *int_map_at (typed, j);
+  looked = now_seconds ();
+  int_map_free (&typed);
+  printf ("%-16s %-12s insert %8.2f ms   at %8.2f ms   (%ld)\n", "int -> int",
+          "typed", (built - start) * 1e3, (looked - built) * 1e3, sum);
+}
+
+/**
+ * @def BENCH_SCALING_KEYS
+ * The number of int keys the writers of the scaling benchmark insert in
+ * total (split evenly between them).
+ */
+#define BENCH_SCALING_KEYS (1 << 20)
+
+/**
+ * @struct scaling_job
+ * The work of one writer of the scaling benchmark: a range of keys, and
+ * either a concurrent map or a plain map behind a global mutex.
+ */
+typedef struct scaling_job {
+    concurrent_hashmap *sharded;
+    hashmap *global;
+    pthread_mutex_t *global_lock;
+    int first;
+    int count;
+} scaling_job;
+
+static void *scaling_writer (void *arg)
+{
+  scaling_job *job = arg;
+  for (int j = job->first; j < job->first + job->count; ++j)
+    {
+      pair *p = pair_alloc (&j, &j, &int_int_type);
+      int inserted;
+      if (job->sharded != NULL)
+        inserted = concurrent_hashmap_insert_move (job->sharded, p);
+      else
+        {
+          pthread_mutex_lock (job->global_lock);
+          inserted = hashmap_insert_move (job->global, p);
+          pthread_mutex_unlock (job->global_lock);
+        }
+      if (!inserted)
+        pair_free ((void **) &p);
+    }
+  return NULL;
+}
+
+/**
+ * Times BENCH_SCALING_KEYS inserts by 1 to 32 writer threads, into a
+ * concurrent (sharded) map and into one map behind a global mutex, and
+ * reports the writers' throughput.
+ */
+void bench_concurrent_scaling (hashmap_backend backend, const char *name)
+{
+  pthread_t threads[32];
+  scaling_job jobs[32];
+  for (int nthreads = 1; nthreads <= 32; nthreads *= 2)
+    for (int sharded = 0; sharded < 2; ++sharded)
+      {
+        pthread_mutex_t global_lock = PTHREAD_MUTEX_INITIALIZER;
+        concurrent_hashmap *cmap = sharded
+            ? concurrent_hashmap_alloc (hash_int, backend, 0) : NULL;
+        hashmap *map = sharded ? NULL
+                               : hashmap_alloc_backend (hash_int, backend);
+        int per_thread = BENCH_SCALING_KEYS / nthreads;
+
+        double start = now_seconds ();
+        for (int t = 0; t < nthreads; ++t)
+          {
+            jobs[t] = (scaling_job) {cmap, map, &global_lock,
+                                     t * per_thread, per_thread};
+            pthread_create (&threads[t], NULL, scaling_writer, &jobs[t]);
+          }
+        for (int t = 0; t < nthreads; ++t)
+          pthread_join (threads[t], NULL);
+        double elapsed = now_seconds () - start;
+
+        printf ("%-16s %-12s %2d threads %8.2f Mops/s\n", name,
+                sharded ? "sharded" : "global-lock", nthreads,
+                (double) per_thread * nthreads / elapsed * 1e-6);
+        concurrent_hashmap_free (&cmap);
+        hashmap_free (&map);
+      }
+}
+
+#define BENCH_TRAIN_LINES 200000
+
+/**
+ * Times training a markov chain on a generated corpus of BENCH_TRAIN_LINES
+ * tweets by 1 to 16 threads, and reports the speedup over one thread.
+ */
+void bench_train_scaling (void)
+{
+  const char *path = "bench.corpus";
+  FILE *file = fopen (path, "w");
+  if (file == NULL)
+    return;
+  srand (1);
+  for (int line = 0; line < BENCH_TRAIN_LINES; ++line)
+    {
+      // a few frequent words, and a long tail of rare ones
+      int words = 4 + rand () % 16;
+      for (int j = 0; j < words; ++j)
+        fprintf (file, "word%d%s ", rand () % (1 + rand () % 50000),
+                 rand () % 16 == 0 ? "." : "");
+      fputc ('\n', file);
+    }
+  fclose (file);
+
+  double single = 0;
+  for (size_t nthreads = 1; nthreads <= 16; nthreads *= 2)
+    {
+      markov_chain *chain = markov_chain_alloc ();
+      corpus_reader *corpus = corpus_open (path);
+      double start = now_seconds ();
+      markov_chain_train_parallel (chain, corpus, nthreads);
+      double elapsed = now_seconds () - start;
+      if (nthreads == 1)
+        single = elapsed;
+      printf ("%-16s %-12s %2zu threads %8.2f Mtokens/s   speedup %5.2fx\n",
+              "markov", "train", nthreads,
+              (double) chain->tokens / elapsed * 1e-6, single / elapsed);
+      corpus_close (&corpus);
+      markov_chain_free (&chain);
+    }
+  remove (path);
+}
+
+/**
+ * @def SUITE_SAMPLES
+ * The most operations of a row of the suite timed one by one (the others
+ * are timed in bulk), for its latency percentiles.
+ */
+#define SUITE_SAMPLES (1UL << 20)
+
+/**
+ * @def SUITE_MIN_STRIDE
+ * The per-key rows time at most one operation in SUITE_MIN_STRIDE alone, so
+ * the clock reads hardly weigh on their throughput.
+ */
+#define SUITE_MIN_STRIDE 8UL
+
+/**
+ * @def SUITE_MIN_OPS
+ * The fewest operations of a row of the suite: small maps repeat theirs
+ * (rebuilding the map when they change it).
+ */
+#define SUITE_MIN_OPS (1UL << 20)
+
+/**
+ * @def SUITE_MISS_KEYS
+ * The most distinct keys the miss lookups draw from.
+ */
+#define SUITE_MISS_KEYS (1UL << 20)
+
+/**
+ * @def SUITE_ZIPF_THETA
+ * The skew of the Zipfian key distribution (YCSB's).
+ */
+#define SUITE_ZIPF_THETA 0.99
+
+/**
+ * @def SUITE_KEY_SIZE
+ * The bytes a key of any kind takes in the key arrays of the suite.
+ */
+#define SUITE_KEY_SIZE 16UL
+
+/**
+ * A double -> int pair type, for the generic maps (the double value funcs
+ * serve the keys too).
+ */
+const pair_type double_int_type = {
+    sizeof (double), sizeof (int), double_value_cpy, int_value_cpy,
+    double_value_cmp, int_value_cmp, double_value_free, int_value_free,
+    NULL, NULL
+};
+
+/**
+ * @return a distinct, scattered 32-bit number for each index (odd
+ * multipliers are bijections of the 32-bit numbers).
+ */
+static inline uint32_t suite_scatter (size_t index)
+{
+  return (uint32_t) index * 0x9E3779B1u;
+}
+
+static void make_int_key (void *out, size_t index)
+{
+  *(int *) out = (int) suite_scatter (index);
+}
+
+static void make_char_key (void *out, size_t index)
+{
+  *(char *) out = (char) index;
+}
+
+static void make_double_key (void *out, size_t index)
+{
+  *(double *) out = (double) suite_scatter (index) + 0.5;
+}
+
+static void make_string_key (void *out, size_t index)
+{
+  snprintf (out, SUITE_KEY_SIZE, "k%u", suite_scatter (index));
+}
+
+/**
+ * @struct suite_kind - a hash func of hash_funcs.h, and the keys it hashes.
+ * @param name the name of the hash func.
+ * @param hash the hash func.
+ * @param type the pair type of its keys (-> int).
+ * @param make_key writes the key of an index (distinct indices, distinct
+ * keys).
+ * @param max_keys the most keys the kind is benchmarked with: a char has
+ * 256 values (half of them are left for the misses), and hash_const makes
+ * every operation O(n).
+ */
+typedef struct suite_kind {
+    const char *name;
+    hash_func hash;
+    const pair_type *type;
+    void (*make_key) (void *out, size_t index);
+    size_t max_keys;
+} suite_kind;
+
+/**
+ * @struct suite_timing - the timing of a row of the suite.
+ * @param samples the latencies of the operations timed one by one, in ns.
+ * @param count the number of samples.
+ * @param stride one operation in stride is timed alone.
+ * @param ops the number of operations.
+ * @param elapsed the time of all of the operations, in ns.
+ * @param misses the cache misses of all of the operations, -1 if they
+ * cannot be counted.
+ * @param perf_fd the cache misses counter, -1 if none.
+ */
+typedef struct suite_timing {
+    uint32_t *samples;
+    size_t count;
+    size_t stride;
+    uint64_t ops;
+    uint64_t elapsed;
+    int64_t misses;
+    int perf_fd;
+} suite_timing;
+
+/**
+ * The cost of reading the clock, subtracted from the operations timed
+ * alone.
+ */
+static uint64_t clock_overhead = 0;
+
+/**
+ * @return a monotonic time stamp, in ns.
+ */
+static inline uint64_t now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * Measures clock_overhead: the fastest of many back-to-back clock reads.
+ */
+static void calibrate_clock (void)
+{
+  clock_overhead = UINT64_MAX;
+  for (int j = 0; j < 10000; ++j)
+    {
+      uint64_t start = now_ns ();
+      uint64_t elapsed = now_ns () - start;
+      if (elapsed < clock_overhead)
+        clock_overhead = elapsed;
+    }
+}
+
+/**
+ * Opens a counter of the cache misses of this thread (user space only).
+ * @return the counter's fd, -1 if perf_event_open is not available (or not
+ * permitted).
+ */
+static int perf_open_cache_misses (void)
+{
+#ifdef __linux__
+  struct perf_event_attr attr;
+  memset (&attr, 0, sizeof (attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof (attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int) syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+  return -1;
+#endif
+}
+
+/**
+ * Starts a new row: n operations are to be timed, at most SUITE_SAMPLES of
+ * them alone (all of them, for the few whole-map ones).
+ */
+static void timing_reset (suite_timing *timing, uint64_t n)
+{
+  timing->count = 0;
+  timing->stride = n < SUITE_MIN_OPS ? 1 : n / SUITE_SAMPLES;
+  if (n >= SUITE_MIN_OPS && timing->stride < SUITE_MIN_STRIDE)
+    timing->stride = SUITE_MIN_STRIDE;
+  timing->ops = 0;
+  timing->elapsed = 0;
+  timing->misses = timing->perf_fd >= 0 ? 0 : -1;
+}
+
+static void timing_start (suite_timing *timing)
+{
+#ifdef __linux__
+  if (timing->perf_fd >= 0)
+    {
+      ioctl (timing->perf_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (timing->perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+  timing->elapsed -= now_ns ();
+}
+
+static void timing_stop (suite_timing *timing, uint64_t ops)
+{
+  timing->elapsed += now_ns ();
+  timing->ops += ops;
+#ifdef __linux__
+  uint64_t misses;
+  if (timing->perf_fd >= 0)
+    {
+      ioctl (timing->perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read (timing->perf_fd, &misses, sizeof (misses))
+          == (ssize_t) sizeof (misses))
+        timing->misses += (int64_t) misses;
+    }
+#endif
+}
+
+static inline void timing_sample (suite_timing *timing, uint64_t elapsed)
+{
+  elapsed = elapsed > clock_overhead ? elapsed - clock_overhead : 0;
+  if (timing->count < SUITE_SAMPLES)
+    timing->samples[timing->count++] = elapsed > UINT32_MAX
+                                       ? UINT32_MAX : (uint32_t) elapsed;
+}
+
+/**
+ * @def SUITE_TIMED_LOOP
+ * Runs op for i from 0 to n - 1, timing one op in the timing's stride
+ * alone, and all of them in bulk.
+ */
+#define SUITE_TIMED_LOOP(timing, i, n, op)                                    \
+  do                                                                          \
+    {                                                                         \
+      timing_start (timing);                                                  \
+      for (size_t i = 0; i < (n); i++)                                        \
+        if (i % (timing)->stride == 0)                                        \
+          {                                                                   \
+            uint64_t op_start_ = now_ns ();                                   \
+            op;                                                               \
+            timing_sample (timing, now_ns () - op_start_);                    \
+          }                                                                   \
+        else                                                                  \
+          op;                                                                 \
+      timing_stop (timing, n);                                                \
+    }                                                                         \
+  while (0)
+
+static int sample_cmp (const void *a, const void *b)
+{
+  uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Prints a row of the suite: the throughput (the clock reads of the
+ * operations timed alone excluded), the latency percentiles, and the cache
+ * misses per operation.
+ * @param pairs the pairs an operation visits, 1 for the per-key ones: the
+ * throughput of the others is in pairs/s.
+ */
+static void report_row (const char *kind, const char *dist, size_t n,
+                        const char *op, size_t pairs, suite_timing *timing)
+{
+  qsort (timing->samples, timing->count, sizeof (*timing->samples),
+         sample_cmp);
+  uint64_t overhead = 2 * clock_overhead * timing->count;
+  double elapsed = (double) (timing->elapsed > overhead
+                             ? timing->elapsed - overhead : 1) * 1e-9;
+  double percentiles[3] = {0.5, 0.99, 0.999};
+  uint32_t latency[3] = {0, 0, 0};
+  for (int j = 0; timing->count > 0 && j < 3; ++j)
+    latency[j] = timing->samples[(size_t) (percentiles[j]
+                                           * (double) (timing->count - 1))];
+  printf ("%-12s %-8s %10zu %-10s %8.2f M%s/s   p50 %9u   p99 %9u   "
+          "p999 %9u ns", kind, dist, n, op,
+          (double) (timing->ops * pairs) / elapsed * 1e-6,
+          pairs == 1 ? "ops" : "pairs", latency[0], latency[1], latency[2]);
+  if (timing->misses >= 0)
+    printf ("   %7.2f misses/op",
+            (double) timing->misses / (double) timing->ops);
+  putchar ('\n');
+}
+
+/**
+ * @return the bytes allocated (and not freed) so far, 0 if unknown.
+ */
+static size_t heap_in_use (void)
+{
+#ifdef __GLIBC__
+  return mallinfo2 ().uordblks;
+#else
+  return 0;
+#endif
+}
+
+/**
+ * @struct suite_zipf - draws ranks in [0, n) by a Zipfian distribution, in
+ * O(1) (Gray et al., as YCSB does).
+ */
+typedef struct suite_zipf {
+    size_t n;
+    double zetan;
+    double alpha;
+    double eta;
+    double half_pow_theta;
+} suite_zipf;
+
+static void zipf_init (suite_zipf *zipf, size_t n)
+{
+  double zeta2 = 1.0 + pow (0.5, SUITE_ZIPF_THETA);
+  zipf->n = n;
+  zipf->zetan = 0;
+  for (size_t i = 1; i <= n; i++)
+    zipf->zetan += 1.0 / pow ((double) i, SUITE_ZIPF_THETA);
+  zipf->alpha = 1.0 / (1.0 - SUITE_ZIPF_THETA);
+  zipf->eta = (1.0 - pow (2.0 / (double) n, 1.0 - SUITE_ZIPF_THETA))
+              / (1.0 - zeta2 / zipf->zetan);
+  zipf->half_pow_theta = 1.0 + pow (0.5, SUITE_ZIPF_THETA);
+}
+
+static size_t zipf_draw (const suite_zipf *zipf, markov_rng *rng)
+{
+  double u = markov_rng_unit (rng);
+  double uz = u * zipf->zetan;
+  if (uz < 1.0)
+    return 0;
+  if (uz < zipf->half_pow_theta)
+    return 1;
+  size_t rank = (size_t) ((double) zipf->n
+                          * pow (zipf->eta * u - zipf->eta + 1.0,
+                                 zipf->alpha));
+  return rank < zipf->n ? rank : zipf->n - 1;
+}
+
+/**
+ * Fills stream with count indices in [0, n): uniformly drawn, or by a
+ * Zipfian distribution whose hot ranks are scattered over the indices.
+ */
+static void fill_stream (uint32_t *stream, size_t count, size_t n,
+                         const suite_zipf *zipf, markov_rng *rng)
+{
+  for (size_t i = 0; i < count; i++)
+    stream[i] = zipf == NULL ? (uint32_t) markov_rng_below (rng, n)
+                             : (uint32_t) ((uint64_t) zipf_draw (zipf, rng)
+                                           * 2654435761ULL % n);
+}
+
+/**
+ * Fills a map with the n keys of keys (-> their index), in their order.
+ */
+static hashmap *suite_build (const suite_kind *kind, hashmap_backend backend,
+                             const unsigned char *keys, size_t n)
+{
+  hashmap *map = hashmap_alloc_backend (kind->hash, backend);
+  for (size_t i = 0; i < n; i++)
+    {
+      int value = (int) i;
+      pair p = {(keyT) (keys + i * SUITE_KEY_SIZE), &value, kind->type, 0};
+      hashmap_insert (map, &p);
+    }
+  return map;
+}
+
+static int suite_all_keys (const_keyT key)
+{
+  (void) key;
+  return 1;
+}
+
+static void suite_increment (valueT value)
+{
+  ++*(int *) value;
+}
+
+/**
+ * Prints the structure of a map (see hashmap_stats): its used buckets, its
+ * longest bucket (probe sequence), and the bytes an entry takes in the
+ * table (and vectors) and in the pairs.
+ */
+static void report_structure (const char *kind, size_t n, const hashmap *map)
+{
+  hashmap_statistics stats;
+  if (!hashmap_stats (map, &stats) || stats.size == 0)
+    return;
+  double size = (double) stats.size;
+  printf ("%-12s %-8s %10zu %-10s %zu/%zu used, max bucket %zu, "
+          "%.1f table + %.1f pair bytes/entry\n", kind, "", n, "structure",
+          stats.used_buckets, stats.buckets, stats.max_bucket,
+          (double) (stats.table_bytes + stats.vector_bytes) / size,
+          (double) (stats.pair_bytes + stats.key_bytes + stats.value_bytes)
+          / size);
+}
+
+#ifdef HASHMAP_STATS
+/**
+ * Prints the running counters of a map (see hashmap_stats): its resizes,
+ * and the key_cmp calls a lookup made.
+ */
+static void report_counters (const char *kind, size_t n, const hashmap *map)
+{
+  hashmap_statistics stats;
+  if (!hashmap_stats (map, &stats) || stats.lookups == 0)
+    return;
+  printf ("%-12s %-8s %10zu %-10s %zu resizes in %.3f ms, "
+          "%.2f key_cmps/lookup\n", kind, "", n, "counters", stats.resizes,
+          (double) stats.resize_ns * 1e-6,
+          (double) stats.key_cmps / (double) stats.lookups);
+}
+#endif
+
+/**
+ * Benchmarks the operations of one kind of keys on maps of n of them:
+ * insert, at (hit and miss), erase, apply_if and resize (to twice the
+ * capacity and back), the lookups and erases drawing their keys uniformly
+ * and by a Zipfian distribution.
+ */
+static void bench_suite_size (const suite_kind *kind, hashmap_backend backend,
+                              size_t n, suite_timing *timing)
+{
+  size_t misses = n < SUITE_MISS_KEYS ? n : SUITE_MISS_KEYS;
+  size_t count = n > SUITE_MIN_OPS ? n : SUITE_MIN_OPS;
+  size_t rounds = (SUITE_MIN_OPS + n - 1) / n;
+  unsigned char *keys = malloc ((n + misses) * SUITE_KEY_SIZE);
+  uint32_t *stream = malloc (count * sizeof (*stream));
+  if (keys == NULL || stream == NULL)
+    {
+      fprintf (stderr, "cannot allocate %zu keys\n", n);
+      free (keys);
+      free (stream);
+      return;
+    }
+  for (size_t i = 0; i < n + misses; i++)
+    kind->make_key (keys + i * SUITE_KEY_SIZE, i);
+  const unsigned char *miss_keys = keys + n * SUITE_KEY_SIZE;
+  markov_rng rng;
+  markov_rng_seed (&rng, 24, n);
+
+  // insert, in a shuffled order, rebuilding small maps
+  for (size_t i = 0; i < n; i++)
+    stream[i] = (uint32_t) i;
+  for (size_t i = n; i-- > 1;)
+    {
+      size_t j = markov_rng_below (&rng, i + 1);
+      uint32_t swap = stream[i];
+      stream[i] = stream[j];
+      stream[j] = swap;
+    }
+  timing_reset (timing, (uint64_t) n * rounds);
+  hashmap *map = NULL;
+  size_t bytes = 0;
+  for (size_t round = 0; round < rounds; round++)
+    {
+      hashmap_free (&map);
+      size_t heap = heap_in_use ();
+      map = hashmap_alloc_backend (kind->hash, backend);
+      int value = 0;
+      pair p = {NULL, &value, kind->type, 0};
+      SUITE_TIMED_LOOP (timing, i, n,
+                        (p.key = (keyT) (keys + stream[i] * SUITE_KEY_SIZE),
+                         hashmap_insert (map, &p)));
+      bytes = heap_in_use () - heap;
+    }
+  report_row (kind->name, "shuffled", n, "insert", 1, timing);
+  if (bytes > 0)
+    printf ("%-12s %-8s %10zu %-10s %8.1f bytes/entry\n", kind->name, "", n,
+            "memory", (double) bytes / (double) map->size);
+  report_structure (kind->name, n, map);
+
+  // the whole map, at once
+  size_t passes = rounds < 8 ? 8 : rounds;
+  volatile size_t sink = 0;
+  timing_reset (timing, passes);
+  SUITE_TIMED_LOOP (timing, i, passes,
+                    sink += (size_t) hashmap_apply_if (map, suite_all_keys,
+                                                       suite_increment));
+  report_row (kind->name, "", n, "apply_if", map->size, timing);
+  size_t capacity = map->capacity;
+  timing_reset (timing, 2 * passes);
+  SUITE_TIMED_LOOP (timing, i, 2 * passes,
+                    sink += (size_t) hashmap_resize (
+                        map, i % 2 == 0 ? 2 * capacity : capacity));
+  report_row (kind->name, "", n, "resize", map->size, timing);
+
+  for (int zipfian = 0; zipfian < 2; ++zipfian)
+    {
+      const char *dist = zipfian ? "zipf" : "uniform";
+      suite_zipf zipf;
+      if (zipfian)
+        zipf_init (&zipf, n);
+      fill_stream (stream, count, n, zipfian ? &zipf : NULL, &rng);
+      timing_reset (timing, count);
+      SUITE_TIMED_LOOP (timing, i, count,
+                        sink += hashmap_at (map, keys + stream[i]
+                                                 * SUITE_KEY_SIZE) != NULL);
+      report_row (kind->name, dist, n, "at (hit)", 1, timing);
+
+      if (zipfian)
+        zipf_init (&zipf, misses);
+      fill_stream (stream, count, misses, zipfian ? &zipf : NULL, &rng);
+      timing_reset (timing, count);
+      SUITE_TIMED_LOOP (timing, i, count,
+                        sink += hashmap_at (map, miss_keys + stream[i]
+                                                     * SUITE_KEY_SIZE)
+                                != NULL);
+      report_row (kind->name, dist, n, "at (miss)", 1, timing);
+#ifdef HASHMAP_STATS
+      report_counters (kind->name, n, map);
+#endif
+
+      // n erases (a key drawn again misses), rebuilding small maps
+      if (zipfian)
+        zipf_init (&zipf, n);
+      fill_stream (stream, n, n, zipfian ? &zipf : NULL, &rng);
+      timing_reset (timing, (uint64_t) n * rounds);
+      for (size_t round = 0; round < rounds; round++)
+        {
+          if (map == NULL)
+            map = suite_build (kind, backend, keys, n);
+          SUITE_TIMED_LOOP (timing, i, n,
+                            sink += (size_t) hashmap_erase (
+                                map, keys + stream[i] * SUITE_KEY_SIZE));
+          hashmap_free (&map);
+        }
+      report_row (kind->name, dist, n, "erase", 1, timing);
+      if (!zipfian)
+        map = suite_build (kind, backend, keys, n);
+    }
+  free (stream);
+  free (keys);
+}
+
+/**
+ * Benchmarks every hash func of hash_funcs.h, with its keys, on maps of
+ * 1e3 to max_size (by powers of 10) keys.
+ */
+void bench_suite (size_t max_size, hashmap_backend backend)
+{
+  const suite_kind kinds[] = {
+      {"hash_int", hash_int, &int_int_type, make_int_key, SIZE_MAX},
+      {"hash_char", hash_char, &char_int_type, make_char_key, 128},
+      {"hash_double", hash_double, &double_int_type, make_double_key,
+       SIZE_MAX},
+      {"hash_string", hash_string, &str_int_type, make_string_key, SIZE_MAX},
+      {"hash_const", hash_const, &int_int_type, make_int_key, 1000}};
+  suite_timing timing = {malloc (SUITE_SAMPLES * sizeof (uint32_t)), 0, 1,
+                         0, 0, -1, perf_open_cache_misses ()};
+  if (timing.samples == NULL)
+    return;
+  calibrate_clock ();
+  printf ("clock overhead %llu ns, cache misses %s\n",
+          (unsigned long long) clock_overhead,
+          timing.perf_fd >= 0 ? "counted" : "not available");
+
+  for (size_t k = 0; k < sizeof (kinds) / sizeof (*kinds); ++k)
+    for (size_t n = 1000; n <= max_size; n *= 10)
+      {
+        // the kinds of few keys run once, with all of them
+        bench_suite_size (&kinds[k], backend,
+                          n < kinds[k].max_keys ? n : kinds[k].max_keys,
+                          &timing);
+        if (n >= kinds[k].max_keys)
+          break;
+      }
+#ifdef __linux__
+  if (timing.perf_fd >= 0)
+    close (timing.perf_fd);
+#endif
+  free (timing.samples);
+}
+
+int main (int argc, char *argv[])
+{
+  if (argc > 1 && strcmp (argv[1], "--suite") == 0)
+    {
+      hashmap_backend backend = HASHMAP_CHAINED;
+      if (argc > 3 && strcmp (argv[3], "open-addressing") == 0)
+        backend = HASHMAP_OPEN_ADDRESSING;
+      else if (argc > 3 && strcmp (argv[3], "compact") == 0)
+        backend = HASHMAP_COMPACT;
+      bench_suite (argc > 2 ? strtoull (argv[2], NULL, 10) : 1000000,
+                   backend);
+      return 0;
+    }
+  bench_calls (HASHMAP_CHAINED, "chained");
+  bench_calls (HASHMAP_OPEN_ADDRESSING, "open-addressing");
+  bench_calls (HASHMAP_COMPACT, "compact");
+  bench_build_and_free (HASHMAP_CHAINED, "chained");
+  bench_build_and_free (HASHMAP_OPEN_ADDRESSING, "open-addressing");
+  bench_build_and_free (HASHMAP_COMPACT, "compact");
+  bench_batch_lookup (HASHMAP_CHAINED, "chained");
+  bench_batch_lookup (HASHMAP_OPEN_ADDRESSING, "open-addressing");
+  bench_batch_lookup (HASHMAP_COMPACT, "compact");
+  bench_scan (HASHMAP_CHAINED, "chained");
+  bench_scan (HASHMAP_OPEN_ADDRESSING, "open-addressing");
+  bench_scan (HASHMAP_COMPACT, "compact");
+  bench_typed_int ();
+  bench_snapshot ();
+  bench_concurrent_scaling (HASHMAP_CHAINED, "chained");
+  bench_concurrent_scaling (HASHMAP_OPEN_ADDRESSING, "open-addressing");
+  bench_concurrent_scaling (HASHMAP_COMPACT, "compact");
+  bench_train_scaling ();
+  if (argc > 1)
+    bench_hash_distribution (argv[1]);
+  return 0;
+}
@@ -0,0 +1,239 @@
+#include <stdlib.h>
+#include "concurrent_hashmap.h"
+#include "hashmap_group.h"
+
+/**
+ * @return the shard the given key belongs to.
+ */
+static hashmap_shard *shard_of (const concurrent_hashmap *map, const_keyT key)
+{
+  uint64_t mixed = mix_hash (map->hash_func (key));
+  // shard_shift is 64 for a single shard, and a 64-bit shift is undefined
+  size_t ind = map->shard_count == 1 ? 0 : (size_t) (mixed >> map->shard_shift);
+  return &map->shards[ind];
+}
+
+/**
+ * Allocates dynamically new concurrent hash map element.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout of the shards.
+ * @param shard_count the number of shards, rounded up to a power of 2
+ * (0 for CONCURRENT_HASHMAP_DEFAULT_SHARDS).
+ * @return pointer to dynamically allocated concurrent hash map.
+ * @if_fail return NULL.
+ */
+concurrent_hashmap *concurrent_hashmap_alloc (hash_func func,
+                                              hashmap_backend backend,
+                                              size_t shard_count)
+{
+  if (func == NULL)
+    return NULL;
+  if (shard_count == 0)
+    shard_count = CONCURRENT_HASHMAP_DEFAULT_SHARDS;
+
+  concurrent_hashmap *map = malloc (sizeof (*map));
+  if (map == NULL)
+    return NULL;
+
+  map->shard_count = 1;
+  map->shard_shift = 64;
+  while (map->shard_count < shard_count)
+    {
+      map->shard_count *= 2;
+      map->shard_shift--;
+    }
+  map->hash_func = func;
+  map->shards = aligned_alloc (_Alignof (hashmap_shard),
+                               map->shard_count * sizeof (hashmap_shard));
+  if (map->shards == NULL)
+    {
+      free (map);
+      return NULL;
+    }
+
+  for (size_t i = 0; i < map->shard_count; i++)
+    {
+      map->shards[i].map = hashmap_alloc_backend (func, backend);
+      if (map->shards[i].map == NULL
+          || pthread_rwlock_init (&map->shards[i].lock, NULL) != 0)
+        {
+          // undo the shards allocated so far
+          hashmap_free (&map->shards[i].map);
+          map->shard_count = i;
+          concurrent_hashmap_free (&map);
+          return NULL;
+        }
+    }
+  return map;
+}
+
+/**
+ * Frees a concurrent hash map and all its shards.
+ * No other thread may use the map during (or after) the call.
+ * @param p_map pointer to dynamically allocated pointer to the map.
+ */
+void concurrent_hashmap_free (concurrent_hashmap **p_map)
+{
+  if (p_map == NULL || *p_map == NULL)
+    return;
+
+  concurrent_hashmap *map = *p_map;
+  for (size_t i = 0; i < map->shard_count; i++)
+    {
+      hashmap_free (&map->shards[i].map);
+      pthread_rwlock_destroy (&map->shards[i].lock);
+    }
+  free (map->shards);
+  free (map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair to the map (see hashmap_insert).
+ * @param map a concurrent hash map.
+ * @param in_pair a pair the map would contain a copy of.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int concurrent_hashmap_insert (concurrent_hashmap *map, const pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL)
+    return 0;
+
+  hashmap_shard *shard = shard_of (map, in_pair->key);
+  pthread_rwlock_wrlock (&shard->lock);
+  int inserted = hashmap_insert (shard->map, in_pair);
+  pthread_rwlock_unlock (&shard->lock);
+  return inserted;
+}
+
+/**
+ * Inserts in_pair itself to the map (see hashmap_insert_move).
+ * @param map a concurrent hash map.
+ * @param in_pair a dynamically allocated pair.
+ * @return returns 1 for successful insertion, 0 otherwise (then in_pair is
+ * still owned by the caller).
+ */
+int concurrent_hashmap_insert_move (concurrent_hashmap *map, pair *in_pair)
+{
+  if (map == NULL || in_pair == NULL)
+    return 0;
+
+  hashmap_shard *shard = shard_of (map, in_pair->key);
+  pthread_rwlock_wrlock (&shard->lock);
+  int inserted = hashmap_insert_move (shard->map, in_pair);
+  pthread_rwlock_unlock (&shard->lock);
+  return inserted;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * The value is not locked after the call: it stays valid only as long as
+ * no thread erases its key, and the caller must synchronize any access to
+ * it with the writers (concurrent_hashmap_update is the locked way).
+ * @param map a concurrent hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT concurrent_hashmap_at (concurrent_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    return NULL;
+
+  hashmap_shard *shard = shard_of (map, key);
+  pthread_rwlock_rdlock (&shard->lock);
+  valueT value = hashmap_at (shard->map, key);
+  pthread_rwlock_unlock (&shard->lock);
+  return value;
+}
+
+/**
+ * Applies val_fn on the value associated with key, while holding the lock
+ * of its shard (so concurrent updates of the same key are serialized).
+ * @param map a concurrent hash map.
+ * @param key the key whose value is modified.
+ * @param val_fn a function that modifies valueT, in-place.
+ * @param ctx a user context, passed to val_fn.
+ * @return 1 if key is in the map (and val_fn was applied), 0 otherwise.
+ */
+int concurrent_hashmap_update (concurrent_hashmap *map, const_keyT key,
+                               valueT_ctx_func val_fn, void *ctx)
+{
+  if (map == NULL || key == NULL || val_fn == NULL)
+    return 0;
+
+  hashmap_shard *shard = shard_of (map, key);
+  pthread_rwlock_wrlock (&shard->lock);
+  valueT value = hashmap_at (shard->map, key);
+  if (value != NULL)
+    val_fn (value, ctx);
+  pthread_rwlock_unlock (&shard->lock);
+  return value != NULL;
+}
+
+/**
+ * The function erases the pair associated with key (see hashmap_erase).
+ * @param map a concurrent hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int concurrent_hashmap_erase (concurrent_hashmap *map, const_keyT key)
+{
+  if (map == NULL || key == NULL)
+    return 0;
+
+  hashmap_shard *shard = shard_of (map, key);
+  pthread_rwlock_wrlock (&shard->lock);
+  int erased = hashmap_erase (shard->map, key);
+  pthread_rwlock_unlock (&shard->lock);
+  return erased;
+}
+
+/**
+ * @param map a concurrent hash map.
+ * @return the number of pairs in the map (each shard counted under its
+ * lock, so concurrent writers may change the total meanwhile).
+ */
+size_t concurrent_hashmap_size (concurrent_hashmap *map)
+{
+  if (map == NULL)
+    return 0;
+
+  size_t size = 0;
+  for (size_t i = 0; i < map->shard_count; i++)
+    {
+      pthread_rwlock_rdlock (&map->shards[i].lock);
+      size += map->shards[i].map->size;
+      pthread_rwlock_unlock (&map->shards[i].lock);
+    }
+  return size;
+}
+
+/**
+ * Applies val_fn on the values whose keys fulfill key_pred, over the whole
+ * map. The shards are locked one at a time, so writers are blocked only on
+ * the shard being scanned.
+ * @param map a concurrent hash map.
+ * @param key_pred a function that checks a condition on keyT
+ *        and return 1 if true, 0 else
+ * @param val_fn a function that modifies valueT, in-place
+ * @param ctx a user context, passed to both callbacks
+ * @return number of changed values
+ */
+int concurrent_hashmap_apply_if (concurrent_hashmap *map,
+                                 keyT_ctx_func key_pred,
+                                 valueT_ctx_func val_fn, void *ctx)
+{
+  int counter = 0;
+  if (map == NULL || key_pred == NULL || val_fn == NULL)
+    return counter;
+
+  for (size_t i = 0; i < map->shard_count; i++)
+    {
+      pthread_rwlock_wrlock (&map->shards[i].lock);
+      counter += hashmap_apply_if_parallel (map->shards[i].map, 1, key_pred,
+                                            val_fn, ctx);
+      pthread_rwlock_unlock (&map->shards[i].lock);
+    }
+  return counter;
+}
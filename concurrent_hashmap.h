@@ -0,0 +1,134 @@
+#ifndef CONCURRENT_HASHMAP_H_
+#define CONCURRENT_HASHMAP_H_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+/**
+ * @def CONCURRENT_HASHMAP_DEFAULT_SHARDS
+ * The number of shards concurrent_hashmap_alloc uses when given 0.
+ */
+#define CONCURRENT_HASHMAP_DEFAULT_SHARDS 64UL
+
+/**
+ * @struct hashmap_shard - a hash map and the lock guarding it.
+ * Each shard takes a whole cache line, so the locks of neighbour shards
+ * are not falsely shared between the cores.
+ * @param lock readers (at) share it, writers (insert / erase) hold it alone.
+ * @param map the pairs of the shard, resized on its own.
+ */
+typedef struct hashmap_shard {
+    _Alignas (64) pthread_rwlock_t lock;
+    hashmap *map;
+} hashmap_shard;
+
+/**
+ * @struct concurrent_hashmap - a hash map safe for concurrent writers.
+ * Each key belongs to one shard, chosen by the high bits of its mixed
+ * hash (the shard's own table indexes by the low bits), so threads
+ * working on different shards never wait for each other.
+ * @param shards the shards array.
+ * @param shard_count the number of shards (a power of 2).
+ * @param shard_shift the shift of the mixed hash giving the shard index.
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct concurrent_hashmap {
+    hashmap_shard *shards;
+    size_t shard_count;
+    unsigned shard_shift;
+    hash_func hash_func;
+} concurrent_hashmap;
+
+/**
+ * Allocates dynamically new concurrent hash map element.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout of the shards.
+ * @param shard_count the number of shards, rounded up to a power of 2
+ * (0 for CONCURRENT_HASHMAP_DEFAULT_SHARDS).
+ * @return pointer to dynamically allocated concurrent hash map.
+ * @if_fail return NULL.
+ */
+concurrent_hashmap *concurrent_hashmap_alloc (hash_func func,
+                                              hashmap_backend backend,
+                                              size_t shard_count);
+
+/**
+ * Frees a concurrent hash map and all its shards.
+ * No other thread may use the map during (or after) the call.
+ * @param p_map pointer to dynamically allocated pointer to the map.
+ */
+void concurrent_hashmap_free (concurrent_hashmap **p_map);
+
+/**
+ * Inserts a copy of in_pair to the map (see hashmap_insert).
+ * @param map a concurrent hash map.
+ * @param in_pair a pair the map would contain a copy of.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int concurrent_hashmap_insert (concurrent_hashmap *map, const pair *in_pair);
+
+/**
+ * Inserts in_pair itself to the map (see hashmap_insert_move).
+ * @param map a concurrent hash map.
+ * @param in_pair a dynamically allocated pair.
+ * @return returns 1 for successful insertion, 0 otherwise (then in_pair is
+ * still owned by the caller).
+ */
+int concurrent_hashmap_insert_move (concurrent_hashmap *map, pair *in_pair);
+
+/**
+ * The function returns the value associated with the given key.
+ * The value is not locked after the call: it stays valid only as long as
+ * no thread erases its key, and the caller must synchronize any access to
+ * it with the writers (concurrent_hashmap_update is the locked way).
+ * @param map a concurrent hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
+ */
+valueT concurrent_hashmap_at (concurrent_hashmap *map, const_keyT key);
+
+/**
+ * Applies val_fn on the value associated with key, while holding the lock
+ * of its shard (so concurrent updates of the same key are serialized).
+ * @param map a concurrent hash map.
+ * @param key the key whose value is modified.
+ * @param val_fn a function that modifies valueT, in-place.
+ * @param ctx a user context, passed to val_fn.
+ * @return 1 if key is in the map (and val_fn was applied), 0 otherwise.
+ */
+int concurrent_hashmap_update (concurrent_hashmap *map, const_keyT key,
+                               valueT_ctx_func val_fn, void *ctx);
+
+/**
+ * The function erases the pair associated with key (see hashmap_erase).
+ * @param map a concurrent hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int concurrent_hashmap_erase (concurrent_hashmap *map, const_keyT key);
+
+/**
+ * @param map a concurrent hash map.
+ * @return the number of pairs in the map (each shard counted under its
+ * lock, so concurrent writers may change the total meanwhile).
+ */
+size_t concurrent_hashmap_size (concurrent_hashmap *map);
+
+/**
+ * Applies val_fn on the values whose keys fulfill key_pred, over the whole
+ * map. The shards are locked one at a time, so writers are blocked only on
+ * the shard being scanned.
+ * @param map a concurrent hash map.
+ * @param key_pred a function that checks a condition on keyT
+ *        and return 1 if true, 0 else
+ * @param val_fn a function that modifies valueT, in-place
+ * @param ctx a user context, passed to both callbacks
+ * @return number of changed values
+ */
+int concurrent_hashmap_apply_if (concurrent_hashmap *map,
+                                 keyT_ctx_func key_pred,
+                                 valueT_ctx_func val_fn, void *ctx);
+
+#endif //CONCURRENT_HASHMAP_H_
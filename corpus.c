@@ -0,0 +1,253 @@
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "corpus.h"
+
+/**
+ * @return 1 if c separates tokens, 0 otherwise. A NUL separates tokens too,
+ * so a token never contains one.
+ */
+static inline int corpus_is_delimiter (char c)
+{
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '\0';
+}
+
+/**
+ * Maps a regular file, for the reader to read it in place.
+ * @return 1 if the process has succeeded, 0 else (the file is to be read)
+ */
+static int corpus_map (corpus_reader *reader)
+{
+  struct stat st;
+  if (fstat (reader->fd, &st) != 0 || !S_ISREG (st.st_mode)
+      || st.st_size == 0)
+    return 0;
+  void *data = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE,
+                     reader->fd, 0);
+  if (data == MAP_FAILED)
+    return 0;
+  // the corpus is read once, front to back
+  madvise (data, (size_t) st.st_size, MADV_SEQUENTIAL);
+  reader->data = data;
+  reader->length = (size_t) st.st_size;
+  reader->mapped = 1;
+  reader->eof = 1;
+  return 1;
+}
+
+/**
+ * Allocates a reader over nothing yet.
+ * @param fd the corpus file descriptor, -1 for none.
+ * @return pointer to dynamically allocated reader, NULL if failed.
+ */
+static corpus_reader *corpus_reader_alloc (int fd)
+{
+  corpus_reader *reader = malloc (sizeof (*reader));
+  if (reader == NULL)
+    return NULL;
+  reader->fd = fd;
+  reader->data = NULL;
+  reader->length = 0;
+  reader->pos = 0;
+  reader->buffer = NULL;
+  reader->buffer_size = 0;
+  reader->mapped = 0;
+  reader->eof = 0;
+  reader->error = 0;
+  return reader;
+}
+
+/**
+ * Opens a corpus reader over an open file descriptor (see corpus_open).
+ * @param fd an open file descriptor, owned by the reader from now on.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (out of memory) return NULL, fd is closed.
+ */
+corpus_reader *corpus_open_fd (int fd)
+{
+  if (fd < 0)
+    return NULL;
+
+  corpus_reader *reader = corpus_reader_alloc (fd);
+  if (reader == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+  if (corpus_map (reader))
+    return reader;
+
+  reader->buffer = malloc (CORPUS_CHUNK_SIZE);
+  if (reader->buffer == NULL)
+    {
+      corpus_close (&reader);
+      return NULL;
+    }
+  reader->buffer_size = CORPUS_CHUNK_SIZE;
+  reader->data = reader->buffer;
+  return reader;
+}
+
+/**
+ * Opens a corpus file for reading: a regular file is mapped, any other
+ * file (such as a pipe) is read in chunks of CORPUS_CHUNK_SIZE.
+ * @param path the corpus file, "-" for the standard input.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (no such file, or out of memory) return NULL.
+ */
+corpus_reader *corpus_open (const char *path)
+{
+  if (path == NULL)
+    return NULL;
+  if (strcmp (path, "-") == 0)
+    return corpus_open_fd (dup (STDIN_FILENO));
+  return corpus_open_fd (open (path, O_RDONLY));
+}
+
+/**
+ * Opens a corpus reader over a corpus in memory (such as a part of another
+ * reader's corpus, see corpus_load).
+ * @param data the corpus, not owned by the reader (it must outlive it).
+ * @param length the number of bytes of the corpus.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (out of memory) return NULL.
+ */
+corpus_reader *corpus_open_memory (const char *data, size_t length)
+{
+  if (data == NULL && length > 0)
+    return NULL;
+
+  corpus_reader *reader = corpus_reader_alloc (-1);
+  if (reader == NULL)
+    return NULL;
+  reader->data = data;
+  reader->length = length;
+  reader->eof = 1;
+  return reader;
+}
+
+/**
+ * Reads the next chunk of the corpus into the read buffer, after the part
+ * of the current line read so far (moved to the buffer's start). The
+ * buffer grows if the line fills it.
+ * @return 1 if the process has succeeded, 0 else (reader->error is set)
+ */
+static int corpus_fill (corpus_reader *reader)
+{
+  memmove (reader->buffer, reader->buffer + reader->pos,
+           reader->length - reader->pos);
+  reader->length -= reader->pos;
+  reader->pos = 0;
+  if (reader->length == reader->buffer_size)
+    {
+      char *grown = realloc (reader->buffer, 2 * reader->buffer_size);
+      if (grown == NULL)
+        {
+          reader->error = 1;
+          return 0;
+        }
+      reader->buffer = grown;
+      reader->buffer_size *= 2;
+      reader->data = grown;
+    }
+
+  ssize_t count;
+  do
+    count = read (reader->fd, reader->buffer + reader->length,
+                  reader->buffer_size - reader->length);
+  while (count < 0 && errno == EINTR);
+  if (count < 0)
+    {
+      reader->error = 1;
+      return 0;
+    }
+  reader->length += (size_t) count;
+  reader->eof = count == 0;
+  return 1;
+}
+
+/**
+ * Brings the rest of the corpus into memory (a mapped file already is): on
+ * success, it is reader->data from reader->pos to reader->length.
+ * @param reader a corpus reader.
+ * @return 1 if the process has succeeded, 0 else (reader->error is set)
+ */
+int corpus_load (corpus_reader *reader)
+{
+  if (reader == NULL || reader->error)
+    return 0;
+  while (!reader->eof)
+    if (!corpus_fill (reader))
+      return 0;
+  return 1;
+}
+
+/**
+ * Reads the next line of the corpus, split to tokens on spaces, tabs, CRs
+ * and NULs. A line of more than CORPUS_MAX_TOKENS tokens is yielded in
+ * parts, as if it were several lines.
+ * @param reader a corpus reader.
+ * @param tokens output: the tokens of the line (valid until the next call).
+ * @param n output: the number of tokens of the line, may be 0.
+ * @return 1 if a line was read, 0 at the end of the corpus or if reading
+ * failed (reader->error is set).
+ */
+int corpus_next_line (corpus_reader *reader, const token_view **tokens,
+                      size_t *n)
+{
+  if (reader == NULL || tokens == NULL || n == NULL || reader->error)
+    return 0;
+
+  // read until the buffer holds a whole line (a mapped file always does)
+  const char *newline;
+  while ((newline = memchr (reader->data + reader->pos, '\n',
+                            reader->length - reader->pos)) == NULL
+         && !reader->eof)
+    if (!corpus_fill (reader))
+      return 0;
+  if (newline == NULL && reader->pos == reader->length)
+    return 0;
+
+  const char *data = reader->data;
+  size_t end = newline == NULL ? reader->length : (size_t) (newline - data);
+  size_t i = reader->pos, count = 0;
+  for (;;)
+    {
+      while (i < end && corpus_is_delimiter (data[i]))
+        i++;
+      if (i == end || count == CORPUS_MAX_TOKENS)
+        break;
+      size_t start = i;
+      while (i < end && !corpus_is_delimiter (data[i]))
+        i++;
+      reader->tokens[count++] = (token_view) {data + start, i - start};
+    }
+  // the rest of a too long line is the next line
+  reader->pos = i < end ? i : end + (newline != NULL);
+
+  *tokens = reader->tokens;
+  *n = count;
+  return 1;
+}
+
+/**
+ * Closes a corpus file, and frees the reader.
+ * @param p_reader pointer to dynamically allocated pointer to reader.
+ */
+void corpus_close (corpus_reader **p_reader)
+{
+  if (p_reader == NULL || *p_reader == NULL)
+    return;
+  corpus_reader *reader = *p_reader;
+  if (reader->buffer != NULL)
+    free (reader->buffer);
+  else if (reader->mapped)
+    munmap ((void *) reader->data, reader->length);
+  if (reader->fd >= 0)
+    close (reader->fd);
+  free (reader);
+  *p_reader = NULL;
+}
@@ -0,0 +1,109 @@
+#ifndef CORPUS_H_
+#define CORPUS_H_
+
+#include <stdlib.h>
+
+/**
+ * @def CORPUS_CHUNK_SIZE
+ * The size of the reads of a corpus that cannot be mapped (such as a pipe).
+ */
+#define CORPUS_CHUNK_SIZE (1UL << 20)
+
+/**
+ * @def CORPUS_MAX_TOKENS
+ * The most tokens of a line yielded at once, longer lines are split.
+ */
+#define CORPUS_MAX_TOKENS 1024UL
+
+/**
+ * @struct token_view - a token of the corpus, not NUL-terminated.
+ * @param ptr the first char of the token, in the reader's memory.
+ * @param len the number of chars of the token.
+ */
+typedef struct token_view {
+    const char *ptr;
+    size_t len;
+} token_view;
+
+/**
+ * @struct corpus_reader - reads a corpus line by line, as token views into
+ * the corpus itself: the mapped file, or a buffer of chunks read from it.
+ * @param fd the corpus file descriptor, -1 for a corpus in memory.
+ * @param data the mapped file, the read buffer, or the corpus in memory.
+ * @param length the number of bytes of data.
+ * @param pos the offset of the next line in data.
+ * @param buffer the read buffer, NULL if the file is mapped (or in memory).
+ * @param buffer_size the size of the read buffer.
+ * @param mapped 1 if data is a mapping of the file.
+ * @param eof 1 if the whole corpus is in data.
+ * @param error 1 if reading the corpus failed.
+ * @param tokens the tokens of the current line.
+ */
+typedef struct corpus_reader {
+    int fd;
+    const char *data;
+    size_t length;
+    size_t pos;
+    char *buffer;
+    size_t buffer_size;
+    int mapped;
+    int eof;
+    int error;
+    token_view tokens[CORPUS_MAX_TOKENS];
+} corpus_reader;
+
+/**
+ * Opens a corpus file for reading: a regular file is mapped, any other
+ * file (such as a pipe) is read in chunks of CORPUS_CHUNK_SIZE.
+ * @param path the corpus file, "-" for the standard input.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (no such file, or out of memory) return NULL.
+ */
+corpus_reader *corpus_open (const char *path);
+
+/**
+ * Opens a corpus reader over an open file descriptor (see corpus_open).
+ * @param fd an open file descriptor, owned by the reader from now on.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (out of memory) return NULL, fd is closed.
+ */
+corpus_reader *corpus_open_fd (int fd);
+
+/**
+ * Opens a corpus reader over a corpus in memory (such as a part of another
+ * reader's corpus, see corpus_load).
+ * @param data the corpus, not owned by the reader (it must outlive it).
+ * @param length the number of bytes of the corpus.
+ * @return pointer to dynamically allocated reader.
+ * @if_fail (out of memory) return NULL.
+ */
+corpus_reader *corpus_open_memory (const char *data, size_t length);
+
+/**
+ * Brings the rest of the corpus into memory (a mapped file already is): on
+ * success, it is reader->data from reader->pos to reader->length.
+ * @param reader a corpus reader.
+ * @return 1 if the process has succeeded, 0 else (reader->error is set)
+ */
+int corpus_load (corpus_reader *reader);
+
+/**
+ * Reads the next line of the corpus, split to tokens on spaces, tabs, CRs
+ * and NULs. A line of more than CORPUS_MAX_TOKENS tokens is yielded in
+ * parts, as if it were several lines.
+ * @param reader a corpus reader.
+ * @param tokens output: the tokens of the line (valid until the next call).
+ * @param n output: the number of tokens of the line, may be 0.
+ * @return 1 if a line was read, 0 at the end of the corpus or if reading
+ * failed (reader->error is set).
+ */
+int corpus_next_line (corpus_reader *reader, const token_view **tokens,
+                      size_t *n);
+
+/**
+ * Closes a corpus file, and frees the reader.
+ * @param p_reader pointer to dynamically allocated pointer to reader.
+ */
+void corpus_close (corpus_reader **p_reader);
+
+#endif //CORPUS_H_
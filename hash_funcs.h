@@ -2,13 +2,14 @@
 #define HASHFUNCS_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #define CONST 1
 
 /**
  * Integers simple hash func.
  */
-size_t hash_int(const void *elem){
+static inline size_t hash_int(const void *elem){
     size_t hash = *((int *) elem);
     return hash;
 }
@@ -16,7 +17,7 @@ size_t hash_int(const void *elem){
 /**
  * Chars simple hash func.
  */
-size_t hash_char(const void *elem){
+static inline size_t hash_char(const void *elem){
     size_t hash = *((char *) elem);
     return hash;
 }
@@ -24,28 +25,137 @@ size_t hash_char(const void *elem){
 /**
  * Doubles simple hash func.
  */
-size_t hash_double(const void *elem){
+static inline size_t hash_double(const void *elem){
     size_t hash = *((double *) elem);
     return hash;
 }
 
 /**
- * String simple hash func.
+ * @def HASH_SECRET_0 .. HASH_SECRET_3
+ * Odd 64-bit constants (with balanced bits) mixed into the string hash.
  */
-size_t hash_string(const void *elem){
-  size_t hash = 0;
-  char *s = (char *) elem;
-  for (size_t i = 0; i < strlen(s); i++)
-    hash += s[i];
-  hash += strlen(s);
-  return hash;
+#define HASH_SECRET_0 0xa0761d6478bd642fULL
+#define HASH_SECRET_1 0xe7037ed1a0b428dbULL
+#define HASH_SECRET_2 0x8ebc6af09c88c6e3ULL
+#define HASH_SECRET_3 0x589965cc75374cc3ULL
+
+/**
+ * Multiplies *a and *b into 128 bits: *a gets the low half, *b the high one.
+ */
+static inline void hash_mum(uint64_t *a, uint64_t *b){
+#ifdef __SIZEOF_INT128__
+  __uint128_t r = (__uint128_t) *a * *b;
+  *a = (uint64_t) r;
+  *b = (uint64_t) (r >> 64);
+#else
+  uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b;
+  uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+  uint64_t t = rl + (rm0 << 32), c = t < rl;
+  uint64_t lo = t + (rm1 << 32);
+  c += lo < t;
+  *a = lo;
+  *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+/**
+ * Multiplies a and b into 128 bits, and folds the halves with xor.
+ */
+static inline uint64_t hash_mix(uint64_t a, uint64_t b){
+  hash_mum (&a, &b);
+  return a ^ b;
+}
+
+/**
+ * Unaligned reads of 8 / 4 bytes (in native byte order).
+ */
+static inline uint64_t hash_read8(const unsigned char *p){
+  uint64_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+static inline uint64_t hash_read4(const unsigned char *p){
+  uint32_t v;
+  memcpy (&v, p, sizeof (v));
+  return v;
+}
+
+/**
+ * Length-aware string hash (wyhash-like), for len bytes at ptr which don't
+ * need to be NUL-terminated. Consumes 16 bytes per step (48 bytes per step,
+ * on three independent lanes, for long strings), and every byte is mixed by
+ * a full 64x64->128 multiply, so anagrams and short words spread well.
+ */
+static inline size_t hash_string_n(const void *ptr, size_t len){
+  const unsigned char *p = (const unsigned char *) ptr;
+  uint64_t seed = hash_mix (HASH_SECRET_0, HASH_SECRET_1);
+  uint64_t a, b;
+  if (len <= 16)
+    {
+      if (len >= 4)
+        {
+          size_t mid = (len >> 3) << 2;
+          a = (hash_read4 (p) << 32) | hash_read4 (p + mid);
+          b = (hash_read4 (p + len - 4) << 32) | hash_read4 (p + len - 4 - mid);
+        }
+      else if (len > 0)
+        {
+          a = ((uint64_t) p[0] << 16) | ((uint64_t) p[len >> 1] << 8)
+              | p[len - 1];
+          b = 0;
+        }
+      else
+        a = b = 0;
+    }
+  else
+    {
+      size_t i = len;
+      if (i > 48)
+        {
+          uint64_t see1 = seed, see2 = seed;
+          do
+            {
+              seed = hash_mix (hash_read8 (p) ^ HASH_SECRET_1,
+                               hash_read8 (p + 8) ^ seed);
+              see1 = hash_mix (hash_read8 (p + 16) ^ HASH_SECRET_2,
+                               hash_read8 (p + 24) ^ see1);
+              see2 = hash_mix (hash_read8 (p + 32) ^ HASH_SECRET_3,
+                               hash_read8 (p + 40) ^ see2);
+              p += 48;
+              i -= 48;
+            }
+          while (i > 48);
+          seed ^= see1 ^ see2;
+        }
+      while (i > 16)
+        {
+          seed = hash_mix (hash_read8 (p) ^ HASH_SECRET_1,
+                           hash_read8 (p + 8) ^ seed);
+          i -= 16;
+          p += 16;
+        }
+      a = hash_read8 (p + i - 16);
+      b = hash_read8 (p + i - 8);
+    }
+  a ^= HASH_SECRET_1;
+  b ^= seed;
+  hash_mum (&a, &b);
+  return (size_t) hash_mix (a ^ HASH_SECRET_0 ^ len, b ^ HASH_SECRET_1);
+}
+
+/**
+ * String hash func (of a NUL-terminated string), see hash_string_n.
+ */
+static inline size_t hash_string(const void *elem){
+  return hash_string_n (elem, strlen ((const char *) elem));
 }
 
 /**
  * Hash all the elements to constant key
  */
-size_t hash_const(const void *elem){
+static inline size_t hash_const(const void *elem){
   return *((int *) elem) * 0 + CONST;
 }
 
-#endif // HASHFUNCS_H_
\ No newline at end of file
+#endif // HASHFUNCS_H_
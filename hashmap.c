@@ -1,13 +1,136 @@
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef HASHMAP_STATS
+#include <time.h>
+#endif
 #include "hashmap.h"
+#include "hashmap_group.h"
 
 /**
- * Allocates dynamically new hash map element.
+ * @def HASH_MAP_BATCH_CHUNK
+ * The number of keys a batch operation hashes and prefetches ahead, before
+ * resolving them (bounded so the hashes fit on the stack, and the
+ * prefetched lines are still in cache when they are used).
+ */
+#define HASH_MAP_BATCH_CHUNK 64
+
+#ifdef HASHMAP_STATS
+/**
+ * @def HASHMAP_COUNT
+ * Adds n to a running counter of the map (see hashmap_stats). The counters
+ * of a const map are updated too (by relaxed atomics, as lookups may run
+ * on several threads at once); without HASHMAP_STATS, nothing is counted.
+ */
+#define HASHMAP_COUNT(hash_map, counter, n) \
+  __atomic_fetch_add (&((hashmap *) (hash_map))->counter, (n), \
+                      __ATOMIC_RELAXED)
+
+/**
+ * @return a monotonic time stamp, in nanoseconds.
+ */
+static uint64_t stats_now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+#else
+#define HASHMAP_COUNT(hash_map, counter, n) ((void) (hash_map))
+#endif
+
+/**
+ * @return 1 if the pair's key is key: the cached hashes are compared first,
+ * then the keys, with probe_cmp (or with the pair type's key_cmp if NULL).
+ */
+static inline int pair_has_key (const hashmap *hash_map,
+                                const pair *cur_pair, const void *key,
+                                size_t hash, key_probe_cmp probe_cmp)
+{
+  if (cur_pair->hash != hash)
+    return 0;
+  HASHMAP_COUNT (hash_map, key_cmps, 1);
+  return probe_cmp ? probe_cmp (cur_pair->key, key)
+                   : cur_pair->type->key_cmp (cur_pair->key, key);
+}
+
+/**
+ * Allocates the metadata and slots arrays of an open-addressing map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int oa_alloc_arrays (int8_t **ctrl, pair ***slots, size_t capacity)
+{
+  *ctrl = malloc (capacity * sizeof (int8_t));
+  *slots = malloc (capacity * sizeof (pair *));
+  if (*ctrl == NULL || *slots == NULL)
+    {
+      free (*ctrl);
+      free (*slots);
+      return 0;
+    }
+  memset (*ctrl, CTRL_EMPTY, capacity);
+  return 1;
+}
+
+/**
+ * @def COMPACT_EMPTY, COMPACT_DELETED
+ * Index entry of a never-used slot, and of a slot whose pair was erased.
+ * Any other index entry is the position of the slot's pair in entries.
+ */
+#define COMPACT_EMPTY UINT32_MAX
+#define COMPACT_DELETED (UINT32_MAX - 1)
+
+/**
+ * @return the number of entries a compact map of the given capacity holds
+ * (the index is kept within the max load factor).
+ */
+static size_t compact_entries_cap (size_t capacity)
+{
+  return (size_t) (HASH_MAP_MAX_LOAD_FACTOR * (double) capacity);
+}
+
+/**
+ * Allocates the index and entries arrays of a compact map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int compact_alloc_arrays (uint32_t **index, pair ***entries,
+                                 size_t capacity)
+{
+  // entry positions must not collide with the empty / deleted marks
+  if (compact_entries_cap (capacity) >= COMPACT_DELETED)
+    return 0;
+  *index = malloc (capacity * sizeof (uint32_t));
+  *entries = malloc (compact_entries_cap (capacity) * sizeof (pair *));
+  if (*index == NULL || *entries == NULL)
+    {
+      free (*index);
+      free (*entries);
+      return 0;
+    }
+  memset (*index, 0xff, capacity * sizeof (uint32_t));
+  return 1;
+}
+
+/**
+ * Allocates dynamically new hash map element, using the chained backend.
  * @param func a function which "hashes" keys.
  * @return pointer to dynamically allocated hashmap.
  * @if_fail return NULL.
  */
 hashmap *hashmap_alloc (hash_func func)
+{
+  return hashmap_alloc_backend (func, HASHMAP_CHAINED);
+}
+
+/**
+ * Allocates dynamically new hash map element, with the given backend.
+ * All backends share the same insert / at / erase / apply_if semantics.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout to use.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_backend (hash_func func, hashmap_backend backend)
 {
   if (func == NULL)
     return NULL;
@@ -16,194 +139,1077 @@ hashmap *hashmap_alloc (hash_func func)
   if (hm == NULL)
     return NULL;
 
-  hm->buckets = malloc (sizeof (void *) * HASH_MAP_INITIAL_CAP);
-  if (hm->buckets == NULL)
+  hm->buckets = NULL;
+  hm->ctrl = NULL;
+  hm->slots = NULL;
+  hm->arena = NULL;
+  hm->entries = NULL;
+  hm->index = NULL;
+  hm->entries_used = 0;
+  hm->tombstones = 0;
+  hm->backend = backend;
+#ifdef HASHMAP_STATS
+  hm->resizes = 0;
+  hm->resize_ns = 0;
+  hm->lookups = 0;
+  hm->key_cmps = 0;
+#endif
+  if (backend == HASHMAP_OPEN_ADDRESSING)
     {
-      free (hm);
-      return NULL;
+      if (!oa_alloc_arrays (&hm->ctrl, &hm->slots, HASH_MAP_INITIAL_CAP))
+        {
+          free (hm);
+          return NULL;
+        }
+    }
+  else if (backend == HASHMAP_COMPACT)
+    {
+      if (!compact_alloc_arrays (&hm->index, &hm->entries,
+                                 HASH_MAP_INITIAL_CAP))
+        {
+          free (hm);
+          return NULL;
+        }
+    }
+  else
+    {
+      hm->buckets = malloc (sizeof (void *) * HASH_MAP_INITIAL_CAP);
+      if (hm->buckets == NULL)
+        {
+          free (hm);
+          return NULL;
+        }
+      for (size_t i = 0; i < HASH_MAP_INITIAL_CAP; i++)
+        hm->buckets[i] = NULL;
     }
 
   //
   hm->size = 0;
   hm->capacity = HASH_MAP_INITIAL_CAP;
   hm->hash_func = func;
-  for (size_t i=0; i < hm->capacity; i++)
-    hm->buckets[i] = NULL;
   return hm;
 }
 
+/**
+ * Allocates dynamically new arena-backed hash map element.
+ * The map allocates its pairs (and their keys and values, when their size
+ * is known, see pair_type) from size-classed slabs of its own arena, and
+ * hashmap_free releases them all at once.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout to use.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_arena (hash_func func, hashmap_backend backend)
+{
+  hashmap *hm = hashmap_alloc_backend (func, backend);
+  if (hm == NULL)
+    return NULL;
+
+  hm->arena = arena_alloc ();
+  if (hm->arena == NULL)
+    hashmap_free (&hm);
+  return hm;
+}
+
+/**
+ * @return 1 if freeing the map must visit its pairs, 0 if freeing its
+ * arena frees them all (no pair owns memory outside the arena).
+ */
+static int hashmap_owns_heap_pairs (const hashmap *hash_map)
+{
+  return hash_map->arena == NULL || hash_map->arena->heap_elements > 0;
+}
+
+/**
+ * Frees the pairs and the arrays of an open-addressing map.
+ * @param hash_map an open-addressing hash map.
+ */
+static void oa_free (hashmap *hash_map)
+{
+  if (hashmap_owns_heap_pairs (hash_map))
+    for (size_t i = 0; i < hash_map->capacity; i++)
+      if (hash_map->ctrl[i] >= 0)
+        pair_free_in (hash_map->arena, (void **) &hash_map->slots[i]);
+  free (hash_map->ctrl);
+  free (hash_map->slots);
+}
+
+/**
+ * Looks for the slot holding key, in an open-addressing map.
+ * Every probed group is matched against the key's tag with a single
+ * compare, so key_cmp is called only for slots whose tag matches.
+ * @param hash_map an open-addressing hash map.
+ * @param key the key to be checked.
+ * @param hash the hash of key.
+ * @param probe_cmp compares the stored keys with key (NULL for key_cmp).
+ * @return the slot index if key exists, hash_map->capacity otherwise.
+ */
+static size_t oa_find (const hashmap *hash_map, const void *key,
+                       size_t hash, key_probe_cmp probe_cmp)
+{
+  uint64_t mixed = mix_hash (hash);
+  size_t groups = hash_map->capacity / HASH_MAP_GROUP_WIDTH;
+  size_t group = (size_t) (mixed >> 7) & (groups - 1);
+  int8_t tag = (int8_t) (mixed & 0x7f);
+
+  // triangular probing over the groups visits each of them once
+  for (size_t step = 1; step <= groups; step++)
+    {
+      const int8_t *ctrl = hash_map->ctrl + group * HASH_MAP_GROUP_WIDTH;
+      for (uint32_t m = group_match (ctrl, tag); m != 0; m &= m - 1)
+        {
+          size_t ind = group * HASH_MAP_GROUP_WIDTH + __builtin_ctz (m);
+          if (pair_has_key (hash_map, hash_map->slots[ind], key, hash,
+                            probe_cmp))
+            return ind;
+        }
+      // an empty slot ends the probe sequence of every key passing here
+      if (group_match (ctrl, CTRL_EMPTY))
+        return hash_map->capacity;
+      group = (group + step) & (groups - 1);
+    }
+  return hash_map->capacity;
+}
+
+/**
+ * Places a pair (the pointer itself, no copy is made) in the first empty
+ * or deleted slot of its probe sequence, by its cached hash.
+ * The caller ensures the key is not in the map, and that a free slot exists.
+ * @param hash_map an open-addressing hash map.
+ * @param in_pair the pair to be placed.
+ */
+static void oa_place (hashmap *hash_map, pair *in_pair)
+{
+  uint64_t hash = mix_hash (in_pair->hash);
+  size_t groups = hash_map->capacity / HASH_MAP_GROUP_WIDTH;
+  size_t group = (size_t) (hash >> 7) & (groups - 1);
+
+  for (size_t step = 1;; step++)
+    {
+      int8_t *ctrl = hash_map->ctrl + group * HASH_MAP_GROUP_WIDTH;
+      uint32_t m = group_match_free (ctrl);
+      if (m != 0)
+        {
+          size_t ind = group * HASH_MAP_GROUP_WIDTH + __builtin_ctz (m);
+          if (hash_map->ctrl[ind] == CTRL_DELETED)
+            hash_map->tombstones--;
+          hash_map->ctrl[ind] = (int8_t) (hash & 0x7f);
+          hash_map->slots[ind] = in_pair;
+          return;
+        }
+      group = (group + step) & (groups - 1);
+    }
+}
+
+/**
+ * Rehashing an open-addressing map into new arrays of new_capacity slots.
+ * The pairs are moved (pointers only), and the deleted slots are dropped.
+ * If a problem occurred in the process, no changes to be made.
+ * @param hash_map the hash map to be resized.
+ * @param new_capacity the new number of slots (a multiple of the group width)
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int oa_resize (hashmap *hash_map, size_t new_capacity)
+{
+  int8_t *old_ctrl = hash_map->ctrl;
+  pair **old_slots = hash_map->slots;
+  size_t old_capacity = hash_map->capacity;
+
+  if (!oa_alloc_arrays (&hash_map->ctrl, &hash_map->slots, new_capacity))
+    {
+      hash_map->ctrl = old_ctrl;
+      hash_map->slots = old_slots;
+      return 0;
+    }
+  hash_map->capacity = new_capacity;
+  hash_map->tombstones = 0;
+
+  for (size_t i = 0; i < old_capacity; i++)
+    if (old_ctrl[i] >= 0)
+      oa_place (hash_map, old_slots[i]);
+
+  free (old_ctrl);
+  free (old_slots);
+  return 1;
+}
+
+/**
+ * Removes the pair of the given slot from an open-addressing map, without
+ * freeing it.
+ * @param hash_map an open-addressing hash map.
+ * @param ind the index of a full slot.
+ * @return the removed pair.
+ */
+static pair *oa_unlink (hashmap *hash_map, size_t ind)
+{
+  pair *out_pair = hash_map->slots[ind];
+
+  // if the group still has an empty slot, no probe sequence ever went past
+  // it, so the slot can become empty again instead of a tombstone
+  size_t group = ind & ~(HASH_MAP_GROUP_WIDTH - 1);
+  if (group_match (hash_map->ctrl + group, CTRL_EMPTY))
+    hash_map->ctrl[ind] = CTRL_EMPTY;
+  else
+    {
+      hash_map->ctrl[ind] = CTRL_DELETED;
+      hash_map->tombstones++;
+    }
+  hash_map->size--;
+  return out_pair;
+}
+
+/**
+ * Frees the pairs and the arrays of a compact map.
+ * @param hash_map a compact hash map.
+ */
+static void compact_free (hashmap *hash_map)
+{
+  if (hashmap_owns_heap_pairs (hash_map))
+    for (size_t i = 0; i < hash_map->entries_used; i++)
+      if (hash_map->entries[i] != NULL)
+        pair_free_in (hash_map->arena, (void **) &hash_map->entries[i]);
+  free (hash_map->index);
+  free (hash_map->entries);
+}
+
+/**
+ * Looks for the index slot of key, in a compact map (linear probing).
+ * @param hash_map a compact hash map.
+ * @param key the key to be checked.
+ * @param hash the hash of key.
+ * @param probe_cmp compares the stored keys with key (NULL for key_cmp).
+ * @return the index slot if key exists, hash_map->capacity otherwise.
+ */
+static size_t compact_find (const hashmap *hash_map, const void *key,
+                            size_t hash, key_probe_cmp probe_cmp)
+{
+  size_t mask = hash_map->capacity - 1;
+  for (size_t ind = (size_t) mix_hash (hash) & mask;; ind = (ind + 1) & mask)
+    {
+      uint32_t entry = hash_map->index[ind];
+      if (entry == COMPACT_EMPTY)
+        return hash_map->capacity;
+      if (entry == COMPACT_DELETED)
+        continue;
+      if (pair_has_key (hash_map, hash_map->entries[entry], key, hash,
+                        probe_cmp))
+        return ind;
+    }
+}
+
+/**
+ * Appends a pair (the pointer itself, no copy is made) to the entries of a
+ * compact map, and points the first free slot of its probe sequence at it.
+ * The caller ensures the key is not in the map, and that the entries are
+ * not full.
+ * @param hash_map a compact hash map.
+ * @param in_pair the pair to be placed.
+ */
+static void compact_place (hashmap *hash_map, pair *in_pair)
+{
+  size_t mask = hash_map->capacity - 1;
+  size_t ind = (size_t) mix_hash (in_pair->hash) & mask;
+  while (hash_map->index[ind] < COMPACT_DELETED)
+    ind = (ind + 1) & mask;
+  hash_map->index[ind] = (uint32_t) hash_map->entries_used;
+  hash_map->entries[hash_map->entries_used++] = in_pair;
+}
+
+/**
+ * Rebuilds a compact map with new_capacity index slots: the entries are
+ * compacted (the holes are dropped, the order is kept) and reindexed.
+ * If a problem occurred in the process, no changes to be made.
+ * @param hash_map the hash map to be rebuilt.
+ * @param new_capacity the new number of index slots (holding the size).
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int compact_rebuild (hashmap *hash_map, size_t new_capacity)
+{
+  uint32_t *old_index = hash_map->index;
+  pair **old_entries = hash_map->entries;
+  size_t old_used = hash_map->entries_used;
+
+  if (!compact_alloc_arrays (&hash_map->index, &hash_map->entries,
+                             new_capacity))
+    {
+      hash_map->index = old_index;
+      hash_map->entries = old_entries;
+      return 0;
+    }
+  hash_map->capacity = new_capacity;
+  hash_map->entries_used = 0;
+
+  for (size_t i = 0; i < old_used; i++)
+    if (old_entries[i] != NULL)
+      compact_place (hash_map, old_entries[i]);
+
+  free (old_index);
+  free (old_entries);
+  return 1;
+}
+
+/**
+ * Removes the pair of the given index slot from a compact map, without
+ * freeing it. Its entry becomes a hole, and its slot a deleted slot, until
+ * the map is rebuilt.
+ * @param hash_map a compact hash map.
+ * @param ind the index of a full slot.
+ * @return the removed pair.
+ */
+static pair *compact_unlink (hashmap *hash_map, size_t ind)
+{
+  uint32_t entry = hash_map->index[ind];
+  pair *out_pair = hash_map->entries[entry];
+  hash_map->entries[entry] = NULL;
+  hash_map->index[ind] = COMPACT_DELETED;
+  hash_map->size--;
+  return out_pair;
+}
+
+/**
+ * The function check if the given key, of the given hash, already inserted
+ * to the hash map. key_cmp is called only for pairs of the same full hash.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @param hash the hash of key (hash_map->hash_func (key)).
+ * @param probe_cmp compares the stored keys with key (NULL for key_cmp).
+ * @return pointer to the pair associated with key if exists, NULL
+ * otherwise (a pointer to the pair itself, not a copy of it).
+ */
+static pair *hashmap_find_with (const hashmap *hash_map, const void *key,
+                                size_t hash, key_probe_cmp probe_cmp)
+{
+  HASHMAP_COUNT (hash_map, lookups, 1);
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      size_t ind = oa_find (hash_map, key, hash, probe_cmp);
+      return ind == hash_map->capacity ? NULL : hash_map->slots[ind];
+    }
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      size_t ind = compact_find (hash_map, key, hash, probe_cmp);
+      return ind == hash_map->capacity
+             ? NULL : hash_map->entries[hash_map->index[ind]];
+    }
+
+  vector *cur_vec = hash_map->buckets[hash & (hash_map->capacity -1)];
+  if (cur_vec == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < cur_vec->size; i++)
+    {
+      pair *cur_pair = cur_vec->data[i];
+      if (pair_has_key (hash_map, cur_pair, key, hash, probe_cmp))
+        return cur_pair;
+    }
+  return NULL;
+}
+
+/**
+ * The function check if the given key, of the given hash, already inserted
+ * to the hash map (see hashmap_find_with, with the pair type's key_cmp).
+ */
+static pair *hashmap_find (const hashmap *hash_map, const_keyT key,
+                           size_t hash)
+{
+  return hashmap_find_with (hash_map, key, hash, NULL);
+}
+
+/**
+ * Looks up a key given in another representation than the stored keys
+ * (e.g. a (pointer, length) view of a string key): no key is built for
+ * the lookup.
+ * @param hash_map a hash map.
+ * @param probe the looked-up key, in its own representation.
+ * @param hash the hash of probe, equal to the hash_func of the stored key
+ * it represents.
+ * @param probe_cmp returns 1 if a stored key is the one probe represents.
+ * @return pointer to the pair associated with probe if exists, NULL
+ * otherwise (a pointer to the pair itself, not a copy of it).
+ */
+pair *hashmap_find_probe (const hashmap *hash_map, const void *probe,
+                          size_t hash, key_probe_cmp probe_cmp)
+{
+  if (hash_map == NULL || probe == NULL || probe_cmp == NULL)
+    return NULL;
+
+  return hashmap_find_with (hash_map, probe, hash, probe_cmp);
+}
+
+/**
+ * The function check if the given key already inserted to the hash map.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return pointer to the pair associated with key if exists, NULL
+ * otherwise (a pointer to the pair itself, not a copy of it).
+ */
+pair *key_in_hashmap (const hashmap *hash_map, const_keyT key)
+{
+  if (hash_map == NULL)
+    return NULL;
+
+  return hashmap_find (hash_map, key, hash_map->hash_func (key));
+}
+
+/**
+ * Links a pair (the pointer itself, not a copy of it) into the buckets-array,
+ * the bucket's vector takes ownership of it.
+ * @param buckets an array of pointers to vectors
+ * @param in_pair a pair the buckets-array would own
+ * @param index the index of the vector which will contain the pair.
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int buckets_link (vector **buckets, pair *in_pair, size_t index)
+{
+  if (buckets[index] == NULL)
+    {
+      buckets[index] = vector_alloc (pair_copy, pair_cmp, pair_free);
+      if (buckets[index] == NULL)
+        return 0;
+    }
+  return vector_push_back_ptr (buckets[index], in_pair);
+}
+
+/**
+ * Frees the vectors of a buckets-array, without freeing the pairs they
+ * point to (the pairs are owned by another buckets-array).
+ * @param buckets an array of pointers to vectors
+ * @param capacity the number of buckets
+ */
+static void buckets_release (vector **buckets, size_t capacity)
+{
+  for (size_t i = 0; i < capacity; i++)
+    if (buckets[i] != NULL)
+      {
+        buckets[i]->size = 0;
+        vector_free (&buckets[i]);
+      }
+  free (buckets);
+}
+
 /**
  * Frees a hash map and the elements the hash map itself allocated.
+ * An arena-backed map is freed in O(number of slabs + buckets), without
+ * visiting its pairs.
  * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
  */
 void hashmap_free (hashmap **p_hash_map)
 {
   if (p_hash_map != NULL && *p_hash_map != NULL)
     {
-      for (size_t i = 0; i < (*p_hash_map)->capacity; i++)
-        // free the vector which held in each bucket
-        vector_free (&(*p_hash_map)->buckets[i]);
+      hashmap *hash_map = *p_hash_map;
+      if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+        oa_free (hash_map);
+      else if (hash_map->backend == HASHMAP_COMPACT)
+        compact_free (hash_map);
+      else
+        {
+          // free the pairs held in each bucket, and the bucket's vector
+          if (hashmap_owns_heap_pairs (hash_map))
+            for (size_t i = 0; i < hash_map->capacity; i++)
+              if (hash_map->buckets[i] != NULL)
+                for (size_t j = 0; j < hash_map->buckets[i]->size; j++)
+                  pair_free_in (hash_map->arena,
+                                &hash_map->buckets[i]->data[j]);
+          buckets_release (hash_map->buckets, hash_map->capacity);
+        }
+
+      // free the arena, and the hash map itself
+      arena_free (&hash_map->arena);
+      free (hash_map);
+      *p_hash_map = NULL;
+    }
+}
+
+/**
+ * rehashing a chained map, and resizing it's capacity, by allocing a new
+ * buckets list, and relinking all the pairs of the old one to it. The pairs
+ * themselves are moved (not copied), so pointers to their keys and values
+ * stay valid.
+ * if a problem occurred in the process, no changes to be made.
+ * @param hash_map the chained hash map to be resized.
+ * @param new_capacity the new capacity of the buckets array
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int buckets_resize (hashmap *hash_map, size_t new_capacity)
+{
+  size_t old_capacity = hash_map->capacity;
+  vector **old = hash_map->buckets;
+  vector **new = malloc (new_capacity * sizeof (void *));
+  if (new == NULL)
+    return 0;
+
+  // initialize the new-buckets:
+  for (size_t i = 0; i < new_capacity; ++i)
+    new[i] = NULL;
+
+  // for each vector in the old buckets list, all its pairs will got
+  // relinked into the *new* buckets list
+  for (size_t i = 0; i < old_capacity; i++) // scan vectors
+
+    if (old[i] != NULL)
+      for (size_t j = 0; j < old[i]->size; j++) // scan pairs
+        {
+          // the cached hash is reused, hash_func is never called here
+          pair *cur_pair = (pair *) (old[i]->data[j]);
+          size_t ind = cur_pair->hash & (new_capacity-1);
+
+          // ensure the linking succeeded, if not - undo the hole process
+          // (the pairs are still owned by the old list)
+          if (!buckets_link (new, cur_pair, ind))
+            {
+              buckets_release (new, new_capacity);
+              return 0;
+            }
+        }
+
+  // rehashing worked successfully, release the old list & update the map:
+  buckets_release (old, old_capacity);
+  hash_map->buckets = new;
+  hash_map->capacity = new_capacity;
+  return 1;
+}
+
+/**
+ * Rehashes the map into new_capacity buckets (slots, index slots), by its
+ * backend's resize, and counts the resize (see hashmap_stats).
+ * @param hash_map the hash map to be resized.
+ * @param new_capacity the new capacity, valid for the backend.
+ * @return 1 if the process has succeeded, 0 else (the map is unchanged)
+ */
+static int table_resize (hashmap *hash_map, size_t new_capacity)
+{
+#ifdef HASHMAP_STATS
+  uint64_t start = stats_now_ns ();
+#endif
+  int resized;
+  if (hash_map->backend == HASHMAP_COMPACT)
+    resized = compact_rebuild (hash_map, new_capacity);
+  else if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    resized = oa_resize (hash_map, new_capacity);
+  else
+    resized = buckets_resize (hash_map, new_capacity);
+#ifdef HASHMAP_STATS
+  if (resized)
+    {
+      HASHMAP_COUNT (hash_map, resizes, 1);
+      HASHMAP_COUNT (hash_map, resize_ns, stats_now_ns () - start);
+    }
+#endif
+  return resized;
+}
+
+/**
+ * Rehashes the map into new_capacity buckets (slots, index slots), whatever
+ * its backend: a chained map relinks its pairs into a new buckets list, an
+ * open addressing map rehashes them into new slots, a compact one
+ * reindexes them. The pairs themselves are moved (not copied), so pointers
+ * to their keys and values stay valid.
+ * if a problem occurred in the process, no changes to be made.
+ * @param hash_map the hash map to be resized.
+ * @param new_capacity the new capacity of the buckets array: a power of 2
+ * (at least the group width for open addressing), which holds the pairs
+ * within the max load factor.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_resize (hashmap *hash_map, size_t new_capacity)
+{
+  if (hash_map == NULL || new_capacity == 0
+      || (new_capacity & (new_capacity - 1)) != 0
+      || (double) hash_map->size
+         > HASH_MAP_MAX_LOAD_FACTOR * (double) new_capacity
+      || (hash_map->backend == HASHMAP_OPEN_ADDRESSING
+          && new_capacity < HASH_MAP_GROUP_WIDTH))
+    return 0;
+  return table_resize (hash_map, new_capacity);
+}
+
+/**
+ * Removes the pair associated with key from the hash map, without freeing
+ * it and without resizing the map.
+ * @param hash_map a hash map.
+ * @param key the key of the pair to be removed.
+ * @param hash the hash of key.
+ * @return the removed pair, NULL if key is not in the map.
+ */
+static pair *hashmap_unlink (hashmap *hash_map, const_keyT key, size_t hash)
+{
+  HASHMAP_COUNT (hash_map, lookups, 1);
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      size_t ind = oa_find (hash_map, key, hash, NULL);
+      if (ind == hash_map->capacity)
+        return NULL;
+      return oa_unlink (hash_map, ind);
+    }
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      size_t ind = compact_find (hash_map, key, hash, NULL);
+      if (ind == hash_map->capacity)
+        return NULL;
+      return compact_unlink (hash_map, ind);
+    }
+
+  vector *cur_vec = hash_map->buckets[hash & (hash_map->capacity -1)];
+  if (cur_vec == NULL)
+    return NULL;
+
+  for (size_t i = 0; i < cur_vec->size; i++)
+    {
+      pair *cur_pair = cur_vec->data[i];
+      if (pair_has_key (hash_map, cur_pair, key, hash, NULL))
+        {
+          hash_map->size--;
+          return vector_extract (cur_vec, i);
+        }
+    }
+  return NULL;
+}
+
+/**
+ * Links a pair (the pointer itself, no copy is made) into the hash map,
+ * and grows the map if the load factor is out of the max range.
+ * The caller ensures the key is not in the map, and sets in_pair->hash.
+ * @param hash_map a hash map.
+ * @param in_pair a dynamically allocated pair the map would own.
+ * @return 1 if the map owns in_pair, 0 if failed (in_pair is then unlinked
+ * back, and still owned by the caller).
+ */
+static int hashmap_link (hashmap *hash_map, pair *in_pair)
+{
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      // the entries are full: compact them, and grow the index if needed
+      // (the index never exceeds the max load factor, checked below)
+      if (hash_map->entries_used == compact_entries_cap (hash_map->capacity))
+        {
+          size_t new_capacity = hash_map->capacity;
+          if (hash_map->size + 1 > compact_entries_cap (new_capacity))
+            new_capacity *= HASH_MAP_GROWTH_FACTOR;
+          if (!table_resize (hash_map, new_capacity))
+            return 0;
+        }
+      compact_place (hash_map, in_pair);
+      hash_map->size++;
+      return 1;
+    }
+
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      oa_place (hash_map, in_pair);
+      hash_map->size++;
+    }
+  else
+    {
+      size_t ind = in_pair->hash & (hash_map->capacity -1);
+      if (!buckets_link (hash_map->buckets, in_pair, ind))
+        return 0;
+      hash_map->size++;
+    }
+
+  // check if the load factor out of the max range, resize and rehash the map
+  double load_factor = hashmap_get_load_factor (hash_map);
+  if (load_factor > HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      size_t new_capacity = hash_map->capacity * HASH_MAP_GROWTH_FACTOR;
+      if (!table_resize (hash_map, new_capacity))
+        {
+          hashmap_unlink (hash_map, in_pair->key, in_pair->hash);
+          return 0;
+        }
+    }
+  else if (hash_map->backend == HASHMAP_OPEN_ADDRESSING
+           && (double) (hash_map->size + hash_map->tombstones)
+              > HASH_MAP_MAX_LOAD_FACTOR * (double) hash_map->capacity)
+    {
+      // too many deleted slots: rehash in place, so enough empty slots are
+      // left to end the probe sequences (if it fails, enough are still left)
+      table_resize (hash_map, hash_map->capacity);
+    }
+  return 1;
+}
+
+/**
+ * Shrinks the hash map if its load factor is out of the min range.
+ * @param hash_map a hash map.
+ */
+static void hashmap_shrink (hashmap *hash_map)
+{
+  double load_factor = hashmap_get_load_factor (hash_map);
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      if (load_factor < HASH_MAP_MIN_LOAD_FACTOR
+          && hash_map->capacity > HASH_MAP_INITIAL_CAP)
+        table_resize (hash_map, hash_map->capacity / HASH_MAP_GROWTH_FACTOR);
+      // more holes than pairs: compact, so scans stay proportional to size
+      else if (hash_map->entries_used - hash_map->size > hash_map->size)
+        table_resize (hash_map, hash_map->capacity);
+      return;
+    }
+  if (load_factor >= HASH_MAP_MIN_LOAD_FACTOR)
+    return;
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      if (hash_map->capacity > HASH_MAP_GROUP_WIDTH)
+        table_resize (hash_map, hash_map->capacity / HASH_MAP_GROWTH_FACTOR);
+    }
+  else if (hash_map->capacity > 1)
+    table_resize (hash_map, hash_map->capacity / HASH_MAP_GROWTH_FACTOR);
+}
+
+/**
+ * Inserts a new in_pair to the hash map.
+ * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
+ * NOT the in_pair it receives as a parameter.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a in_pair the hash map would contain.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+{
+  if (hash_map == NULL || in_pair == NULL)
+    return 0;
+
+  return hashmap_insert_hashed (hash_map, in_pair,
+                                hash_map->hash_func (in_pair->key));
+}
+
+/**
+ * Inserts a copy of in_pair to the hash map (see hashmap_insert), given the
+ * hash of its key, so the key is not hashed again.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a in_pair the hash map would contain.
+ * @param hash the hash of in_pair's key (hash_map->hash_func (key)).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_insert_hashed (hashmap *hash_map, const pair *in_pair,
+                           size_t hash)
+{
+  if (hash_map == NULL || in_pair == NULL)
+    return 0;
+
+  // ensure the key not in hash map:
+  if (hashmap_find (hash_map, in_pair->key, hash))
+    return 0;
+
+  pair *new_pair = pair_copy_in (hash_map->arena, in_pair);
+  if (new_pair == NULL)
+    return 0;
+  new_pair->hash = hash;
+
+  // make pair insertion to the map, if failed - return 0
+  if (!hashmap_link (hash_map, new_pair))
+    {
+      pair_free_in (hash_map->arena, (void **) &new_pair);
+      return 0;
+    }
+  return 1;
+}
+
+/**
+ * Inserts the given in_pair itself to the hash map, no copy is made.
+ * On success the hash map takes ownership of in_pair (it is freed with the
+ * map, or by hashmap_erase), the caller must not free it.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a dynamically allocated pair (see pair_alloc).
+ * @return returns 1 for successful insertion, 0 otherwise (then in_pair is
+ * still owned by the caller).
+ */
+int hashmap_insert_move (hashmap *hash_map, pair *in_pair)
+{
+  if (hash_map == NULL || in_pair == NULL)
+    return 0;
+
+  // ensure the key not in hash map:
+  size_t hash = hash_map->hash_func (in_pair->key);
+  if (hashmap_find (hash_map, in_pair->key, hash))
+    return 0;
+
+  // an arena-backed map keeps its pairs in the arena: it takes a copy there
+  // instead, and frees in_pair
+  if (hash_map->arena != NULL)
+    {
+      pair *new_pair = pair_copy_in (hash_map->arena, in_pair);
+      if (new_pair == NULL)
+        return 0;
+      new_pair->hash = hash;
+      if (!hashmap_link (hash_map, new_pair))
+        {
+          pair_free_in (hash_map->arena, (void **) &new_pair);
+          return 0;
+        }
+      pair_free ((void **) &in_pair);
+      return 1;
+    }
+
+  in_pair->hash = hash;
+  return hashmap_link (hash_map, in_pair);
+}
+
+/**
+ * Removes the pair associated with key from the hash map, and returns it
+ * instead of freeing it. The caller takes ownership of the pair, and may
+ * insert it to another map with hashmap_insert_move, or free it.
+ * @param hash_map a hash map.
+ * @param key a key of the pair to be extracted.
+ * @return the extracted pair, NULL if key not in map.
+ */
+pair *hashmap_extract (hashmap *hash_map, const_keyT key)
+{
+  if (hash_map == NULL || key == NULL)
+    return NULL;
+
+  size_t hash = hash_map->hash_func (key);
+  pair *out_pair = hashmap_find (hash_map, key, hash);
+  if (out_pair == NULL)
+    return NULL;
 
-      // free the buckets array, and the hash map itself
-      free ((*p_hash_map)->buckets);
-      free (*p_hash_map);
-      *p_hash_map = NULL;
+  // an arena-backed map hands out a heap copy of its pair (which then must
+  // be freed with pair_free), so the caller owns no arena memory
+  if (hash_map->arena != NULL)
+    {
+      pair *heap_pair = pair_copy (out_pair);
+      if (heap_pair == NULL)
+        return NULL;
+      heap_pair->hash = hash;
+      hashmap_unlink (hash_map, key, hash);
+      pair_free_in (hash_map->arena, (void **) &out_pair);
+      out_pair = heap_pair;
     }
+  else
+    hashmap_unlink (hash_map, key, hash);
+
+  // check if the load factor out of the min range, resize the map
+  hashmap_shrink (hash_map);
+  return out_pair;
 }
 
 /**
- * The function check if the given key already inserted to the hash map.
+ * The function returns the value associated with the given key.
  * @param hash_map a hash map.
  * @param key the key to be checked.
- * @return pointer to the pair associated with key if exists, NULL
- * otherwise (a pointer to the pair itself, not a copy of it).
+ * @return the value associated with key if exists, NULL otherwise (the
+ * value itself, not a copy of it).
  */
-pair *key_in_hashmap (const hashmap *hash_map, const_keyT key)
+valueT hashmap_at (const hashmap *hash_map, const_keyT key)
 {
   if (hash_map == NULL)
     return NULL;
 
-  size_t ind = (hash_map->hash_func (key)) & (hash_map->capacity -1);
-
-  if (hash_map->buckets[ind] == NULL)
+  pair *assoc_pair = key_in_hashmap (hash_map, key);
+  // check if key in hash map
+  if (assoc_pair == NULL)
     return NULL;
 
-  for (size_t i = 0; i < hash_map->buckets[ind]->size; i++)
+  return assoc_pair->value;
+}
+
+/**
+ * Prefetches the table lines a lookup of the given hash reads first: the
+ * bucket pointer (chained), or the metadata group and its slots (open
+ * addressing).
+ * @param hash_map a hash map.
+ * @param hash the hash of a key.
+ */
+static void hashmap_prefetch (const hashmap *hash_map, size_t hash)
+{
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
     {
-      pair *cur_pair = hash_map->buckets[ind]->data[i];
-      if (cur_pair->key_cmp (cur_pair->key, key))
-        return cur_pair;
+      size_t groups = hash_map->capacity / HASH_MAP_GROUP_WIDTH;
+      size_t group = (size_t) (mix_hash (hash) >> 7) & (groups - 1);
+      __builtin_prefetch (hash_map->ctrl + group * HASH_MAP_GROUP_WIDTH);
+      __builtin_prefetch (hash_map->slots + group * HASH_MAP_GROUP_WIDTH);
     }
-  return NULL;
-
+  else if (hash_map->backend == HASHMAP_COMPACT)
+    __builtin_prefetch (hash_map->index
+                        + (mix_hash (hash) & (hash_map->capacity - 1)));
+  else
+    __builtin_prefetch (hash_map->buckets + (hash & (hash_map->capacity -1)));
 }
 
 /**
- * Inserts a new in_pair to the buckets-array.
- * @param buckets an array of pointers to vectors
- * @param in_pair a in_pair the buckets-array would contain
- * @param index the index of the vector which will contain the pair.
- * @return 1 if the process has succeeded, 0 else
+ * Prefetches the entries a lookup of the given hash compares: the pairs
+ * array of its bucket (chained), or the pair of its home index slot
+ * (compact). The open-addressing slots are prefetched by hashmap_prefetch.
+ * The bucket pointer (index slot) itself should be prefetched before.
+ * @param hash_map a hash map.
+ * @param hash the hash of a key.
  */
-int buckets_insert (vector **buckets, const pair *in_pair, size_t index)
+static void hashmap_prefetch_entries (const hashmap *hash_map, size_t hash)
 {
-  if (buckets == NULL || in_pair == NULL)
-    return 0;
-
-  // if its first key to get inserted into the ind bucket
-  if (buckets[index] == NULL)
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    return;
+  if (hash_map->backend == HASHMAP_COMPACT)
     {
-      buckets[index] = vector_alloc (pair_copy, pair_cmp, pair_free);
+      uint32_t entry = hash_map->index[mix_hash (hash)
+                                       & (hash_map->capacity - 1)];
+      if (entry < COMPACT_DELETED)
+        __builtin_prefetch (hash_map->entries[entry]);
+      return;
     }
-  return vector_push_back (buckets[index], in_pair);
+  vector *cur_vec = hash_map->buckets[hash & (hash_map->capacity -1)];
+  if (cur_vec != NULL)
+    __builtin_prefetch (cur_vec->data);
 }
 
 /**
- * rehashing the map, and resizing it's capacity, by allocing a new buckets
- * list, and hashing all the elements form the old one to it.
- * if a problem occurred in the process, no changes to be made.
- * @param hash_map the hash map to be resized.
- * @param new_capacity the new capacity of the buckets array
- * @return 1 if the process has succeeded, 0 else
+ * Prefetches the buckets of a chunk of hashes, then their entries, so the
+ * cache misses of the whole chunk overlap.
+ * @param hash_map a hash map.
+ * @param hashes the hashes (n <= HASH_MAP_BATCH_CHUNK).
+ * @param n the number of hashes.
  */
-int hashmap_resize (hashmap *hash_map, size_t new_capacity)
+static void hashmap_prefetch_chunk (const hashmap *hash_map,
+                                    const size_t *hashes, size_t n)
 {
-  size_t old_capacity = hash_map->capacity;
-  vector **old = hash_map->buckets;
-  vector **new = malloc (new_capacity * sizeof (void *));
-  if (new == NULL)
-    return 0;
-
-  // initialize the new-buckets:
-  for (size_t i = 0; i < new_capacity; ++i)
-    new[i] = NULL;
+  for (size_t i = 0; i < n; i++)
+    hashmap_prefetch (hash_map, hashes[i]);
+  for (size_t i = 0; i < n; i++)
+    hashmap_prefetch_entries (hash_map, hashes[i]);
+}
 
-  hash_map->capacity = new_capacity;
+/**
+ * Hashes a chunk of keys, and prefetches their buckets then their entries.
+ * @param hash_map a hash map.
+ * @param keys the keys (n <= HASH_MAP_BATCH_CHUNK).
+ * @param n the number of keys.
+ * @param hashes output: the hash of each key.
+ */
+static void hashmap_hash_chunk (const hashmap *hash_map,
+                                const const_keyT *keys, size_t n,
+                                size_t *hashes)
+{
+  for (size_t i = 0; i < n; i++)
+    hashes[i] = hash_map->hash_func (keys[i]);
+  hashmap_prefetch_chunk (hash_map, hashes, n);
+}
 
-  // for each vector in the old buckets list, all its elements will got
-  // rehashed into the *new* buckets list
-  for (size_t i = 0; i < old_capacity; i++) // scan vectors
+/**
+ * Looks up n keys at once: the keys are hashed and their table lines
+ * prefetched (a chunk at a time) before any of them is resolved, so the
+ * memory latency of the lookups overlaps.
+ * @param hash_map a hash map.
+ * @param keys the keys to be checked.
+ * @param n the number of keys.
+ * @param out_values output: out_values[i] is the value associated with
+ * keys[i] (the value itself, not a copy of it), NULL if not in map.
+ * @return the number of keys found, 0 if the function failed.
+ */
+size_t hashmap_at_batch (const hashmap *hash_map, const const_keyT *keys,
+                         size_t n, valueT *out_values)
+{
+  if (hash_map == NULL || keys == NULL || out_values == NULL)
+    return 0;
 
-    if (old[i] != NULL)
-      for (size_t j = 0; j < old[i]->size; j++) // scan pairs
+  size_t found = 0;
+  size_t hashes[HASH_MAP_BATCH_CHUNK];
+  for (size_t start = 0; start < n; start += HASH_MAP_BATCH_CHUNK)
+    {
+      size_t chunk = n - start < HASH_MAP_BATCH_CHUNK
+                     ? n - start : HASH_MAP_BATCH_CHUNK;
+      hashmap_hash_chunk (hash_map, keys + start, chunk, hashes);
+      for (size_t i = 0; i < chunk; i++)
         {
-          pair *cur_pair = (pair *) (old[i]->data[j]);
-          size_t ind = hash_map->hash_func (cur_pair->key) & (new_capacity-1);
-
-          // ensure the insertion succeeded, if not - undo the hole process
-          if (!buckets_insert (new, cur_pair, ind))
-            {
-              for (size_t k = 0; k < new_capacity; k++)
-                {
-                  vector_free (&new[k]);
-                }
-              free (new);
-              hash_map->capacity = old_capacity;
-              return 0;
-            }
+          pair *assoc_pair = hashmap_find (hash_map, keys[start + i],
+                                           hashes[i]);
+          out_values[start + i] = assoc_pair ? assoc_pair->value : NULL;
+          found += assoc_pair != NULL;
         }
-
-  // rehashing worked successfully, free the old list & update the hash-map:
-  for (size_t i = 0; i < old_capacity; i++)
-    {
-      vector_free (&old[i]);
     }
-  free (old);
-  hash_map->buckets = new;
-  return 1;
+  return found;
 }
 
 /**
- * Inserts a new in_pair to the hash map.
- * The function inserts *new*, *copied*, *dynamically allocated* in_pair,
- * NOT the in_pair it receives as a parameter.
- * @param hash_map the hash map to be inserted with new element.
- * @param in_pair a in_pair the hash map would contain.
- * @return returns 1 for successful insertion, 0 otherwise.
+ * Grows the hash map once, to a capacity that holds extra more pairs
+ * within the max load factor.
+ * @param hash_map a hash map.
+ * @param extra the number of pairs to make room for.
+ * @return 1 if the process has succeeded, 0 else (the map is unchanged).
  */
-int hashmap_insert (hashmap *hash_map, const pair *in_pair)
+static int hashmap_reserve (hashmap *hash_map, size_t extra)
 {
-  if (hash_map == NULL || in_pair == NULL)
-    return 0;
-
-  // ensure the key not in hash map:
-  if (key_in_hashmap (hash_map, in_pair->key))
-    return 0;
-
-  size_t ind = (hash_map->hash_func (in_pair->key)) & (hash_map->capacity -1);
-
-  // make pair insertion to the buckets array, if failed - return 0
-  if (!buckets_insert (hash_map->buckets, in_pair, ind))
-    return 0;
-
-  hash_map->size++;
-  // check if the load factor out of the max range, resize and rehash the map
-  double load_factor = hashmap_get_load_factor (hash_map);
-  if (load_factor > HASH_MAP_MAX_LOAD_FACTOR)
-    return hashmap_resize (hash_map, hash_map->capacity *
-                                     HASH_MAP_GROWTH_FACTOR);
-  return 1;
-
+  size_t new_capacity = hash_map->capacity;
+  while ((double) (hash_map->size + extra)
+         > HASH_MAP_MAX_LOAD_FACTOR * (double) new_capacity)
+    new_capacity *= HASH_MAP_GROWTH_FACTOR;
+  if (new_capacity == hash_map->capacity)
+    return 1;
+  return table_resize (hash_map, new_capacity);
 }
 
 /**
- * The function returns the value associated with the given key.
- * @param hash_map a hash map.
- * @param key the key to be checked.
- * @return the value associated with key if exists, NULL otherwise (the
- * value itself, not a copy of it).
+ * Inserts copies of n pairs to the hash map (see hashmap_insert).
+ * The keys are hashed and probed a chunk at a time (prefetched before they
+ * are resolved), and the table is then grown at most once, for the keys
+ * which are not in the map only, before those are inserted.
+ * @param hash_map the hash map to be inserted with new elements.
+ * @param pairs the pairs the hash map would contain copies of.
+ * @param n the number of pairs.
+ * @return the number of inserted pairs (a pair whose key is already in the
+ * map, or appeared earlier in the batch, is not inserted), 0 if the
+ * function failed.
  */
-valueT hashmap_at (const hashmap *hash_map, const_keyT key)
+size_t hashmap_insert_batch (hashmap *hash_map, const pair *const *pairs,
+                             size_t n)
 {
-  if (hash_map == NULL)
-    return NULL;
+  if (hash_map == NULL || pairs == NULL || n == 0)
+    return 0;
 
-  pair *assoc_pair = key_in_hashmap (hash_map, key);
-  // check if key in hash map
-  if (assoc_pair == NULL)
-    return NULL;
+  // the indices of the pairs whose keys are missing, then their hashes
+  size_t *misses = malloc (2 * n * sizeof (size_t));
+  if (misses == NULL)
+    return 0;
+  size_t *miss_hashes = misses + n;
+  size_t miss_count = 0;
+  size_t hashes[HASH_MAP_BATCH_CHUNK];
+  const_keyT keys[HASH_MAP_BATCH_CHUNK];
+  for (size_t start = 0; start < n; start += HASH_MAP_BATCH_CHUNK)
+    {
+      size_t chunk = n - start < HASH_MAP_BATCH_CHUNK
+                     ? n - start : HASH_MAP_BATCH_CHUNK;
+      for (size_t i = 0; i < chunk; i++)
+        keys[i] = pairs[start + i]->key;
+      hashmap_hash_chunk (hash_map, keys, chunk, hashes);
+      for (size_t i = 0; i < chunk; i++)
+        {
+          if (hashmap_find (hash_map, keys[i], hashes[i]))
+            continue;
+          misses[miss_count] = start + i;
+          miss_hashes[miss_count++] = hashes[i];
+        }
+    }
 
-  return assoc_pair->value;
+  // a key repeated in the batch is counted once per repetition; if the
+  // single grow fails, hashmap_link still grows pair by pair
+  hashmap_reserve (hash_map, miss_count);
+
+  size_t inserted = 0;
+  for (size_t start = 0; start < miss_count; start += HASH_MAP_BATCH_CHUNK)
+    {
+      size_t chunk = miss_count - start < HASH_MAP_BATCH_CHUNK
+                     ? miss_count - start : HASH_MAP_BATCH_CHUNK;
+      hashmap_prefetch_chunk (hash_map, miss_hashes + start, chunk);
+      for (size_t i = start; i < start + chunk; i++)
+        {
+          const pair *cur_pair = pairs[misses[i]];
+          // an earlier pair of the batch may have had the same key
+          if (hashmap_find (hash_map, cur_pair->key, miss_hashes[i]))
+            continue;
+          pair *new_pair = pair_copy_in (hash_map->arena, cur_pair);
+          if (new_pair == NULL)
+            continue;
+          new_pair->hash = miss_hashes[i];
+          if (!hashmap_link (hash_map, new_pair))
+            {
+              pair_free_in (hash_map->arena, (void **) &new_pair);
+              continue;
+            }
+          inserted++;
+        }
+    }
+  free (misses);
+  return inserted;
 }
 
 /**
@@ -215,32 +1221,19 @@ valueT hashmap_at (const hashmap *hash_map, const_keyT key)
  */
 int hashmap_erase (hashmap *hash_map, const_keyT key)
 {
-  if (hash_map == NULL)
+  if (hash_map == NULL || key == NULL)
     return 0;
 
-  pair *assoc_pair = key_in_hashmap (hash_map, key);
+  pair *assoc_pair = hashmap_unlink (hash_map, key,
+                                     hash_map->hash_func (key));
 
   // make sure the key in hash map:
   if (assoc_pair == NULL)
     return 0;
 
-  size_t buc_ind = (hash_map->hash_func (key)) & (hash_map->capacity -1);
-  vector *cur_vec = hash_map->buckets[buc_ind];
-
-  int elem_ind = vector_find (cur_vec, assoc_pair);
-  if (elem_ind == -1)
-    return 0;
-
-  // erase the pair from the hash-map
-  if (!vector_erase (cur_vec, elem_ind))
-    return 0;
-
-  hash_map->size--;
+  pair_free_in (hash_map->arena, (void **) &assoc_pair);
   // check if the load factor out of the min range, resize the map
-  double load_factor = hashmap_get_load_factor (hash_map);
-  if (load_factor < HASH_MAP_MIN_LOAD_FACTOR && hash_map->capacity > 1)
-    return hashmap_resize (hash_map, hash_map->capacity /
-                                     HASH_MAP_GROWTH_FACTOR);
+  hashmap_shrink (hash_map);
   return 1;
 }
 
@@ -257,6 +1250,132 @@ double hashmap_get_load_factor (const hashmap *hash_map)
   return (double) hash_map->size / (double) hash_map->capacity;
 }
 
+/**
+ * Adds a bucket (probe sequence) length to the statistics: to its bin of
+ * the histogram, and to the max.
+ */
+static void stats_add_length (hashmap_statistics *out, size_t length)
+{
+  out->histogram[length < HASH_MAP_STATS_BINS
+                 ? length : HASH_MAP_STATS_BINS - 1]++;
+  if (length > out->max_bucket)
+    out->max_bucket = length;
+}
+
+/**
+ * Adds the bytes of a pair, and of its key and value, to the statistics.
+ */
+static void stats_add_pair (hashmap_statistics *out, const pair *cur_pair)
+{
+  size_t pair_bytes, key_bytes, value_bytes;
+  pair_footprint (cur_pair, &pair_bytes, &key_bytes, &value_bytes);
+  out->pair_bytes += pair_bytes;
+  out->key_bytes += key_bytes;
+  out->value_bytes += value_bytes;
+}
+
+/**
+ * @return the number of groups a lookup of the pair of the given slot, in
+ * an open-addressing map, probes (1 if it is in its first group).
+ */
+static size_t oa_probe_length (const hashmap *hash_map, size_t ind)
+{
+  uint64_t mixed = mix_hash (hash_map->slots[ind]->hash);
+  size_t groups = hash_map->capacity / HASH_MAP_GROUP_WIDTH;
+  size_t group = (size_t) (mixed >> 7) & (groups - 1);
+  size_t length = 1;
+  for (size_t step = 1; group != ind / HASH_MAP_GROUP_WIDTH; step++)
+    {
+      group = (group + step) & (groups - 1);
+      length++;
+    }
+  return length;
+}
+
+/**
+ * Reports the structure and memory of the hash map, by a scan of its table
+ * (O(capacity + size)), and its running counters when built with
+ * HASHMAP_STATS (0 otherwise).
+ * @param hash_map a hash map.
+ * @param out output: the statistics of the map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_stats (const hashmap *hash_map, hashmap_statistics *out)
+{
+  if (hash_map == NULL || out == NULL)
+    return 0;
+
+  *out = (hashmap_statistics) {0};
+  out->size = hash_map->size;
+  out->capacity = hash_map->capacity;
+  out->buckets = hash_map->capacity;
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      out->buckets = hash_map->capacity / HASH_MAP_GROUP_WIDTH;
+      out->tombstones = hash_map->tombstones;
+      out->table_bytes = hash_map->capacity
+                         * (sizeof (int8_t) + sizeof (pair *));
+      for (size_t group = 0; group < hash_map->capacity;
+           group += HASH_MAP_GROUP_WIDTH)
+        {
+          int used = 0;
+          for (size_t i = group; i < group + HASH_MAP_GROUP_WIDTH; i++)
+            if (hash_map->ctrl[i] >= 0)
+              {
+                used = 1;
+                stats_add_length (out, oa_probe_length (hash_map, i));
+                stats_add_pair (out, hash_map->slots[i]);
+              }
+          out->used_buckets += used;
+        }
+    }
+  else if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      out->tombstones = hash_map->entries_used - hash_map->size;
+      out->table_bytes = hash_map->capacity * sizeof (uint32_t)
+                         + compact_entries_cap (hash_map->capacity)
+                           * sizeof (pair *);
+      size_t mask = hash_map->capacity - 1;
+      for (size_t ind = 0; ind < hash_map->capacity; ind++)
+        {
+          uint32_t entry = hash_map->index[ind];
+          if (entry >= COMPACT_DELETED)
+            continue;
+          const pair *cur_pair = hash_map->entries[entry];
+          size_t home = (size_t) mix_hash (cur_pair->hash) & mask;
+          out->used_buckets++;
+          stats_add_length (out, ((ind - home) & mask) + 1);
+          stats_add_pair (out, cur_pair);
+        }
+    }
+  else
+    {
+      out->table_bytes = hash_map->capacity * sizeof (vector *);
+      for (size_t i = 0; i < hash_map->capacity; i++)
+        {
+          const vector *cur_vec = hash_map->buckets[i];
+          stats_add_length (out, cur_vec == NULL ? 0 : cur_vec->size);
+          if (cur_vec == NULL)
+            continue;
+          out->used_buckets += cur_vec->size > 0;
+          out->vector_bytes += sizeof (vector)
+                               + cur_vec->capacity * sizeof (void *);
+          for (size_t j = 0; j < cur_vec->size; j++)
+            stats_add_pair (out, cur_vec->data[j]);
+        }
+    }
+  out->total_bytes = sizeof (hashmap) + out->table_bytes + out->vector_bytes
+                     + out->pair_bytes + out->key_bytes + out->value_bytes;
+
+#ifdef HASHMAP_STATS
+  out->resizes = __atomic_load_n (&hash_map->resizes, __ATOMIC_RELAXED);
+  out->resize_ns = __atomic_load_n (&hash_map->resize_ns, __ATOMIC_RELAXED);
+  out->lookups = __atomic_load_n (&hash_map->lookups, __ATOMIC_RELAXED);
+  out->key_cmps = __atomic_load_n (&hash_map->key_cmps, __ATOMIC_RELAXED);
+#endif
+  return 1;
+}
+
 /**
  * This function receives a hashmap and 2 functions, the first checks a
  * condition on the keys, and the seconds apply some modification on the
@@ -281,6 +1400,32 @@ int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
   if (hash_map == NULL || keyT_func == NULL || valT_func == NULL)
     return counter;
 
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      // scan the entries, skipping the holes
+      for (size_t ind = 0; ind < hash_map->entries_used; ind++)
+        if (hash_map->entries[ind] != NULL
+            && keyT_func (hash_map->entries[ind]->key))
+          {
+            valT_func (hash_map->entries[ind]->value);
+            counter++;
+          }
+      return counter;
+    }
+
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      // scan the full slots
+      for (size_t ind = 0; ind < hash_map->capacity; ind++)
+        if (hash_map->ctrl[ind] >= 0
+            && keyT_func (hash_map->slots[ind]->key))
+          {
+            valT_func (hash_map->slots[ind]->value);
+            counter++;
+          }
+      return counter;
+    }
+
   // scan vectors
   for (size_t vec_idx = 0; vec_idx < hash_map->capacity; vec_idx++)
     {
@@ -301,3 +1446,205 @@ int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
   return counter;
 }
 
+/**
+ * @struct apply_range
+ * The work of one hashmap_apply_if_parallel worker: a range of buckets
+ * (slots, entries), and the number of values it changed.
+ */
+typedef struct apply_range {
+    const hashmap *hash_map;
+    size_t begin;
+    size_t end;
+    keyT_ctx_func key_pred;
+    valueT_ctx_func val_fn;
+    void *ctx;
+    size_t counter;
+} apply_range;
+
+/**
+ * Applies val_fn on the values of a range of buckets whose keys fulfill
+ * key_pred. The ranges are disjoint, so no two workers visit the same pair.
+ * @param arg an apply_range, its counter is set.
+ * @return NULL.
+ */
+static void *apply_range_run (void *arg)
+{
+  apply_range *range = arg;
+  const hashmap *hash_map = range->hash_map;
+  size_t counter = 0;
+
+  for (size_t ind = range->begin; ind < range->end; ind++)
+    {
+      if (hash_map->backend == HASHMAP_COMPACT)
+        {
+          pair *cur_pair = hash_map->entries[ind];
+          if (cur_pair != NULL && range->key_pred (cur_pair->key, range->ctx))
+            {
+              range->val_fn (cur_pair->value, range->ctx);
+              counter++;
+            }
+          continue;
+        }
+      if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+        {
+          if (hash_map->ctrl[ind] >= 0
+              && range->key_pred (hash_map->slots[ind]->key, range->ctx))
+            {
+              range->val_fn (hash_map->slots[ind]->value, range->ctx);
+              counter++;
+            }
+          continue;
+        }
+      vector *cur_vec = hash_map->buckets[ind];
+      if (cur_vec != NULL)
+        for (size_t pair_idx = 0; pair_idx < cur_vec->size; pair_idx++)
+          {
+            pair *cur_pair = cur_vec->data[pair_idx];
+            if (range->key_pred (cur_pair->key, range->ctx))
+              {
+                range->val_fn (cur_pair->value, range->ctx);
+                counter++;
+              }
+          }
+    }
+  range->counter = counter;
+  return NULL;
+}
+
+/**
+ * The parallel version of hashmap_apply_if: the buckets (slots, entries)
+ * are split into nthreads contiguous ranges, each scanned by
+ * its own thread (the calling thread scans the last one).
+ * The nthreads - 1 threads are created by the call and joined before it
+ * returns; no pool is kept across calls, so neither the map nor the
+ * library owns threads or state to shut down. Starting a thread costs
+ * some tens of microseconds, little next to the scan of a map worth
+ * splitting: for a small map, pass nthreads = 1.
+ * Both callbacks receive ctx, and are called concurrently (on different
+ * pairs): they must not modify shared state without synchronization.
+ * The map itself must not be modified during the call.
+ * @param hash_map a hashmap
+ * @param nthreads the number of threads to use (0 is treated as 1). If a
+ *        thread cannot be created, its range is scanned by the caller.
+ * @param key_pred a function that checks a condition on keyT
+ *        and return 1 if true, 0 else
+ * @param val_fn a function that modifies valueT, in-place
+ * @param ctx a user context, passed to both callbacks
+ * @return number of changed values (same as the sequential version)
+ */
+int hashmap_apply_if_parallel (const hashmap *hash_map, size_t nthreads,
+                               keyT_ctx_func key_pred,
+                               valueT_ctx_func val_fn, void *ctx)
+{
+  if (hash_map == NULL || key_pred == NULL || val_fn == NULL)
+    return 0;
+  if (nthreads == 0)
+    nthreads = 1;
+  // the buckets (slots) of the map, or its entries for the compact backend
+  size_t length = hash_map->backend == HASHMAP_COMPACT
+                  ? hash_map->entries_used : hash_map->capacity;
+  if (nthreads > length)
+    nthreads = length > 0 ? length : 1;
+
+  apply_range *ranges = malloc (nthreads * sizeof (*ranges));
+  pthread_t *threads = malloc (nthreads * sizeof (*threads));
+  int *started = calloc (nthreads, sizeof (*started));
+  if (ranges == NULL || threads == NULL || started == NULL)
+    {
+      // fall back to a single range, scanned by the calling thread
+      free (ranges);
+      free (threads);
+      free (started);
+      apply_range range = {hash_map, 0, length, key_pred,
+                           val_fn, ctx, 0};
+      apply_range_run (&range);
+      return (int) range.counter;
+    }
+
+  size_t per_thread = length / nthreads;
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      ranges[t] = (apply_range) {hash_map, t * per_thread,
+                                 t + 1 == nthreads ? length
+                                                   : (t + 1) * per_thread,
+                                 key_pred, val_fn, ctx, 0};
+      if (t + 1 < nthreads)
+        started[t] = pthread_create (&threads[t], NULL, apply_range_run,
+                                     &ranges[t]) == 0;
+    }
+
+  apply_range_run (&ranges[nthreads - 1]);
+  size_t counter = ranges[nthreads - 1].counter;
+  for (size_t t = 0; t + 1 < nthreads; t++)
+    {
+      if (started[t])
+        pthread_join (threads[t], NULL);
+      else
+        apply_range_run (&ranges[t]);
+      counter += ranges[t].counter;
+    }
+
+  free (ranges);
+  free (threads);
+  free (started);
+  return (int) counter;
+}
+
+/**
+ * Starts an iteration over the pairs of a hash map.
+ * A compact map is iterated in insertion order, the other backends in
+ * table order. The map must not be modified while iterating (its values
+ * may be modified in place).
+ * @param hash_map a hash map.
+ * @return a cursor before the first pair.
+ */
+hashmap_iter hashmap_iter_begin (const hashmap *hash_map)
+{
+  return (hashmap_iter) {hash_map, 0, 0};
+}
+
+/**
+ * Advances the cursor to the next pair of the map.
+ * @param iter a cursor (see hashmap_iter_begin).
+ * @return the next pair (the pair itself, not a copy of it), NULL when the
+ * iteration is over.
+ */
+pair *hashmap_iter_next (hashmap_iter *iter)
+{
+  if (iter == NULL || iter->hash_map == NULL)
+    return NULL;
+
+  const hashmap *hash_map = iter->hash_map;
+  if (hash_map->backend == HASHMAP_COMPACT)
+    {
+      while (iter->bucket < hash_map->entries_used)
+        {
+          pair *cur_pair = hash_map->entries[iter->bucket++];
+          if (cur_pair != NULL)
+            return cur_pair;
+        }
+      return NULL;
+    }
+
+  if (hash_map->backend == HASHMAP_OPEN_ADDRESSING)
+    {
+      while (iter->bucket < hash_map->capacity)
+        {
+          size_t ind = iter->bucket++;
+          if (hash_map->ctrl[ind] >= 0)
+            return hash_map->slots[ind];
+        }
+      return NULL;
+    }
+
+  // the next pair of the current bucket, or the first of the next one
+  while (iter->bucket < hash_map->capacity)
+    {
+      vector *cur_vec = hash_map->buckets[iter->bucket];
+      if (cur_vec != NULL && iter->pos < cur_vec->size)
+        return cur_vec->data[iter->pos++];
+      iter->bucket++;
+      iter->pos = 0;
+    }
+  return NULL;
+}
@@ -2,6 +2,7 @@
 #define HASHMAP_H_
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "vector.h"
 #include "pair.h"
 
@@ -42,6 +43,40 @@
  */
 #define HASH_MAP_MAX_LOAD_FACTOR 0.75
 
+/**
+ * @def HASH_MAP_GROUP_WIDTH
+ * The number of slots the open-addressing backend probes at once.
+ * Its metadata bytes are scanned 16 at a time (a single SSE2 compare),
+ * so the slots capacity is always a multiple of the group width.
+ */
+#define HASH_MAP_GROUP_WIDTH 16UL
+
+/**
+ * @def HASH_MAP_STATS_BINS
+ * The number of bins of the bucket length histogram of hashmap_stats: the
+ * lengths 0 to HASH_MAP_STATS_BINS - 2 have a bin each, and the last bin
+ * counts all the longer ones.
+ */
+#define HASH_MAP_STATS_BINS 16
+
+/**
+ * @typedef hashmap_backend
+ * The table layout the hash map uses to store its pairs.
+ * HASHMAP_CHAINED - an array of buckets, each bucket is a vector of pairs.
+ * HASHMAP_OPEN_ADDRESSING - one flat array of pair slots, with a parallel
+ * metadata array (one byte per slot: empty / deleted / 7-bit hash tag),
+ * probed a group of HASH_MAP_GROUP_WIDTH slots at a time.
+ * HASHMAP_COMPACT - a dense array of the pairs, in insertion order, with a
+ * sparse index table (one 32-bit entry position per slot) over it. Scans
+ * and iteration touch contiguous memory proportional to the size, and
+ * visit the pairs in insertion order.
+ */
+typedef enum hashmap_backend {
+    HASHMAP_CHAINED,
+    HASHMAP_OPEN_ADDRESSING,
+    HASHMAP_COMPACT
+} hashmap_backend;
+
 /**
  * @typedef hash_func
  * This type of function receives a keyT and returns
@@ -66,30 +101,162 @@ typedef int (*keyT_func) (const_keyT);
  */
 typedef void (*valueT_func) (valueT);
 
+/**
+ * @typedef key_probe_cmp
+ * Compares a stored key with a looked-up key given in another
+ * representation (see hashmap_find_probe), returns 1 if they are equal.
+ */
+typedef int (*key_probe_cmp) (const_keyT key, const void *probe);
+
+/**
+ * @typedef keyT_ctx_func, valueT_ctx_func
+ * The versions of keyT_func and valueT_func receiving a user context (see
+ * hashmap_apply_if_parallel).
+ */
+typedef int (*keyT_ctx_func) (const_keyT, void *);
+typedef void (*valueT_ctx_func) (valueT, void *);
+
 /**
  * @struct hashmap
  * @param buckets dynamic array of vectors which stores the values.
  * @param size the number of elements (pairs) stored in the hash map.
  * @param capacity the number of buckets in the hash map.
  * @param hash_func a function which "hashes" keys.
+ * @param backend the table layout (chained buckets / open addressing).
+ * @param ctrl open addressing only: metadata byte of each slot.
+ * @param slots open addressing only: flat array of the stored pairs.
+ * @param tombstones open addressing only: number of deleted slots.
+ * @param arena the arena the pairs are allocated from, NULL if the pairs
+ * are dynamically allocated one by one.
+ * @param entries compact only: the pairs in insertion order (an erased
+ * pair leaves a NULL hole, until the entries are compacted).
+ * @param entries_used compact only: the number of entries written
+ * (pairs and holes).
+ * @param index compact only: the position in entries of each slot's pair.
+ * @param resizes, resize_ns, lookups, key_cmps HASHMAP_STATS only: the
+ * running counters of the map (see hashmap_stats). HASHMAP_STATS must be
+ * defined for all the sources of a program, or for none.
  */
 typedef struct hashmap {
     vector **buckets;
     size_t size;
-    size_t capacity; // num of buckets
+    size_t capacity; // num of buckets (num of slots for open addressing)
     hash_func hash_func;
+    hashmap_backend backend;
+    int8_t *ctrl;
+    pair **slots;
+    size_t tombstones;
+    arena *arena;
+    pair **entries;
+    size_t entries_used;
+    uint32_t *index;
+#ifdef HASHMAP_STATS
+    size_t resizes;
+    uint64_t resize_ns;
+    size_t lookups;
+    size_t key_cmps;
+#endif
 } hashmap;
 
 /**
- * Allocates dynamically new hash map element.
+ * @struct hashmap_statistics - the structure and memory of a hash map (see
+ * hashmap_stats). A chained map's buckets are its vectors; the bucket of a
+ * pair of an open addressing map is its probe sequence, in groups, and of a
+ * compact one its probe sequence, in index slots.
+ * @param size the number of pairs.
+ * @param capacity the capacity of the map (see hashmap).
+ * @param buckets the number of buckets: chained, the capacity; open
+ * addressing, the groups; compact, the index slots.
+ * @param histogram chained: the number of buckets of each length (0 pairs,
+ * 1 pair, ...). Open addressing and compact: the number of pairs found
+ * after probing each length (histogram[0] is 0, histogram[1] the pairs in
+ * their first group / slot, ...). The last bin counts the longer ones.
+ * @param used_buckets chained: the non-empty buckets. Open addressing: the
+ * groups holding a pair. Compact: the index slots pointing at a pair.
+ * @param max_bucket the length of the longest bucket (probe sequence).
+ * @param tombstones open addressing: the deleted slots. Compact: the holes
+ * of the entries. Chained: 0.
+ * @param table_bytes the bytes of the buckets array (the metadata and slots
+ * arrays, the index and entries arrays).
+ * @param vector_bytes chained only: the bytes of the buckets' vectors.
+ * @param pair_bytes the bytes of the pairs (with their inline keys and
+ * values), key_bytes and value_bytes of the keys and values stored outside
+ * of them (see pair_footprint).
+ * @param total_bytes the bytes of all the above, and of the map itself.
+ * @param resizes, resize_ns HASHMAP_STATS only: the number of resizes
+ * (including the in place rehashes), and the time they took.
+ * @param lookups, key_cmps HASHMAP_STATS only: the number of lookups of a
+ * key (by at, insert, erase...), and of the key_cmp (probe_cmp) calls they
+ * made.
+ */
+typedef struct hashmap_statistics {
+    size_t size;
+    size_t capacity;
+    size_t buckets;
+    size_t histogram[HASH_MAP_STATS_BINS];
+    size_t used_buckets;
+    size_t max_bucket;
+    size_t tombstones;
+    size_t table_bytes;
+    size_t vector_bytes;
+    size_t pair_bytes;
+    size_t key_bytes;
+    size_t value_bytes;
+    size_t total_bytes;
+    size_t resizes;
+    uint64_t resize_ns;
+    size_t lookups;
+    size_t key_cmps;
+} hashmap_statistics;
+
+/**
+ * @struct hashmap_iter - a cursor over the pairs of a hash map.
+ * @param hash_map the map iterated.
+ * @param bucket the current bucket (slot, entry) of the map.
+ * @param pos chained only: the position in the current bucket.
+ */
+typedef struct hashmap_iter {
+    const hashmap *hash_map;
+    size_t bucket;
+    size_t pos;
+} hashmap_iter;
+
+/**
+ * Allocates dynamically new hash map element, using the chained backend.
  * @param func a function which "hashes" keys.
  * @return pointer to dynamically allocated hashmap.
  * @if_fail return NULL.
  */
 hashmap *hashmap_alloc (hash_func func);
 
+/**
+ * Allocates dynamically new hash map element, with the given backend.
+ * All backends share the same insert / at / erase / apply_if semantics.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout to use.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_backend (hash_func func, hashmap_backend backend);
+
+/**
+ * Allocates dynamically new arena-backed hash map element.
+ * The map allocates its pairs (and their keys and values, when their size
+ * is known, see pair_type) from size-classed slabs of its own arena, and
+ * hashmap_free releases them all at once.
+ * hashmap_insert_move copies the given pair into the arena (and frees it),
+ * and hashmap_extract returns a dynamically allocated copy.
+ * @param func a function which "hashes" keys.
+ * @param backend the table layout to use.
+ * @return pointer to dynamically allocated hashmap.
+ * @if_fail return NULL.
+ */
+hashmap *hashmap_alloc_arena (hash_func func, hashmap_backend backend);
+
 /**
  * Frees a hash map and the elements the hash map itself allocated.
+ * An arena-backed map is freed in O(number of slabs + buckets), without
+ * visiting its pairs.
  * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
  */
 void hashmap_free (hashmap **p_hash_map);
@@ -104,6 +271,52 @@ void hashmap_free (hashmap **p_hash_map);
  */
 int hashmap_insert (hashmap *hash_map, const pair *in_pair);
 
+/**
+ * Inserts a copy of in_pair to the hash map (see hashmap_insert), given the
+ * hash of its key, so the key is not hashed again.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a in_pair the hash map would contain.
+ * @param hash the hash of in_pair's key (hash_map->hash_func (key)).
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int hashmap_insert_hashed (hashmap *hash_map, const pair *in_pair,
+                           size_t hash);
+
+/**
+ * Inserts the given in_pair itself to the hash map, no copy is made.
+ * On success the hash map takes ownership of in_pair (it is freed with the
+ * map, or by hashmap_erase), the caller must not free it.
+ * @param hash_map the hash map to be inserted with new element.
+ * @param in_pair a dynamically allocated pair (see pair_alloc).
+ * @return returns 1 for successful insertion, 0 otherwise (then in_pair is
+ * still owned by the caller).
+ */
+int hashmap_insert_move (hashmap *hash_map, pair *in_pair);
+
+/**
+ * The function check if the given key already inserted to the hash map.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return pointer to the pair associated with key if exists, NULL
+ * otherwise (a pointer to the pair itself, not a copy of it).
+ */
+pair *key_in_hashmap (const hashmap *hash_map, const_keyT key);
+
+/**
+ * Looks up a key given in another representation than the stored keys
+ * (e.g. a (pointer, length) view of a string key): no key is built for
+ * the lookup.
+ * @param hash_map a hash map.
+ * @param probe the looked-up key, in its own representation.
+ * @param hash the hash of probe, equal to the hash_func of the stored key
+ * it represents.
+ * @param probe_cmp returns 1 if a stored key is the one probe represents.
+ * @return pointer to the pair associated with probe if exists, NULL
+ * otherwise (a pointer to the pair itself, not a copy of it).
+ */
+pair *hashmap_find_probe (const hashmap *hash_map, const void *probe,
+                          size_t hash, key_probe_cmp probe_cmp);
+
 /**
  * The function returns the value associated with the given key.
  * @param hash_map a hash map.
@@ -113,6 +326,35 @@ int hashmap_insert (hashmap *hash_map, const pair *in_pair);
  */
 valueT hashmap_at (const hashmap *hash_map, const_keyT key);
 
+/**
+ * Looks up n keys at once: the keys are hashed and their table lines
+ * prefetched (a chunk at a time) before any of them is resolved, so the
+ * memory latency of the lookups overlaps.
+ * @param hash_map a hash map.
+ * @param keys the keys to be checked.
+ * @param n the number of keys.
+ * @param out_values output: out_values[i] is the value associated with
+ * keys[i] (the value itself, not a copy of it), NULL if not in map.
+ * @return the number of keys found, 0 if the function failed.
+ */
+size_t hashmap_at_batch (const hashmap *hash_map, const const_keyT *keys,
+                         size_t n, valueT *out_values);
+
+/**
+ * Inserts copies of n pairs to the hash map (see hashmap_insert).
+ * The keys are hashed and probed a chunk at a time (prefetched before they
+ * are resolved), and the table is then grown at most once, for the keys
+ * which are not in the map only, before those are inserted.
+ * @param hash_map the hash map to be inserted with new elements.
+ * @param pairs the pairs the hash map would contain copies of.
+ * @param n the number of pairs.
+ * @return the number of inserted pairs (a pair whose key is already in the
+ * map, or appeared earlier in the batch, is not inserted), 0 if the
+ * function failed.
+ */
+size_t hashmap_insert_batch (hashmap *hash_map, const pair *const *pairs,
+                             size_t n);
+
 /**
  * The function erases the pair associated with key.
  * @param hash_map a hash map.
@@ -122,6 +364,41 @@ valueT hashmap_at (const hashmap *hash_map, const_keyT key);
  */
 int hashmap_erase (hashmap *hash_map, const_keyT key);
 
+/**
+ * Removes the pair associated with key from the hash map, and returns it
+ * instead of freeing it. The caller takes ownership of the pair, and may
+ * insert it to another map with hashmap_insert_move, or free it.
+ * @param hash_map a hash map.
+ * @param key a key of the pair to be extracted.
+ * @return the extracted pair, NULL if key not in map.
+ */
+pair *hashmap_extract (hashmap *hash_map, const_keyT key);
+
+/**
+ * Rehashes the map into new_capacity buckets (slots, index slots), whatever
+ * its backend. The pairs are moved (not copied), so pointers to their keys
+ * and values stay valid.
+ * If a problem occurred in the process, no changes to be made.
+ * @param hash_map the hash map to be resized.
+ * @param new_capacity the new capacity: a power of 2 (at least the group
+ * width for open addressing), which holds the pairs within the max load
+ * factor.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_resize (hashmap *hash_map, size_t new_capacity);
+
+/**
+ * Reports the structure and memory of the hash map, by a scan of its table
+ * (O(capacity + size)), and its running counters when built with
+ * HASHMAP_STATS (0 otherwise). A chained map whose hash_func collapses
+ * shows few used buckets and a long max bucket; a map whose capacity
+ * blew up shows table bytes far above its pair bytes.
+ * @param hash_map a hash map.
+ * @param out output: the statistics of the map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_stats (const hashmap *hash_map, hashmap_statistics *out);
+
 /**
  * This function returns the load factor of the hash map.
  * @param hash_map a hash map.
@@ -143,4 +420,52 @@ double hashmap_get_load_factor (const hashmap *hash_map);
  * @return number of changed values
  */
 int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func, valueT_func valT_func);//const
+
+/**
+ * Starts an iteration over the pairs of a hash map.
+ * A compact map is iterated in insertion order, the other backends in
+ * table order. The map must not be modified while iterating (its values
+ * may be modified in place).
+ * Example:
+ *     hashmap_iter iter = hashmap_iter_begin (map);
+ *     for (pair *p = hashmap_iter_next (&iter); p != NULL;
+ *          p = hashmap_iter_next (&iter))
+ *       ...
+ * @param hash_map a hash map.
+ * @return a cursor before the first pair.
+ */
+hashmap_iter hashmap_iter_begin (const hashmap *hash_map);
+
+/**
+ * Advances the cursor to the next pair of the map.
+ * @param iter a cursor (see hashmap_iter_begin).
+ * @return the next pair (the pair itself, not a copy of it), NULL when the
+ * iteration is over.
+ */
+pair *hashmap_iter_next (hashmap_iter *iter);
+
+/**
+ * The parallel version of hashmap_apply_if: the buckets (slots, entries)
+ * are split into nthreads contiguous ranges, each scanned by
+ * its own thread (the calling thread scans the last one).
+ * The nthreads - 1 threads are created by the call and joined before it
+ * returns; no pool is kept across calls, so neither the map nor the
+ * library owns threads or state to shut down. Starting a thread costs
+ * some tens of microseconds, little next to the scan of a map worth
+ * splitting: for a small map, pass nthreads = 1.
+ * Both callbacks receive ctx, and are called concurrently (on different
+ * pairs): they must not modify shared state without synchronization.
+ * The map itself must not be modified during the call.
+ * @param hash_map a hashmap
+ * @param nthreads the number of threads to use (0 is treated as 1). If a
+ *        thread cannot be created, its range is scanned by the caller.
+ * @param key_pred a function that checks a condition on keyT
+ *        and return 1 if true, 0 else
+ * @param val_fn a function that modifies valueT, in-place
+ * @param ctx a user context, passed to both callbacks
+ * @return number of changed values (same as the sequential version)
+ */
+int hashmap_apply_if_parallel (const hashmap *hash_map, size_t nthreads,
+                               keyT_ctx_func key_pred,
+                               valueT_ctx_func val_fn, void *ctx);
 #endif //HASHMAP_H_
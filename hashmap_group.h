@@ -0,0 +1,72 @@
+#ifndef HASHMAP_GROUP_H_
+#define HASHMAP_GROUP_H_
+
+#include <stdint.h>
+#include "hashmap.h"
+
+/*
+ * The metadata (control bytes) of the open-addressing tables: shared by the
+ * open-addressing backend of hashmap.c and by the typed maps generated by
+ * hashmap_typed.h.
+ */
+
+/**
+ * @def CTRL_EMPTY, CTRL_DELETED
+ * Metadata byte of a never-used slot, and of a slot whose pair was erased.
+ * Both have the high bit set, a full slot holds a 7-bit hash tag (0..127).
+ */
+#define CTRL_EMPTY ((int8_t) -128)
+#define CTRL_DELETED ((int8_t) -2)
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/**
+ * @return bit i is on iff the i-th metadata byte of the group equals tag.
+ */
+static inline uint32_t group_match (const int8_t *group, int8_t tag)
+{
+  __m128i ctrl = _mm_loadu_si128 ((const __m128i *) group);
+  return (uint32_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (ctrl,
+                                                        _mm_set1_epi8 (tag)));
+}
+
+/**
+ * @return bit i is on iff the i-th slot of the group is empty or deleted.
+ */
+static inline uint32_t group_match_free (const int8_t *group)
+{
+  __m128i ctrl = _mm_loadu_si128 ((const __m128i *) group);
+  return (uint32_t) _mm_movemask_epi8 (ctrl);
+}
+#else
+static inline uint32_t group_match (const int8_t *group, int8_t tag)
+{
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HASH_MAP_GROUP_WIDTH; i++)
+    if (group[i] == tag)
+      mask |= 1u << i;
+  return mask;
+}
+
+static inline uint32_t group_match_free (const int8_t *group)
+{
+  uint32_t mask = 0;
+  for (uint32_t i = 0; i < HASH_MAP_GROUP_WIDTH; i++)
+    if (group[i] < 0)
+      mask |= 1u << i;
+  return mask;
+}
+#endif
+
+/**
+ * Spreads the bits of a user hash, so weak hash funcs (such as hash_char)
+ * still fill both the group index (high bits) and the 7-bit tag.
+ */
+static inline uint64_t mix_hash (size_t hash)
+{
+  uint64_t h = (uint64_t) hash * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 32);
+}
+
+#endif //HASHMAP_GROUP_H_
@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashmap_snapshot.h"
+#include "hash_funcs.h"
+
+/**
+ * @def SNAPSHOT_ALIGN
+ * The alignment of the records, and of the values within them.
+ */
+#define SNAPSHOT_ALIGN 8UL
+
+/**
+ * @def SNAPSHOT_KEY_BUFFER
+ * The size of the stack buffer a looked-up key is encoded into (longer
+ * keys are encoded into a dynamically allocated one).
+ */
+#define SNAPSHOT_KEY_BUFFER 256UL
+
+static size_t string_encode (const void *elem, void *out, size_t out_size)
+{
+  size_t len = strlen (elem) + 1;
+  if (out_size >= len)
+    memcpy (out, elem, len);
+  return len;
+}
+
+const hashmap_codec hashmap_string_codec = {string_encode, 0};
+
+/**
+ * @return the number of bytes elem encodes to, written to out if out_size
+ * is large enough.
+ */
+static size_t codec_encode (const hashmap_codec *codec, const void *elem,
+                            void *out, size_t out_size)
+{
+  if (codec->encode != NULL)
+    return codec->encode (elem, out, out_size);
+  if (out_size >= codec->size)
+    memcpy (out, elem, codec->size);
+  return codec->size;
+}
+
+/**
+ * @return len rounded up to SNAPSHOT_ALIGN.
+ */
+static size_t snapshot_align (size_t len)
+{
+  return (len + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1);
+}
+
+/**
+ * Encodes elem into *buffer, growing it if needed.
+ * @param len output: the encoded length.
+ * @return 1 if the process has succeeded, 0 else (the buffer could not grow,
+ * or the length does not fit a record)
+ */
+static int encode_into (const hashmap_codec *codec, const void *elem,
+                        unsigned char **buffer, size_t *buffer_size,
+                        size_t *len)
+{
+  *len = codec_encode (codec, elem, *buffer, *buffer_size);
+  if (*len > UINT32_MAX)
+    return 0;
+  if (*len > *buffer_size)
+    {
+      unsigned char *grown = realloc (*buffer, *len);
+      if (grown == NULL)
+        return 0;
+      *buffer = grown;
+      *buffer_size = *len;
+      codec_encode (codec, elem, *buffer, *buffer_size);
+    }
+  return 1;
+}
+
+/**
+ * Writes one record (lengths, key, padding, value, padding) to the file.
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int write_record (FILE *file, const unsigned char *key,
+                         uint32_t key_len, const unsigned char *value,
+                         uint32_t value_len)
+{
+  static const unsigned char padding[SNAPSHOT_ALIGN] = {0};
+  size_t key_pad = snapshot_align (key_len) - key_len;
+  size_t value_pad = snapshot_align (value_len) - value_len;
+  return fwrite (&key_len, sizeof (key_len), 1, file) == 1
+         && fwrite (&value_len, sizeof (value_len), 1, file) == 1
+         && fwrite (key, 1, key_len, file) == key_len
+         && fwrite (padding, 1, key_pad, file) == key_pad
+         && fwrite (value, 1, value_len, file) == value_len
+         && fwrite (padding, 1, value_pad, file) == value_pad;
+}
+
+/**
+ * Writes the records of the map's pairs after the (not yet written)
+ * header and index, and fills the index in memory.
+ * @return the length of the file, 0 if failed.
+ */
+static size_t write_records (const hashmap *hash_map, FILE *file,
+                             hashmap_snapshot_slot *index, size_t capacity,
+                             const hashmap_codec *key_codec,
+                             const hashmap_codec *value_codec)
+{
+  size_t offset = sizeof (hashmap_snapshot_header)
+                  + capacity * sizeof (hashmap_snapshot_slot);
+  if (fseek (file, (long) offset, SEEK_SET) != 0)
+    return 0;
+
+  unsigned char *key = NULL, *value = NULL;
+  size_t key_size = 0, value_size = 0;
+  hashmap_iter iter = hashmap_iter_begin (hash_map);
+  for (pair *cur_pair = hashmap_iter_next (&iter); cur_pair != NULL;
+       cur_pair = hashmap_iter_next (&iter))
+    {
+      size_t key_len, value_len;
+      if (!encode_into (key_codec, cur_pair->key, &key, &key_size, &key_len)
+          || !encode_into (value_codec, cur_pair->value, &value, &value_size,
+                           &value_len)
+          || !write_record (file, key, (uint32_t) key_len, value,
+                            (uint32_t) value_len))
+        {
+          offset = 0;
+          break;
+        }
+
+      // link the record into the first empty slot of its probe sequence
+      uint64_t hash = hash_string_n (key, key_len);
+      size_t ind = (size_t) hash & (capacity - 1);
+      while (index[ind].offset != 0)
+        ind = (ind + 1) & (capacity - 1);
+      index[ind].hash = hash;
+      index[ind].offset = offset;
+      offset += 2 * sizeof (uint32_t) + snapshot_align (key_len)
+                + snapshot_align (value_len);
+    }
+  free (key);
+  free (value);
+  return offset;
+}
+
+/**
+ * Writes the pairs of a hash map to a snapshot file: a position-independent
+ * image (offsets instead of pointers) of an index over the encoded pairs,
+ * which hashmap_open_mmap serves without rebuilding the map.
+ * @param hash_map a hash map.
+ * @param path the file to be written (replaced if exists).
+ * @param key_codec encodes the keys of the map.
+ * @param value_codec encodes the values of the map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_save (const hashmap *hash_map, const char *path,
+                  const hashmap_codec *key_codec,
+                  const hashmap_codec *value_codec)
+{
+  if (hash_map == NULL || path == NULL || key_codec == NULL
+      || value_codec == NULL)
+    return 0;
+
+  // the index is kept at most half full, so probe sequences stay short
+  size_t capacity = HASH_MAP_INITIAL_CAP;
+  while (capacity < 2 * hash_map->size)
+    capacity *= 2;
+  hashmap_snapshot_slot *index = calloc (capacity, sizeof (*index));
+  if (index == NULL)
+    return 0;
+
+  // the file is written aside and renamed over path, so a reader never
+  // maps a partly written snapshot
+  char *tmp_path = malloc (strlen (path) + sizeof (".tmp"));
+  if (tmp_path == NULL)
+    {
+      free (index);
+      return 0;
+    }
+  strcat (strcpy (tmp_path, path), ".tmp");
+  FILE *file = fopen (tmp_path, "wb");
+
+  hashmap_snapshot_header header = {HASHMAP_SNAPSHOT_MAGIC, hash_map->size,
+                                    capacity, 0};
+  int success = file != NULL;
+  if (success)
+    {
+      header.length = write_records (hash_map, file, index, capacity,
+                                     key_codec, value_codec);
+      success = header.length != 0 && fseek (file, 0, SEEK_SET) == 0
+                && fwrite (&header, sizeof (header), 1, file) == 1
+                && fwrite (index, sizeof (*index), capacity, file) == capacity;
+      success = fclose (file) == 0 && success;
+    }
+  success = success && rename (tmp_path, path) == 0;
+  if (!success)
+    remove (tmp_path);
+
+  free (tmp_path);
+  free (index);
+  return success;
+}
+
+/**
+ * Maps a snapshot file (read-only) to serve lookups directly from it: the
+ * cost of opening does not depend on the number of pairs.
+ * @param path a file written by hashmap_save.
+ * @param key_codec the codec the keys were saved with (the looked-up keys
+ * are encoded with it, and hashed as bytes).
+ * @return pointer to dynamically allocated snapshot.
+ * @if_fail (no such file, or not a valid snapshot) return NULL.
+ */
+hashmap_snapshot *hashmap_open_mmap (const char *path,
+                                     const hashmap_codec *key_codec)
+{
+  if (path == NULL || key_codec == NULL)
+    return NULL;
+
+  int fd = open (path, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  void *base = MAP_FAILED;
+  if (fstat (fd, &st) == 0
+      && (size_t) st.st_size >= sizeof (hashmap_snapshot_header))
+    base = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  // validate the header, so lookups may trust the index bounds
+  size_t length = (size_t) st.st_size;
+  const hashmap_snapshot_header *header = base;
+  size_t capacity = (size_t) header->capacity;
+  if (memcmp (header->magic, HASHMAP_SNAPSHOT_MAGIC,
+              sizeof (header->magic)) != 0
+      || header->length != length || capacity == 0
+      || (capacity & (capacity - 1)) != 0
+      || capacity > (length - sizeof (*header)) / sizeof (hashmap_snapshot_slot))
+    {
+      munmap (base, length);
+      return NULL;
+    }
+
+  hashmap_snapshot *snapshot = malloc (sizeof (*snapshot));
+  if (snapshot == NULL)
+    {
+      munmap (base, length);
+      return NULL;
+    }
+  snapshot->base = base;
+  snapshot->length = length;
+  snapshot->header = header;
+  snapshot->index = (const hashmap_snapshot_slot *) (header + 1);
+  snapshot->key_codec = *key_codec;
+  return snapshot;
+}
+
+/**
+ * Unmaps a snapshot file, and frees the snapshot.
+ * @param p_snapshot pointer to dynamically allocated pointer to snapshot.
+ */
+void hashmap_snapshot_close (hashmap_snapshot **p_snapshot)
+{
+  if (p_snapshot == NULL || *p_snapshot == NULL)
+    return;
+  munmap ((void *) (*p_snapshot)->base, (*p_snapshot)->length);
+  free (*p_snapshot);
+  *p_snapshot = NULL;
+}
+
+/**
+ * @return the value of the record at offset if its key is the given
+ * encoded key, NULL otherwise (or if the record is out of the file).
+ */
+static const void *record_match (const hashmap_snapshot *snapshot,
+                                 uint64_t offset, const unsigned char *key,
+                                 size_t key_len)
+{
+  uint32_t lens[2];
+  if (offset > snapshot->length - sizeof (lens))
+    return NULL;
+  memcpy (lens, snapshot->base + offset, sizeof (lens));
+  size_t value_offset = (size_t) offset + sizeof (lens)
+                        + snapshot_align (lens[0]);
+  if (lens[0] != key_len || value_offset > snapshot->length
+      || lens[1] > snapshot->length - value_offset
+      || memcmp (snapshot->base + offset + sizeof (lens), key, key_len) != 0)
+    return NULL;
+  return snapshot->base + value_offset;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param snapshot a snapshot.
+ * @param key the key to be checked.
+ * @return the encoded value associated with key if exists (a read-only
+ * pointer into the mapped file, valid until the snapshot is closed), NULL
+ * otherwise.
+ */
+const void *hashmap_snapshot_at (const hashmap_snapshot *snapshot,
+                                 const_keyT key)
+{
+  if (snapshot == NULL || key == NULL)
+    return NULL;
+
+  unsigned char stack_key[SNAPSHOT_KEY_BUFFER];
+  unsigned char *encoded = stack_key;
+  size_t key_len = codec_encode (&snapshot->key_codec, key, stack_key,
+                                 sizeof (stack_key));
+  if (key_len > sizeof (stack_key))
+    {
+      encoded = malloc (key_len);
+      if (encoded == NULL)
+        return NULL;
+      codec_encode (&snapshot->key_codec, key, encoded, key_len);
+    }
+
+  const void *value = NULL;
+  uint64_t hash = hash_string_n (encoded, key_len);
+  size_t mask = (size_t) snapshot->header->capacity - 1;
+  for (size_t ind = (size_t) hash & mask, probes = 0; probes <= mask;
+       ind = (ind + 1) & mask, probes++)
+    {
+      const hashmap_snapshot_slot *slot = &snapshot->index[ind];
+      if (slot->offset == 0)
+        break;
+      if (slot->hash == hash)
+        {
+          value = record_match (snapshot, slot->offset, encoded, key_len);
+          if (value != NULL)
+            break;
+        }
+    }
+
+  if (encoded != stack_key)
+    free (encoded);
+  return value;
+}
+
+/**
+ * @param snapshot a snapshot.
+ * @return the number of pairs in the snapshot.
+ */
+size_t hashmap_snapshot_size (const hashmap_snapshot *snapshot)
+{
+  return snapshot == NULL ? 0 : (size_t) snapshot->header->count;
+}
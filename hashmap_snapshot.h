@@ -0,0 +1,137 @@
+#ifndef HASHMAP_SNAPSHOT_H_
+#define HASHMAP_SNAPSHOT_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * @def HASHMAP_SNAPSHOT_MAGIC
+ * The first 8 bytes of a snapshot file (the format version included).
+ */
+#define HASHMAP_SNAPSHOT_MAGIC "HMSNAP1"
+
+/**
+ * @typedef hashmap_encode_func
+ * Encodes an element (a key or a value) into position-independent bytes.
+ * @param elem the element to be encoded.
+ * @param out the buffer to write the bytes to.
+ * @param out_size the size of out: nothing is written if it is too small.
+ * @return the number of bytes elem encodes to.
+ */
+typedef size_t (*hashmap_encode_func) (const void *elem, void *out,
+                                       size_t out_size);
+
+/**
+ * @struct hashmap_codec - how elements of one type are written to a
+ * snapshot. The encoded bytes of a value are what hashmap_snapshot_at
+ * returns, so they must be usable in place (8-byte aligned, no pointers).
+ * @param encode the element's encode function, NULL for elements that are
+ * their own bytes (such as ints and doubles).
+ * @param size with encode NULL: the number of bytes of an element.
+ */
+typedef struct hashmap_codec {
+    hashmap_encode_func encode;
+    size_t size;
+} hashmap_codec;
+
+/**
+ * @var hashmap_string_codec
+ * Encodes a NUL-terminated string as its chars, the NUL included.
+ */
+extern const hashmap_codec hashmap_string_codec;
+
+/**
+ * @struct hashmap_snapshot_slot - an index slot of a snapshot file.
+ * @param hash the hash (hash_string_n) of the encoded key.
+ * @param offset the file offset of the slot's record, 0 for an empty slot.
+ */
+typedef struct hashmap_snapshot_slot {
+    uint64_t hash;
+    uint64_t offset;
+} hashmap_snapshot_slot;
+
+/**
+ * @struct hashmap_snapshot_header - the start of a snapshot file.
+ * The file is: the header, the index (capacity slots, probed linearly),
+ * then the records. Each record is a uint32_t key length, a uint32_t value
+ * length, the key bytes and the value bytes, the value starting 8-byte
+ * aligned. Numbers are in the byte order of the machine that saved it.
+ * @param magic HASHMAP_SNAPSHOT_MAGIC.
+ * @param count the number of pairs.
+ * @param capacity the number of index slots (a power of 2).
+ * @param length the size of the whole file.
+ */
+typedef struct hashmap_snapshot_header {
+    char magic[8];
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t length;
+} hashmap_snapshot_header;
+
+/**
+ * @struct hashmap_snapshot - a read-only map served from a mapped file.
+ * @param base the mapped file.
+ * @param length the size of the mapping.
+ * @param header the header of the file.
+ * @param index the index slots of the file.
+ * @param key_codec encodes the looked-up keys, as they were saved.
+ */
+typedef struct hashmap_snapshot {
+    const unsigned char *base;
+    size_t length;
+    const hashmap_snapshot_header *header;
+    const hashmap_snapshot_slot *index;
+    hashmap_codec key_codec;
+} hashmap_snapshot;
+
+/**
+ * Writes the pairs of a hash map to a snapshot file: a position-independent
+ * image (offsets instead of pointers) of an index over the encoded pairs,
+ * which hashmap_open_mmap serves without rebuilding the map.
+ * @param hash_map a hash map.
+ * @param path the file to be written (replaced if exists).
+ * @param key_codec encodes the keys of the map.
+ * @param value_codec encodes the values of the map.
+ * @return 1 if the process has succeeded, 0 else
+ */
+int hashmap_save (const hashmap *hash_map, const char *path,
+                  const hashmap_codec *key_codec,
+                  const hashmap_codec *value_codec);
+
+/**
+ * Maps a snapshot file (read-only) to serve lookups directly from it: the
+ * cost of opening does not depend on the number of pairs.
+ * @param path a file written by hashmap_save.
+ * @param key_codec the codec the keys were saved with (the looked-up keys
+ * are encoded with it, and hashed as bytes).
+ * @return pointer to dynamically allocated snapshot.
+ * @if_fail (no such file, or not a valid snapshot) return NULL.
+ */
+hashmap_snapshot *hashmap_open_mmap (const char *path,
+                                     const hashmap_codec *key_codec);
+
+/**
+ * Unmaps a snapshot file, and frees the snapshot.
+ * @param p_snapshot pointer to dynamically allocated pointer to snapshot.
+ */
+void hashmap_snapshot_close (hashmap_snapshot **p_snapshot);
+
+/**
+ * The function returns the value associated with the given key.
+ * @param snapshot a snapshot.
+ * @param key the key to be checked.
+ * @return the encoded value associated with key if exists (a read-only
+ * pointer into the mapped file, valid until the snapshot is closed), NULL
+ * otherwise.
+ */
+const void *hashmap_snapshot_at (const hashmap_snapshot *snapshot,
+                                 const_keyT key);
+
+/**
+ * @param snapshot a snapshot.
+ * @return the number of pairs in the snapshot.
+ */
+size_t hashmap_snapshot_size (const hashmap_snapshot *snapshot);
+
+#endif //HASHMAP_SNAPSHOT_H_
@@ -0,0 +1,301 @@
+#ifndef HASHMAP_TYPED_H_
+#define HASHMAP_TYPED_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "hashmap_group.h"
+
+/**
+ * @def HASHMAP_DECLARE(name, K, V, hash_fn, eq_fn)
+ * Generates a hash map specialized to the key type K and the value type V.
+ * The keys and values are stored by value in the slots themselves (no pair,
+ * no pair_type), and hash_fn / eq_fn are called directly, so the compiler
+ * inlines them into the probe loops: no function-pointer dispatch is left.
+ * The table is the open-addressing layout of hashmap.c (see
+ * HASHMAP_OPEN_ADDRESSING): metadata bytes probed a group at a time, and the
+ * same load factors and growth factor.
+ *
+ * K and V must be plain values (copied with assignment): the map never
+ * copies or frees memory they may point to.
+ * @param name the name of the generated type, and the prefix of its
+ * functions: name_alloc, name_free, name_insert, name_at, name_erase,
+ * name_get_or_insert, name_apply_if, name_get_load_factor and name_next.
+ * @param hash_fn a function (or a macro) size_t hash_fn (K key).
+ * @param eq_fn a function (or a macro) int eq_fn (K a, K b), 1 iff equal.
+ *
+ * Example:
+ *     static inline size_t int_hash (int k) { return (size_t) k; }
+ *     static inline int int_eq (int a, int b) { return a == b; }
+ *     HASHMAP_DECLARE (int_map, int, int, int_hash, int_eq)
+ *
+ *     int_map *map = int_map_alloc ();
+ *     int_map_insert (map, 3, 9);
+ *     *int_map_get_or_insert (map, 4, 0) += 1;
+ *     int *value = int_map_at (map, 3);
+ *     int_map_free (&map);
+ */
+#define HASHMAP_DECLARE(name, K, V, hash_fn, eq_fn)                           \
+                                                                              \
+typedef struct name##_slot {                                                  \
+    K key;                                                                    \
+    V value;                                                                  \
+} name##_slot;                                                                \
+                                                                              \
+typedef struct name {                                                         \
+    int8_t *ctrl;                                                             \
+    name##_slot *slots;                                                       \
+    size_t size;                                                              \
+    size_t capacity;                                                          \
+    size_t tombstones;                                                        \
+} name;                                                                       \
+                                                                              \
+/* Allocates the metadata and slots arrays, 1 on success, 0 else. */          \
+static inline int name##_alloc_arrays (name *map, size_t capacity)            \
+{                                                                             \
+  map->ctrl = malloc (capacity * sizeof (int8_t));                            \
+  map->slots = malloc (capacity * sizeof (name##_slot));                      \
+  if (map->ctrl == NULL || map->slots == NULL)                                \
+    {                                                                         \
+      free (map->ctrl);                                                       \
+      free (map->slots);                                                      \
+      return 0;                                                               \
+    }                                                                         \
+  memset (map->ctrl, CTRL_EMPTY, capacity);                                   \
+  map->capacity = capacity;                                                   \
+  map->tombstones = 0;                                                        \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/* @return pointer to dynamically allocated map, NULL if failed. */           \
+static inline name *name##_alloc (void)                                       \
+{                                                                             \
+  name *map = malloc (sizeof (*map));                                         \
+  if (map == NULL)                                                            \
+    return NULL;                                                              \
+  if (!name##_alloc_arrays (map, HASH_MAP_INITIAL_CAP))                       \
+    {                                                                         \
+      free (map);                                                             \
+      return NULL;                                                            \
+    }                                                                         \
+  map->size = 0;                                                              \
+  return map;                                                                 \
+}                                                                             \
+                                                                              \
+/* Frees the map, and sets *p_map to NULL. */                                 \
+static inline void name##_free (name **p_map)                                 \
+{                                                                             \
+  if (p_map == NULL || *p_map == NULL)                                        \
+    return;                                                                   \
+  free ((*p_map)->ctrl);                                                      \
+  free ((*p_map)->slots);                                                     \
+  free (*p_map);                                                              \
+  *p_map = NULL;                                                              \
+}                                                                             \
+                                                                              \
+/* @return the slot index of key, map->capacity if key not in map. */         \
+static inline size_t name##_find (const name *map, K key, uint64_t mixed)     \
+{                                                                             \
+  size_t groups = map->capacity / HASH_MAP_GROUP_WIDTH;                       \
+  size_t group = (size_t) (mixed >> 7) & (groups - 1);                        \
+  int8_t tag = (int8_t) (mixed & 0x7f);                                       \
+  for (size_t step = 1; step <= groups; step++)                               \
+    {                                                                         \
+      const int8_t *ctrl = map->ctrl + group * HASH_MAP_GROUP_WIDTH;          \
+      for (uint32_t m = group_match (ctrl, tag); m != 0; m &= m - 1)          \
+        {                                                                     \
+          size_t ind = group * HASH_MAP_GROUP_WIDTH + __builtin_ctz (m);      \
+          if (eq_fn (map->slots[ind].key, key))                               \
+            return ind;                                                       \
+        }                                                                     \
+      if (group_match (ctrl, CTRL_EMPTY))                                     \
+        return map->capacity;                                                 \
+      group = (group + step) & (groups - 1);                                  \
+    }                                                                         \
+  return map->capacity;                                                       \
+}                                                                             \
+                                                                              \
+/* Claims the first free slot of the probe sequence, @return its index. */    \
+static inline size_t name##_claim (name *map, uint64_t mixed)                 \
+{                                                                             \
+  size_t groups = map->capacity / HASH_MAP_GROUP_WIDTH;                       \
+  size_t group = (size_t) (mixed >> 7) & (groups - 1);                        \
+  for (size_t step = 1;; step++)                                              \
+    {                                                                         \
+      uint32_t m = group_match_free (map->ctrl                                \
+                                     + group * HASH_MAP_GROUP_WIDTH);         \
+      if (m != 0)                                                             \
+        {                                                                     \
+          size_t ind = group * HASH_MAP_GROUP_WIDTH + __builtin_ctz (m);      \
+          if (map->ctrl[ind] == CTRL_DELETED)                                 \
+            map->tombstones--;                                                \
+          map->ctrl[ind] = (int8_t) (mixed & 0x7f);                           \
+          return ind;                                                         \
+        }                                                                     \
+      group = (group + step) & (groups - 1);                                  \
+    }                                                                         \
+}                                                                             \
+                                                                              \
+/* Rehashes the map into new_capacity slots, 1 on success, 0 else (then the   \
+   map is unchanged). */                                                      \
+static inline int name##_resize (name *map, size_t new_capacity)              \
+{                                                                             \
+  name old = *map;                                                            \
+  if (!name##_alloc_arrays (map, new_capacity))                               \
+    {                                                                         \
+      *map = old;                                                             \
+      return 0;                                                               \
+    }                                                                         \
+  for (size_t i = 0; i < old.capacity; i++)                                   \
+    if (old.ctrl[i] >= 0)                                                     \
+      {                                                                       \
+        size_t ind = name##_claim (map, mix_hash (hash_fn (old.slots[i].key)));\
+        map->slots[ind] = old.slots[i];                                       \
+      }                                                                       \
+  free (old.ctrl);                                                            \
+  free (old.slots);                                                           \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/* Makes room for one more key before it is placed: grows the map, or drops   \
+   its tombstones. @return 1 on success, 0 else. */                           \
+static inline int name##_reserve_one (name *map)                              \
+{                                                                             \
+  double max_slots = HASH_MAP_MAX_LOAD_FACTOR * (double) map->capacity;       \
+  if ((double) (map->size + 1) > max_slots)                                   \
+    return name##_resize (map, map->capacity * HASH_MAP_GROWTH_FACTOR);       \
+  if ((double) (map->size + map->tombstones + 1) > max_slots)                 \
+    name##_resize (map, map->capacity);                                       \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * Inserts (key, value) to the map.                                           \
+ * @return 1 for successful insertion, 0 otherwise (also if key in map).     \
+ */                                                                           \
+static inline int name##_insert (name *map, K key, V value)                   \
+{                                                                             \
+  if (map == NULL)                                                            \
+    return 0;                                                                 \
+  uint64_t mixed = mix_hash (hash_fn (key));                                  \
+  if (name##_find (map, key, mixed) != map->capacity                          \
+      || !name##_reserve_one (map))                                           \
+    return 0;                                                                 \
+  size_t ind = name##_claim (map, mixed);                                     \
+  map->slots[ind].key = key;                                                  \
+  map->slots[ind].value = value;                                              \
+  map->size++;                                                                \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * @return pointer to the value associated with key (in the map itself, valid \
+ * until the next insertion or erasure), NULL if key not in map.             \
+ */                                                                           \
+static inline V *name##_at (const name *map, K key)                           \
+{                                                                             \
+  if (map == NULL)                                                            \
+    return NULL;                                                              \
+  size_t ind = name##_find (map, key, mix_hash (hash_fn (key)));              \
+  return ind == map->capacity ? NULL : &map->slots[ind].value;                \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * Looks key up once, and inserts (key, init) if it is not in the map.        \
+ * @return pointer to the value associated with key (see name_at), NULL if    \
+ * the insertion failed.                                                      \
+ */                                                                           \
+static inline V *name##_get_or_insert (name *map, K key, V init)              \
+{                                                                             \
+  if (map == NULL)                                                            \
+    return NULL;                                                              \
+  uint64_t mixed = mix_hash (hash_fn (key));                                  \
+  size_t ind = name##_find (map, key, mixed);                                 \
+  if (ind != map->capacity)                                                   \
+    return &map->slots[ind].value;                                            \
+  if (!name##_reserve_one (map))                                              \
+    return NULL;                                                              \
+  ind = name##_claim (map, mixed);                                            \
+  map->slots[ind].key = key;                                                  \
+  map->slots[ind].value = init;                                               \
+  map->size++;                                                                \
+  return &map->slots[ind].value;                                              \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * Erases the key and its value from the map.                                 \
+ * @return 1 if the erasing was done successfully, 0 otherwise (if key not    \
+ * in map, considered fail).                                                  \
+ */                                                                           \
+static inline int name##_erase (name *map, K key)                             \
+{                                                                             \
+  if (map == NULL)                                                            \
+    return 0;                                                                 \
+  size_t ind = name##_find (map, key, mix_hash (hash_fn (key)));              \
+  if (ind == map->capacity)                                                   \
+    return 0;                                                                 \
+  size_t group = ind & ~(HASH_MAP_GROUP_WIDTH - 1);                           \
+  if (group_match (map->ctrl + group, CTRL_EMPTY))                            \
+    map->ctrl[ind] = CTRL_EMPTY;                                              \
+  else                                                                        \
+    {                                                                         \
+      map->ctrl[ind] = CTRL_DELETED;                                          \
+      map->tombstones++;                                                      \
+    }                                                                         \
+  map->size--;                                                                \
+  if ((double) map->size                                                      \
+      < HASH_MAP_MIN_LOAD_FACTOR * (double) map->capacity                     \
+      && map->capacity > HASH_MAP_GROUP_WIDTH)                                \
+    name##_resize (map, map->capacity / HASH_MAP_GROWTH_FACTOR);              \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * Applies val_fn on the values whose keys fulfill key_pred.                  \
+ * @return number of changed values.                                          \
+ */                                                                           \
+static inline int name##_apply_if (const name *map,                           \
+                                   int (*key_pred) (const K *),               \
+                                   void (*val_fn) (V *))                      \
+{                                                                             \
+  int counter = 0;                                                            \
+  if (map == NULL || key_pred == NULL || val_fn == NULL)                      \
+    return counter;                                                           \
+  for (size_t ind = 0; ind < map->capacity; ind++)                            \
+    if (map->ctrl[ind] >= 0 && key_pred (&map->slots[ind].key))               \
+      {                                                                       \
+        val_fn (&map->slots[ind].value);                                      \
+        counter++;                                                            \
+      }                                                                       \
+  return counter;                                                             \
+}                                                                             \
+                                                                              \
+/* @return the map's load factor, -1 if the function failed. */               \
+static inline double name##_get_load_factor (const name *map)                 \
+{                                                                             \
+  if (map == NULL || map->capacity == 0)                                      \
+    return -1;                                                                \
+  return (double) map->size / (double) map->capacity;                         \
+}                                                                             \
+                                                                              \
+/**                                                                           \
+ * Iterates the map: start with *pos = 0, each call sets *key and *value to   \
+ * the next entry (pointers into the map) and advances *pos.                 \
+ * The map must not be modified while iterating (values may be).              \
+ * @return 1 if an entry was found, 0 when the iteration is over.             \
+ */                                                                           \
+static inline int name##_next (const name *map, size_t *pos, K **key,         \
+                               V **value)                                     \
+{                                                                             \
+  for (; *pos < map->capacity; (*pos)++)                                      \
+    if (map->ctrl[*pos] >= 0)                                                 \
+      {                                                                       \
+        *key = &map->slots[*pos].key;                                         \
+        *value = &map->slots[*pos].value;                                     \
+        (*pos)++;                                                             \
+        return 1;                                                             \
+      }                                                                       \
+  return 0;                                                                   \
+}
+
+#endif //HASHMAP_TYPED_H_
@@ -0,0 +1,1184 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "markov_chain.h"
+#include "hashmap_group.h"
+
+/**
+ * @def MARKOV_NO_STATE
+ * The id of no state (no previous word, no follower), a state id being
+ * the id of its word.
+ */
+#define MARKOV_NO_STATE SYMTAB_NO_ID
+
+/**
+ * Destroy hook of the states vector: frees the state's followers.
+ */
+static void state_destroy (void *elem)
+{
+  markov_state *state = elem;
+  follower_map_free (&state->followers);
+  free (state->alias);
+}
+
+/**
+ * Allocates dynamically a new, empty, markov chain of the given order.
+ * @param order the number of words a next word is drawn by (1 to
+ * MARKOV_MAX_ORDER).
+ * @return pointer to dynamically allocated markov chain.
+ * @if_fail (out of memory, or an invalid order) return NULL.
+ */
+markov_chain *markov_chain_alloc_order (unsigned order)
+{
+  if (order == 0 || order > MARKOV_MAX_ORDER)
+    return NULL;
+  markov_chain *chain = malloc (sizeof (*chain));
+  if (chain == NULL)
+    return NULL;
+
+  chain->order = order;
+  chain->words = symtab_alloc ();
+  chain->states = vector_alloc_by_value (sizeof (markov_state), NULL, NULL,
+                                         state_destroy);
+  chain->dirty = vector_alloc_by_value (sizeof (uint32_t), NULL, NULL, NULL);
+  chain->context_ids = context_map_alloc ();
+  chain->contexts = vector_alloc_by_value (sizeof (markov_state), NULL, NULL,
+                                           state_destroy);
+  chain->context_dirty = vector_alloc_by_value (sizeof (uint32_t), NULL, NULL,
+                                                NULL);
+  chain->starts = 0;
+  chain->tokens = 0;
+  if (chain->words == NULL || chain->states == NULL || chain->dirty == NULL
+      || chain->context_ids == NULL || chain->contexts == NULL
+      || chain->context_dirty == NULL)
+    markov_chain_free (&chain);
+  return chain;
+}
+
+/**
+ * Allocates dynamically a new, empty, markov chain of order 1 (a next word
+ * is drawn by the current word alone).
+ * @return pointer to dynamically allocated markov chain.
+ * @if_fail return NULL.
+ */
+markov_chain *markov_chain_alloc (void)
+{
+  return markov_chain_alloc_order (1);
+}
+
+/**
+ * Frees a markov chain, its states and its words.
+ * @param p_chain pointer to dynamically allocated pointer to markov chain.
+ */
+void markov_chain_free (markov_chain **p_chain)
+{
+  if (p_chain == NULL || *p_chain == NULL)
+    return;
+  vector_free (&(*p_chain)->states);
+  vector_free (&(*p_chain)->dirty);
+  context_map_free (&(*p_chain)->context_ids);
+  vector_free (&(*p_chain)->contexts);
+  vector_free (&(*p_chain)->context_dirty);
+  symtab_free (&(*p_chain)->words);
+  free (*p_chain);
+  *p_chain = NULL;
+}
+
+/**
+ * @return the state of the given id, for modification.
+ */
+static markov_state *state_at (const markov_chain *chain, uint32_t id)
+{
+  return vector_at (chain->states, id);
+}
+
+/**
+ * Interns the word, and adds it as a new state on its first occurrence.
+ * @param chain a markov chain.
+ * @param token a token view of the word.
+ * @return the state id of the word, MARKOV_NO_STATE if failed.
+ */
+static uint32_t markov_chain_intern (markov_chain *chain,
+                                     const token_view *token)
+{
+  uint32_t id = symtab_intern (chain->words, token->ptr, token->len);
+  if (id == SYMTAB_NO_ID || id < chain->states->size)
+    return id;
+
+  // a new word: its id is the next state's
+  markov_state state = {
+      token->len > 0 && token->ptr[token->len - 1] == '.', 0, 0, NULL, NULL};
+  if (!vector_push_back (chain->states, &state))
+    return MARKOV_NO_STATE;
+  chain->starts += !state.is_end;
+  return id;
+}
+
+/**
+ * Counts the word of id next as a follower of the state of the given index
+ * in states, marking the state dirty (its index goes to dirty).
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int state_link (vector *states, vector *dirty, uint32_t index,
+                       uint32_t next)
+{
+  markov_state *state = vector_at (states, index);
+  if (!state->dirty)
+    {
+      if (!vector_push_back (dirty, &index))
+        return 0;
+      state->dirty = 1;
+    }
+  if (state->followers == NULL)
+    {
+      state->followers = follower_map_alloc ();
+      if (state->followers == NULL)
+        return 0;
+    }
+  uint32_t *count = follower_map_get_or_insert (state->followers, next, 0);
+  if (count == NULL)
+    return 0;
+  (*count)++;
+  state->total++;
+  return 1;
+}
+
+/**
+ * Looks the context up (a single probe for a known one), and adds it as a
+ * new context state on its first occurrence.
+ * @return the index of the context's state, MARKOV_NO_STATE if failed.
+ */
+static uint32_t markov_chain_context (markov_chain *chain, markov_key key)
+{
+  if (chain->contexts->size >= MARKOV_NO_STATE)
+    return MARKOV_NO_STATE;
+  uint32_t size = (uint32_t) chain->contexts->size;
+  uint32_t *index = context_map_get_or_insert (chain->context_ids, key, size);
+  if (index == NULL || *index < size)
+    return index == NULL ? MARKOV_NO_STATE : *index;
+
+  markov_state state = {0, 0, 0, NULL, NULL};
+  if (!vector_push_back (chain->contexts, &state))
+    {
+      context_map_erase (chain->context_ids, key);
+      return MARKOV_NO_STATE;
+    }
+  return size;
+}
+
+/**
+ * Trains the chain on the tokens of one line (a tweet): each word is
+ * counted as a follower of the word before it, and of the contexts of the
+ * 2 to order words before it, unless these include an end word.
+ * @param chain a markov chain.
+ * @param tokens the token views of the line.
+ * @param n the number of tokens.
+ * @param words_left if not NULL, the number of words left to train on: it
+ * is decremented by the words read, and the line is cut when it reaches 0.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+int markov_chain_train_tokens (markov_chain *chain, const token_view *tokens,
+                               size_t n, size_t *words_left)
+{
+  if (chain == NULL || (tokens == NULL && n > 0))
+    return 0;
+
+  // the window holds the words since the last end word, up to order ones
+  markov_key window = {0, 0};
+  size_t filled = 0;
+  for (size_t i = 0; i < n; i++)
+    {
+      if (words_left != NULL && *words_left == 0)
+        break;
+      uint32_t id = markov_chain_intern (chain, &tokens[i]);
+      if (id == MARKOV_NO_STATE)
+        return 0;
+      if (filled > 0
+          && !state_link (chain->states, chain->dirty,
+                          markov_key_slot (window, 0) - 1, id))
+        return 0;
+      for (size_t length = 2; length <= filled; length++)
+        {
+          uint32_t index = markov_chain_context (
+              chain, markov_key_suffix (window, length));
+          if (index == MARKOV_NO_STATE
+              || !state_link (chain->contexts, chain->context_dirty, index,
+                              id))
+            return 0;
+        }
+      if (state_at (chain, id)->is_end)
+        {
+          window = (markov_key) {0, 0};
+          filled = 0;
+        }
+      else
+        {
+          window = markov_key_suffix (markov_key_push (window, id),
+                                      chain->order);
+          filled += filled < chain->order;
+        }
+      chain->tokens++;
+      if (words_left != NULL)
+        (*words_left)--;
+    }
+  return 1;
+}
+
+/**
+ * Trains the chain on one line (a tweet), see markov_chain_train_tokens.
+ * @param chain a markov chain.
+ * @param line a NUL-terminated line, its words separated by
+ * MARKOV_DELIMITERS.
+ * @param words_left if not NULL, the number of words left to train on: it
+ * is decremented by the words read, and the line is cut when it reaches 0.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+int markov_chain_train_line (markov_chain *chain, const char *line,
+                             size_t *words_left)
+{
+  if (chain == NULL || line == NULL)
+    return 0;
+
+  token_view tokens[CORPUS_MAX_TOKENS];
+  size_t n = 0;
+  for (line += strspn (line, MARKOV_DELIMITERS); *line != '\0';
+       line += strspn (line, MARKOV_DELIMITERS))
+    {
+      tokens[n].ptr = line;
+      tokens[n].len = strcspn (line, MARKOV_DELIMITERS);
+      line += tokens[n++].len;
+      // a too long line is trained on as several lines
+      if (n == CORPUS_MAX_TOKENS)
+        {
+          if (!markov_chain_train_tokens (chain, tokens, n, words_left))
+            return 0;
+          n = 0;
+        }
+    }
+  return markov_chain_train_tokens (chain, tokens, n, words_left);
+}
+
+/**
+ * Trains the chain on a corpus, a tweet per line.
+ * @param chain a markov chain.
+ * @param corpus an open corpus reader.
+ * @param max_words the maximal number of words to train on (0 for all).
+ * @return 1 if the process has succeeded, 0 else (out of memory, or reading
+ * the corpus failed)
+ */
+int markov_chain_train_corpus (markov_chain *chain, corpus_reader *corpus,
+                               size_t max_words)
+{
+  if (chain == NULL || corpus == NULL)
+    return 0;
+
+  const token_view *tokens;
+  size_t n;
+  size_t *words_left = max_words > 0 ? &max_words : NULL;
+  while ((words_left == NULL || *words_left > 0)
+         && corpus_next_line (corpus, &tokens, &n))
+    if (!markov_chain_train_tokens (chain, tokens, n, words_left))
+      return 0;
+  return !corpus->error;
+}
+
+/**
+ * @struct train_part - a part of the corpus, trained on by one thread.
+ * @param corpus the lines of the part.
+ * @param local the chain the thread trains, private to it.
+ * @param to_global local state id -> the id of its word in the merged chain.
+ * @param to_global_context local context index -> the index of the context
+ * in the merged chain.
+ * @param success 1 if the thread has succeeded.
+ */
+typedef struct train_part {
+    corpus_reader *corpus;
+    markov_chain *local;
+    uint32_t *to_global;
+    uint32_t *to_global_context;
+    int success;
+} train_part;
+
+/**
+ * @struct merge_part - the states of the merged chain one thread merges
+ * the local followers into: the ones whose mixed index falls to its own.
+ * @param chain the merged chain.
+ * @param parts the trained parts.
+ * @param nparts the number of trained parts.
+ * @param index the index of the thread's partition.
+ * @param count the number of partitions.
+ * @param dirty the ids of the word states the thread made dirty (a
+ * uint32_t each), for the chain's dirty list.
+ * @param context_dirty the same, of the context states.
+ * @param success 1 if the thread has succeeded.
+ */
+typedef struct merge_part {
+    markov_chain *chain;
+    const train_part *parts;
+    size_t nparts;
+    size_t index;
+    size_t count;
+    vector *dirty;
+    vector *context_dirty;
+    int success;
+} merge_part;
+
+static void *train_part_run (void *arg)
+{
+  train_part *part = arg;
+  part->success = markov_chain_train_corpus (part->local, part->corpus, 0);
+  return NULL;
+}
+
+/**
+ * Merges the followers of the local states (word or context ones) of a
+ * trained part into the merged states of the thread's partition.
+ * @param part the thread's partition.
+ * @param trained the trained part.
+ * @param local_states the local states.
+ * @param to_merged local state index -> merged state index.
+ * @param states the merged states.
+ * @param dirty output: the merged states made dirty.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int merge_states (const merge_part *part, const train_part *trained,
+                         const vector *local_states,
+                         const uint32_t *to_merged, vector *states,
+                         vector *dirty)
+{
+  for (size_t i = 0; i < local_states->size; i++)
+    {
+      uint32_t merged = to_merged[i];
+      const markov_state *local = vector_at (local_states, i);
+      if (local->total == 0 || mix_hash (merged) % part->count != part->index)
+        continue;
+
+      // the state is this thread's alone, no lock is needed
+      markov_state *state = vector_at (states, merged);
+      if (!state->dirty)
+        {
+          if (!vector_push_back (dirty, &merged))
+            return 0;
+          state->dirty = 1;
+        }
+      if (state->followers == NULL
+          && (state->followers = follower_map_alloc ()) == NULL)
+        return 0;
+      size_t pos = 0;
+      uint32_t *next, *count;
+      while (follower_map_next (local->followers, &pos, &next, &count))
+        {
+          uint32_t *total = follower_map_get_or_insert (
+              state->followers, trained->to_global[*next], 0);
+          if (total == NULL)
+            return 0;
+          *total += *count;
+        }
+      state->total += local->total;
+    }
+  return 1;
+}
+
+static void *merge_part_run (void *arg)
+{
+  merge_part *part = arg;
+  part->success = 1;
+  for (size_t t = 0; part->success && t < part->nparts; t++)
+    {
+      const train_part *trained = &part->parts[t];
+      part->success = merge_states (part, trained, trained->local->states,
+                                    trained->to_global, part->chain->states,
+                                    part->dirty)
+                      && merge_states (part, trained,
+                                       trained->local->contexts,
+                                       trained->to_global_context,
+                                       part->chain->contexts,
+                                       part->context_dirty);
+    }
+  return NULL;
+}
+
+/**
+ * Runs func on each of the n args (elem_size bytes each): n - 1 of them on
+ * new threads, the last one on the calling thread (and any whose thread
+ * could not be created).
+ */
+static void run_parallel (void *(*func) (void *), void *args,
+                          size_t elem_size, size_t n)
+{
+  pthread_t *threads = malloc (n * sizeof (*threads));
+  int *started = calloc (n, sizeof (*started));
+  for (size_t t = 0; threads != NULL && started != NULL && t + 1 < n; t++)
+    started[t] = pthread_create (&threads[t], NULL, func,
+                                 (char *) args + t * elem_size) == 0;
+  func ((char *) args + (n - 1) * elem_size);
+  for (size_t t = 0; t + 1 < n; t++)
+    {
+      if (started != NULL && started[t])
+        pthread_join (threads[t], NULL);
+      else
+        func ((char *) args + t * elem_size);
+    }
+  free (threads);
+  free (started);
+}
+
+/**
+ * Splits the corpus into nthreads parts at line boundaries, and trains a
+ * private chain (of the chain's order) on each part on its own thread.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int train_parts (const markov_chain *chain, corpus_reader *corpus,
+                        train_part *parts, size_t nthreads)
+{
+  const char *data = corpus->data + corpus->pos;
+  size_t length = corpus->length - corpus->pos, begin = 0;
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      // a part ends after the line its share of the corpus ends in
+      size_t end = t + 1 == nthreads ? length : length / nthreads * (t + 1);
+      if (end < begin)
+        end = begin;
+      const char *newline = memchr (data + end, '\n', length - end);
+      if (newline != NULL && t + 1 < nthreads)
+        end = (size_t) (newline - data) + 1;
+      else
+        end = length;
+      parts[t].corpus = corpus_open_memory (data + begin, end - begin);
+      parts[t].local = markov_chain_alloc_order (chain->order);
+      if (parts[t].corpus == NULL || parts[t].local == NULL)
+        return 0;
+      begin = end;
+    }
+  corpus->pos = corpus->length;
+
+  run_parallel (train_part_run, parts, sizeof (*parts), nthreads);
+  for (size_t t = 0; t < nthreads; t++)
+    if (!parts[t].success)
+      return 0;
+  return 1;
+}
+
+/**
+ * @return the key of the same words, by their ids in the merged chain.
+ */
+static markov_key key_to_global (markov_key key, const uint32_t *to_global)
+{
+  markov_key global = {0, 0};
+  for (unsigned slot = MARKOV_MAX_ORDER; slot-- > 0;)
+    if (markov_key_slot (key, slot) != 0)
+      global = markov_key_push (global,
+                                to_global[markov_key_slot (key, slot) - 1]);
+  return global;
+}
+
+/**
+ * Merges the words and the contexts of the trained parts into the chain,
+ * in the order of the parts (so the word ids are the ones a sequential
+ * training gives), and maps their local ids and indices to the chain's.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int merge_words (markov_chain *chain, train_part *parts,
+                        size_t nparts)
+{
+  for (size_t t = 0; t < nparts; t++)
+    {
+      markov_chain *local = parts[t].local;
+      size_t size = markov_chain_size (local);
+      // (one more each, so an empty part is not a failed malloc)
+      parts[t].to_global = malloc ((size + 1) * sizeof (uint32_t));
+      parts[t].to_global_context = malloc ((local->contexts->size + 1)
+                                           * sizeof (uint32_t));
+      if (parts[t].to_global == NULL || parts[t].to_global_context == NULL)
+        return 0;
+      for (uint32_t id = 0; id < size; id++)
+        {
+          const char *word = symtab_word (local->words, id);
+          token_view token = {word, strlen (word)};
+          parts[t].to_global[id] = markov_chain_intern (chain, &token);
+          if (parts[t].to_global[id] == MARKOV_NO_STATE)
+            return 0;
+        }
+
+      size_t pos = 0;
+      markov_key *key;
+      uint32_t *index;
+      while (context_map_next (local->context_ids, &pos, &key, &index))
+        {
+          parts[t].to_global_context[*index] = markov_chain_context (
+              chain, key_to_global (*key, parts[t].to_global));
+          if (parts[t].to_global_context[*index] == MARKOV_NO_STATE)
+            return 0;
+        }
+      chain->tokens += local->tokens;
+    }
+  return 1;
+}
+
+/**
+ * Appends the ids of a thread's dirty states to the chain's dirty list,
+ * and frees them.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int merge_dirty (vector *dirty, vector **p_part_dirty)
+{
+  int success = 1;
+  for (size_t i = 0; success && i < (*p_part_dirty)->size; i++)
+    success = vector_push_back (dirty, vector_at (*p_part_dirty, i));
+  vector_free (p_part_dirty);
+  return success;
+}
+
+/**
+ * Merges the followers of the trained parts into the chain: the states
+ * (and the contexts) are partitioned by their mixed ids among nthreads
+ * threads, each merging the followers of its own states only.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int merge_followers (markov_chain *chain, const train_part *parts,
+                            size_t nthreads)
+{
+  merge_part *merges = calloc (nthreads, sizeof (*merges));
+  if (merges == NULL)
+    return 0;
+  int success = 1;
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      merges[t] = (merge_part) {
+          chain, parts, nthreads, t, nthreads,
+          vector_alloc_by_value (sizeof (uint32_t), NULL, NULL, NULL),
+          vector_alloc_by_value (sizeof (uint32_t), NULL, NULL, NULL), 0};
+      success = success && merges[t].dirty != NULL
+                && merges[t].context_dirty != NULL;
+    }
+  if (success)
+    run_parallel (merge_part_run, merges, sizeof (*merges), nthreads);
+
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      success = success && merges[t].success;
+      if (merges[t].dirty != NULL)
+        success = merge_dirty (chain->dirty, &merges[t].dirty) && success;
+      if (merges[t].context_dirty != NULL)
+        success = merge_dirty (chain->context_dirty, &merges[t].context_dirty)
+                  && success;
+    }
+  free (merges);
+  return success;
+}
+
+/**
+ * Trains the chain on a corpus, a tweet per line, on nthreads threads: the
+ * corpus is split at line boundaries, a private chain is trained on each
+ * part, and the parts are merged into the chain in parallel, each thread
+ * owning a partition of the states. The words, ids and counts are the
+ * ones markov_chain_train_corpus gives (the followers of a state may be
+ * iterated in another order).
+ * @param chain a markov chain.
+ * @param corpus an open corpus reader (read into memory first, unless
+ * mapped).
+ * @param nthreads the number of threads (1 or 0 to train sequentially).
+ * @return 1 if the process has succeeded, 0 else (out of memory, or reading
+ * the corpus failed)
+ */
+int markov_chain_train_parallel (markov_chain *chain, corpus_reader *corpus,
+                                 size_t nthreads)
+{
+  if (chain == NULL || corpus == NULL)
+    return 0;
+  if (nthreads <= 1)
+    return markov_chain_train_corpus (chain, corpus, 0);
+  if (!corpus_load (corpus))
+    return 0;
+
+  train_part *parts = calloc (nthreads, sizeof (*parts));
+  if (parts == NULL)
+    return 0;
+  int success = train_parts (chain, corpus, parts, nthreads)
+                && merge_words (chain, parts, nthreads)
+                && merge_followers (chain, parts, nthreads);
+  for (size_t t = 0; t < nthreads; t++)
+    {
+      corpus_close (&parts[t].corpus);
+      markov_chain_free (&parts[t].local);
+      free (parts[t].to_global);
+      free (parts[t].to_global_context);
+    }
+  free (parts);
+  return success;
+}
+
+/**
+ * Orders alias columns by their follower id.
+ */
+static int alias_entry_cmp (const void *a, const void *b)
+{
+  uint32_t next_a = ((const markov_alias_entry *) a)->next;
+  uint32_t next_b = ((const markov_alias_entry *) b)->next;
+  return (next_a > next_b) - (next_a < next_b);
+}
+
+/**
+ * Builds the alias table of a state's followers (Vose's method): each
+ * column starts with a follower's probability scaled by the number of
+ * followers, and the columns below 1 are filled up by ones above it.
+ * The columns are sorted by follower id first, so the table depends only
+ * on the follower counts, not on the order of the followers map (which
+ * differs between a sequential and a parallel training).
+ * @return the alias table, NULL if failed (out of memory).
+ */
+static markov_alias *alias_build (const markov_state *state)
+{
+  size_t size = state->followers->size;
+  markov_alias *table = malloc (sizeof (*table)
+                                + size * sizeof (markov_alias_entry));
+  uint32_t *work = malloc (size * sizeof (*work));
+  if (table == NULL || work == NULL)
+    {
+      free (table);
+      free (work);
+      return NULL;
+    }
+
+  table->size = size;
+  size_t i = 0, pos = 0;
+  uint32_t *next, *count;
+  while (follower_map_next (state->followers, &pos, &next, &count))
+    {
+      markov_alias_entry *entry = &table->entries[i++];
+      entry->prob = (double) *count * (double) size / (double) state->total;
+      entry->next = entry->alias = *next;
+    }
+  qsort (table->entries, size, sizeof (markov_alias_entry), alias_entry_cmp);
+
+  // the small columns are stacked from the front of work, the large ones
+  // from its back
+  size_t small = 0, large = size;
+  for (i = 0; i < size; i++)
+    if (table->entries[i].prob < 1.0)
+      work[small++] = (uint32_t) i;
+    else
+      work[--large] = (uint32_t) i;
+  while (small > 0 && large < size)
+    {
+      markov_alias_entry *less = &table->entries[work[--small]];
+      uint32_t more_ind = work[large++];
+      markov_alias_entry *more = &table->entries[more_ind];
+      less->alias = more->next;
+      more->prob -= 1.0 - less->prob;
+      if (more->prob < 1.0)
+        work[small++] = more_ind;
+      else
+        work[--large] = more_ind;
+    }
+  // what is left is 1, up to rounding
+  while (small > 0)
+    table->entries[work[--small]].prob = 1.0;
+  while (large < size)
+    table->entries[work[large++]].prob = 1.0;
+  free (work);
+  return table;
+}
+
+/**
+ * Builds the alias tables of the dirty states (word or context ones).
+ * @param states the states.
+ * @param dirty the indices of the dirty states, emptied as they compile.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int compile_states (vector *states, vector *dirty)
+{
+  while (dirty->size > 0)
+    {
+      uint32_t index = *(uint32_t *) vector_at (dirty, dirty->size - 1);
+      markov_state *state = vector_at (states, index);
+      markov_alias *table = alias_build (state);
+      if (table == NULL)
+        return 0;
+      free (state->alias);
+      state->alias = table;
+      state->dirty = 0;
+      vector_erase (dirty, dirty->size - 1);
+    }
+  return 1;
+}
+
+/**
+ * Compiles the followers of the states trained on since the last compile
+ * into alias tables, for markov_chain_next to draw from in O(1). The other
+ * states keep their tables.
+ * @param chain a markov chain.
+ * @return 1 if the process has succeeded, 0 else (out of memory: the
+ * states not compiled keep drawing by walking their followers)
+ */
+int markov_chain_compile (markov_chain *chain)
+{
+  if (chain == NULL)
+    return 0;
+  return compile_states (chain->states, chain->dirty)
+         && compile_states (chain->contexts, chain->context_dirty);
+}
+
+/**
+ * @param chain a markov chain.
+ * @return the number of states (distinct words) of the chain.
+ */
+size_t markov_chain_size (const markov_chain *chain)
+{
+  return chain == NULL ? 0 : chain->states->size;
+}
+
+/**
+ * @param chain a markov chain.
+ * @param id a state id.
+ * @return the word of the given state (owned by the chain).
+ */
+const char *markov_chain_word (const markov_chain *chain, uint32_t id)
+{
+  return symtab_word (chain->words, id);
+}
+
+/**
+ * @return the bytes of the states of a states vector, and of their
+ * followers and alias tables.
+ */
+static size_t states_bytes (const vector *states)
+{
+  size_t bytes = sizeof (*states) + states->capacity * sizeof (markov_state);
+  for (size_t i = 0; i < states->size; i++)
+    {
+      const markov_state *state = vector_at (states, i);
+      if (state->followers != NULL)
+        bytes += sizeof (follower_map) + state->followers->capacity
+                 * (sizeof (int8_t) + sizeof (follower_map_slot));
+      if (state->alias != NULL)
+        bytes += sizeof (markov_alias)
+                 + state->alias->size * sizeof (markov_alias_entry);
+    }
+  return bytes;
+}
+
+/**
+ * @param chain a markov chain.
+ * @return the bytes of the chain's transition tables: its states, their
+ * followers, alias tables and contexts (the words excluded).
+ */
+size_t markov_chain_bytes (const markov_chain *chain)
+{
+  if (chain == NULL)
+    return 0;
+  return states_bytes (chain->states) + states_bytes (chain->contexts)
+         + sizeof (context_map) + chain->context_ids->capacity
+           * (sizeof (int8_t) + sizeof (context_map_slot));
+}
+
+/**
+ * @param chain a markov chain.
+ * @param id a state id.
+ * @return the state of the given id (a pointer into the chain, valid until
+ * the chain is trained on more words).
+ */
+const markov_state *markov_chain_state (const markov_chain *chain,
+                                        uint32_t id)
+{
+  return state_at (chain, id);
+}
+
+/**
+ * Draws the first word of a tweet: uniformly among the words which are not
+ * end words.
+ * @param chain a markov chain.
+ * @param rng the random generator to draw by.
+ * @return the state id of the word, UINT32_MAX if all words are end words.
+ */
+uint32_t markov_chain_first (const markov_chain *chain, markov_rng *rng)
+{
+  if (chain == NULL || rng == NULL || chain->starts == 0)
+    return MARKOV_NO_STATE;
+
+  for (;;)
+    {
+      uint32_t id = (uint32_t) markov_rng_below (rng, chain->states->size);
+      if (!state_at (chain, id)->is_end)
+        return id;
+    }
+}
+
+/**
+ * Draws a follower of a state, by its frequency: in O(1) from the alias
+ * table of a compiled state, by walking the followers of a dirty one.
+ * @return the state id of the follower, MARKOV_NO_STATE if it has none.
+ */
+static uint32_t state_draw (const markov_state *state, markov_rng *rng)
+{
+  if (state->total == 0)
+    return MARKOV_NO_STATE;
+
+  if (!state->dirty)
+    {
+      const markov_alias_entry *entry
+          = &state->alias->entries[markov_rng_below (rng, state->alias->size)];
+      double coin = markov_rng_unit (rng);
+      return coin < entry->prob ? entry->next : entry->alias;
+    }
+
+  uint64_t r = markov_rng_below (rng, state->total);
+  size_t pos = 0;
+  uint32_t *next, *count;
+  while (follower_map_next (state->followers, &pos, &next, &count))
+    {
+      if (r < *count)
+        return *next;
+      r -= *count;
+    }
+  return MARKOV_NO_STATE;
+}
+
+/**
+ * Draws the word following the given one, by the frequencies it followed
+ * it in the corpus: in O(1) from the alias table of a compiled state, by
+ * walking the followers of a dirty one.
+ * @param chain a markov chain.
+ * @param id the state id of the current word.
+ * @param rng the random generator to draw by.
+ * @return the state id of the next word, UINT32_MAX if the word has no
+ * followers (an end word, or the last word of the corpus).
+ */
+uint32_t markov_chain_next (const markov_chain *chain, uint32_t id,
+                            markov_rng *rng)
+{
+  return state_draw (state_at (chain, id), rng);
+}
+
+/**
+ * Draws the word following the window's words: by the longest context of
+ * up to order of them seen in the corpus, backing off to shorter ones (the
+ * last word alone at worst).
+ * @param window the latest words (at least one).
+ * @param filled the number of words of the window.
+ * @return the state id of the next word, MARKOV_NO_STATE if none.
+ */
+static uint32_t window_next (const markov_chain *chain, markov_key window,
+                             size_t filled, markov_rng *rng)
+{
+  for (size_t length = filled; length >= 2; length--)
+    {
+      const uint32_t *index = context_map_at (
+          chain->context_ids, markov_key_suffix (window, length));
+      if (index != NULL)
+        return state_draw (vector_at (chain->contexts, *index), rng);
+    }
+  return markov_chain_next (chain, markov_key_slot (window, 0) - 1, rng);
+}
+
+/**
+ * Draws the word following the given words (see markov_chain_next), by the
+ * longest context of up to order latest ones seen in the corpus.
+ * @param chain a markov chain.
+ * @param ids the state ids of the words so far, the latest one last.
+ * @param length the number of words (at least 1).
+ * @param rng the random generator to draw by.
+ * @return the state id of the next word, UINT32_MAX if none.
+ */
+uint32_t markov_chain_next_context (const markov_chain *chain,
+                                    const uint32_t *ids, size_t length,
+                                    markov_rng *rng)
+{
+  if (chain == NULL || ids == NULL || length == 0 || rng == NULL)
+    return MARKOV_NO_STATE;
+
+  size_t filled = length < chain->order ? length : chain->order;
+  markov_key window = {0, 0};
+  for (size_t i = length - filled; i < length; i++)
+    window = markov_key_push (window, ids[i]);
+  return window_next (chain, window, filled, rng);
+}
+
+/**
+ * @param chain a markov chain.
+ * @param ids the state ids of the context's words, the latest one last.
+ * @param length the number of words (2 to the chain's order).
+ * @return the state of the given context (valid until the chain is
+ * trained on more words), NULL if it never was followed by a word.
+ */
+const markov_state *markov_chain_context_state (const markov_chain *chain,
+                                                const uint32_t *ids,
+                                                size_t length)
+{
+  if (chain == NULL || ids == NULL || length < 2 || length > chain->order)
+    return NULL;
+
+  markov_key key = {0, 0};
+  for (size_t i = 0; i < length; i++)
+    key = markov_key_push (key, ids[i]);
+  const uint32_t *index = context_map_at (chain->context_ids, key);
+  return index == NULL ? NULL : vector_at (chain->contexts, *index);
+}
+
+/**
+ * Generates a tweet: a first word, then followers (drawn by the contexts of
+ * up to order words) until an end word, or until the tweet has max_length
+ * words.
+ * @param chain a trained markov chain.
+ * @param out_ids output: the state ids of the tweet's words (at least
+ * max_length of them).
+ * @param max_length the maximal number of words.
+ * @param rng the random generator to draw by.
+ * @return the number of words of the tweet.
+ */
+size_t markov_chain_generate (const markov_chain *chain, uint32_t *out_ids,
+                              size_t max_length, markov_rng *rng)
+{
+  if (chain == NULL || out_ids == NULL || max_length == 0 || rng == NULL)
+    return 0;
+
+  uint32_t id = markov_chain_first (chain, rng);
+  markov_key window = {0, 0};
+  size_t length = 0, filled = 0;
+  while (id != MARKOV_NO_STATE && length < max_length)
+    {
+      out_ids[length++] = id;
+      window = markov_key_suffix (markov_key_push (window, id), chain->order);
+      filled += filled < chain->order;
+      id = window_next (chain, window, filled, rng);
+    }
+  return length;
+}
+
+/**
+ * Prints a generated tweet, its words separated by spaces.
+ * @param chain a markov chain.
+ * @param ids the state ids of the tweet's words.
+ * @param length the number of words.
+ * @param out the stream to print to.
+ */
+void markov_chain_print (const markov_chain *chain, const uint32_t *ids,
+                         size_t length, FILE *out)
+{
+  for (size_t i = 0; i < length; i++)
+    {
+      if (i > 0)
+        fputc (' ', out);
+      fputs (symtab_word (chain->words, ids[i]), out);
+    }
+}
+
+/**
+ * @struct tweet_buffer - the formatted tweets of a block.
+ * @param data the chars.
+ * @param length the number of chars.
+ * @param capacity the size of data.
+ */
+typedef struct tweet_buffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+} tweet_buffer;
+
+/**
+ * @struct tweet_writer - the blocks of tweets to generate, and the order
+ * they are written in, shared by the generating threads (under lock).
+ * @param lock guards the writer.
+ * @param turn signaled when a block was written.
+ * @param out the stream the tweets are written to.
+ * @param blocks the number of blocks.
+ * @param next_claim the next block to generate.
+ * @param next_write the next block to write.
+ * @param failed 1 if a thread failed, the others stop.
+ */
+typedef struct tweet_writer {
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+    FILE *out;
+    size_t blocks;
+    size_t next_claim;
+    size_t next_write;
+    int failed;
+} tweet_writer;
+
+/**
+ * @struct tweet_job - a generating thread.
+ * @param model the model, read-only.
+ * @param writer the shared writer.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param words the number of words the thread generated.
+ */
+typedef struct tweet_job {
+    const markov_model *model;
+    tweet_writer *writer;
+    uint64_t seed;
+    size_t count;
+    size_t max_length;
+    size_t words;
+} tweet_job;
+
+/**
+ * Appends a tweet line to the buffer, growing it if needed.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int tweet_format (tweet_buffer *buffer, const markov_model *model,
+                         size_t number, const uint32_t *ids, size_t length)
+{
+  // the number's prefix takes at most 32 chars
+  size_t needed = 32;
+  for (size_t i = 0; i < length; i++)
+    needed += strlen (model->word (model->model, ids[i])) + 1;
+  if (buffer->length + needed > buffer->capacity)
+    {
+      size_t capacity = 2 * (buffer->length + needed);
+      char *grown = realloc (buffer->data, capacity);
+      if (grown == NULL)
+        return 0;
+      buffer->data = grown;
+      buffer->capacity = capacity;
+    }
+
+  char *end = buffer->data + buffer->length;
+  end += sprintf (end, "Tweet %zu:", number);
+  for (size_t i = 0; i < length; i++)
+    {
+      const char *word = model->word (model->model, ids[i]);
+      size_t word_length = strlen (word);
+      *end++ = ' ';
+      memcpy (end, word, word_length);
+      end += word_length;
+    }
+  *end++ = '\n';
+  buffer->length = (size_t) (end - buffer->data);
+  return 1;
+}
+
+static void *tweet_job_run (void *arg)
+{
+  tweet_job *job = arg;
+  tweet_writer *writer = job->writer;
+  uint32_t *ids = malloc (job->max_length * sizeof (*ids));
+  tweet_buffer buffer = {NULL, 0, 0};
+
+  pthread_mutex_lock (&writer->lock);
+  size_t block = writer->failed ? writer->blocks : writer->next_claim++;
+  pthread_mutex_unlock (&writer->lock);
+  while (block < writer->blocks)
+    {
+      // the block is generated out of lock, the model is only read
+      int success = ids != NULL;
+      size_t first = block * MARKOV_WRITE_BLOCK;
+      size_t end = first + MARKOV_WRITE_BLOCK < job->count
+                   ? first + MARKOV_WRITE_BLOCK : job->count;
+      buffer.length = 0;
+      for (size_t n = first; success && n < end; n++)
+        {
+          markov_rng rng;
+          markov_rng_seed (&rng, job->seed, n);
+          const markov_model *model = job->model;
+          size_t length = model->generate (model->model, ids,
+                                           job->max_length, &rng);
+          success = tweet_format (&buffer, model, n + 1, ids, length);
+          job->words += length;
+        }
+
+      // the blocks are claimed in order, so the one to write next is
+      // always being generated: the wait ends
+      pthread_mutex_lock (&writer->lock);
+      while (writer->next_write != block && !writer->failed)
+        pthread_cond_wait (&writer->turn, &writer->lock);
+      if (!writer->failed)
+        writer->failed = !success
+                         || (buffer.length > 0
+                             && fwrite (buffer.data, 1, buffer.length,
+                                        writer->out) != buffer.length);
+      writer->next_write++;
+      pthread_cond_broadcast (&writer->turn);
+      block = writer->failed ? writer->blocks : writer->next_claim++;
+      pthread_mutex_unlock (&writer->lock);
+    }
+
+  free (buffer.data);
+  free (ids);
+  return NULL;
+}
+
+static size_t chain_generate (const void *model, uint32_t *out_ids,
+                              size_t max_length, markov_rng *rng)
+{
+  return markov_chain_generate (model, out_ids, max_length, rng);
+}
+
+static const char *chain_word (const void *model, uint32_t id)
+{
+  return markov_chain_word (model, id);
+}
+
+/**
+ * Generates count tweets on nthreads threads, and writes them to out in
+ * order, as "Tweet <n>: <words>" lines. Tweet n draws by its own generator,
+ * seeded by (seed, n), so the tweets of a seed do not depend on the number
+ * of threads. The threads share the chain read-only (it must not be
+ * trained meanwhile), each formats blocks of MARKOV_WRITE_BLOCK tweets in a
+ * buffer of its own, and the blocks are written whole, in order.
+ * @param chain a trained (preferably compiled) markov chain.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_chain_write_tweets (const markov_chain *chain, uint64_t seed,
+                               size_t count, size_t max_length,
+                               size_t nthreads, FILE *out, size_t *words)
+{
+  if (chain == NULL)
+    return 0;
+  markov_model model = {chain, chain_generate, chain_word};
+  return markov_write_tweets (&model, seed, count, max_length, nthreads, out,
+                              words);
+}
+
+/**
+ * Generates count tweets from a model, see markov_chain_write_tweets.
+ * @param model a model.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_write_tweets (const markov_model *model, uint64_t seed,
+                         size_t count, size_t max_length, size_t nthreads,
+                         FILE *out, size_t *words)
+{
+  if (model == NULL || model->model == NULL || out == NULL
+      || max_length == 0)
+    return 0;
+  if (nthreads == 0)
+    nthreads = 1;
+
+  tweet_job *jobs = malloc (nthreads * sizeof (*jobs));
+  if (jobs == NULL)
+    return 0;
+  tweet_writer writer = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+                         out, (count + MARKOV_WRITE_BLOCK - 1)
+                              / MARKOV_WRITE_BLOCK, 0, 0, 0};
+  for (size_t t = 0; t < nthreads; t++)
+    jobs[t] = (tweet_job) {model, &writer, seed, count, max_length, 0};
+  run_parallel (tweet_job_run, jobs, sizeof (*jobs), nthreads);
+
+  if (words != NULL)
+    {
+      *words = 0;
+      for (size_t t = 0; t < nthreads; t++)
+        *words += jobs[t].words;
+    }
+  free (jobs);
+  pthread_mutex_destroy (&writer.lock);
+  pthread_cond_destroy (&writer.turn);
+  return !writer.failed;
+}
@@ -0,0 +1,437 @@
+#ifndef MARKOV_CHAIN_H_
+#define MARKOV_CHAIN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "hashmap.h"
+#include "hashmap_typed.h"
+#include "vector.h"
+#include "corpus.h"
+#include "symtab.h"
+#include "markov_rng.h"
+
+/**
+ * @def MARKOV_MAX_TWEET_LENGTH
+ * The default maximal number of words of a generated tweet.
+ */
+#define MARKOV_MAX_TWEET_LENGTH 20UL
+
+/**
+ * @def MARKOV_MAX_ORDER
+ * The most words a next word is drawn by (the size of a markov_key).
+ */
+#define MARKOV_MAX_ORDER 4U
+
+/**
+ * @def MARKOV_WRITE_BLOCK
+ * The number of tweets markov_chain_write_tweets formats and writes at
+ * once.
+ */
+#define MARKOV_WRITE_BLOCK 4096UL
+
+/**
+ * @def MARKOV_DELIMITERS
+ * The chars separating the words of the corpus.
+ */
+#define MARKOV_DELIMITERS " \t\r\n"
+
+static inline size_t markov_id_hash (uint32_t id)
+{
+  return (size_t) id;
+}
+
+static inline int markov_id_eq (uint32_t a, uint32_t b)
+{
+  return a == b;
+}
+
+/**
+ * @struct markov_key - a context: the ids of 2 to MARKOV_MAX_ORDER words
+ * packed into a fixed-width key, 32 bits a word (its id + 1, 0 for none),
+ * the latest word in the low bits of lo. Sliding the window of a key by
+ * one word is a shift, and hashing it one integer mix, whatever the words.
+ */
+typedef struct markov_key {
+    uint64_t lo;
+    uint64_t hi;
+} markov_key;
+
+static inline size_t markov_key_hash (markov_key key)
+{
+  // folded into one word, the map mixes it
+  return (size_t) (key.lo ^ (key.hi << 17 | key.hi >> 47));
+}
+
+static inline int markov_key_eq (markov_key a, markov_key b)
+{
+  return a.lo == b.lo && a.hi == b.hi;
+}
+
+/**
+ * @return the id + 1 in the given slot of the key (0 for no word), slot 0
+ * holding the latest word.
+ */
+static inline uint32_t markov_key_slot (markov_key key, unsigned slot)
+{
+  uint64_t half = slot < 2 ? key.lo : key.hi;
+  return (uint32_t) (half >> (32 * (slot & 1)));
+}
+
+/**
+ * Slides the window of a key by one word: O(1), whatever the words.
+ * @return the key of the given one's words, then the word of id.
+ */
+static inline markov_key markov_key_push (markov_key key, uint32_t id)
+{
+  return (markov_key) {key.lo << 32 | ((uint64_t) id + 1),
+                       key.hi << 32 | key.lo >> 32};
+}
+
+/**
+ * @return the key of the latest length words of the given key.
+ */
+static inline markov_key markov_key_suffix (markov_key key, size_t length)
+{
+  static const uint64_t masks[MARKOV_MAX_ORDER + 1][2] = {
+      {0, 0}, {UINT32_MAX, 0}, {UINT64_MAX, 0}, {UINT64_MAX, UINT32_MAX},
+      {UINT64_MAX, UINT64_MAX}};
+  return (markov_key) {key.lo & masks[length][0], key.hi & masks[length][1]};
+}
+
+/**
+ * @typedef follower_map
+ * Maps the state id of a follower word to the number of times it followed
+ * a word in the corpus.
+ */
+HASHMAP_DECLARE (follower_map, uint32_t, uint32_t, markov_id_hash,
+                 markov_id_eq)
+
+/**
+ * @typedef context_map
+ * Maps a context to the index of its state.
+ */
+HASHMAP_DECLARE (context_map, markov_key, uint32_t, markov_key_hash,
+                 markov_key_eq)
+
+/**
+ * @struct markov_alias_entry - a column of an alias table.
+ * @param prob the probability the column draws its own follower.
+ * @param next the column's own follower.
+ * @param alias the follower the column draws otherwise.
+ */
+typedef struct markov_alias_entry {
+    double prob;
+    uint32_t next;
+    uint32_t alias;
+} markov_alias_entry;
+
+/**
+ * @struct markov_alias - the followers of a state compiled into a
+ * Walker/Vose alias table: a follower is drawn, by its frequency, with
+ * one uniform column and one biased coin, whatever the number of them.
+ * @param size the number of columns (the number of followers).
+ * @param entries the columns.
+ */
+typedef struct markov_alias {
+    size_t size;
+    markov_alias_entry entries[];
+} markov_alias;
+
+/**
+ * @struct markov_state - a word (or a context of words) of the corpus, and
+ * the words following it.
+ * @param is_end 1 if the word ends a sentence (its last char is '.'), an
+ * end word has no followers.
+ * @param dirty 1 if the follower counts changed since the alias table was
+ * compiled (see markov_chain_compile).
+ * @param total the number of times any word followed this one.
+ * @param followers the follower counts, NULL while there are none.
+ * @param alias the compiled followers, NULL until compiled.
+ */
+typedef struct markov_state {
+    int is_end;
+    int dirty;
+    uint64_t total;
+    follower_map *followers;
+    markov_alias *alias;
+} markov_state;
+
+/**
+ * @struct markov_chain - a context -> next-word frequency model: the next
+ * word is drawn by the latest order words, backing off to fewer of them if
+ * they were never followed by a word.
+ * @param order the most words a next word is drawn by.
+ * @param words the interned words: a word's id is its state id, the words
+ * are looked up by their corpus views, and copied once, on their first
+ * occurrence.
+ * @param states the states, by value, indexed by their id.
+ * @param dirty the ids of the dirty states (a uint32_t each).
+ * @param context_ids the contexts of 2 to order words -> their indices.
+ * @param contexts the states of the contexts, by value, indexed by their
+ * indices.
+ * @param context_dirty the indices of the dirty contexts.
+ * @param starts the number of states which are not end words.
+ * @param tokens the number of tokens trained on.
+ */
+typedef struct markov_chain {
+    unsigned order;
+    symtab *words;
+    vector *states;
+    vector *dirty;
+    context_map *context_ids;
+    vector *contexts;
+    vector *context_dirty;
+    size_t starts;
+    uint64_t tokens;
+} markov_chain;
+
+/**
+ * @typedef markov_generate_func
+ * Generates a tweet from a model (see markov_chain_generate).
+ */
+typedef size_t (*markov_generate_func) (const void *model, uint32_t *out_ids,
+                                        size_t max_length, markov_rng *rng);
+
+/**
+ * @typedef markov_word_func
+ * @return the word of the given id in a model (owned by the model).
+ */
+typedef const char *(*markov_word_func) (const void *model, uint32_t id);
+
+/**
+ * @struct markov_model - a model tweets are generated from, read-only: a
+ * markov chain, or a frozen one (see markov_frozen.h).
+ * @param model the model.
+ * @param generate generates a tweet from the model.
+ * @param word the words of the model's ids.
+ */
+typedef struct markov_model {
+    const void *model;
+    markov_generate_func generate;
+    markov_word_func word;
+} markov_model;
+
+/**
+ * Allocates dynamically a new, empty, markov chain of the given order.
+ * @param order the number of words a next word is drawn by (1 to
+ * MARKOV_MAX_ORDER).
+ * @return pointer to dynamically allocated markov chain.
+ * @if_fail (out of memory, or an invalid order) return NULL.
+ */
+markov_chain *markov_chain_alloc_order (unsigned order);
+
+/**
+ * Allocates dynamically a new, empty, markov chain of order 1 (a next word
+ * is drawn by the current word alone).
+ * @return pointer to dynamically allocated markov chain.
+ * @if_fail return NULL.
+ */
+markov_chain *markov_chain_alloc (void);
+
+/**
+ * Frees a markov chain, its states and its words.
+ * @param p_chain pointer to dynamically allocated pointer to markov chain.
+ */
+void markov_chain_free (markov_chain **p_chain);
+
+/**
+ * Trains the chain on the tokens of one line (a tweet): each word is
+ * counted as a follower of the word before it, and of the contexts of the
+ * 2 to order words before it, unless these include an end word.
+ * @param chain a markov chain.
+ * @param tokens the token views of the line.
+ * @param n the number of tokens.
+ * @param words_left if not NULL, the number of words left to train on: it
+ * is decremented by the words read, and the line is cut when it reaches 0.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+int markov_chain_train_tokens (markov_chain *chain, const token_view *tokens,
+                               size_t n, size_t *words_left);
+
+/**
+ * Trains the chain on one line (a tweet), see markov_chain_train_tokens.
+ * @param chain a markov chain.
+ * @param line a NUL-terminated line, its words separated by
+ * MARKOV_DELIMITERS.
+ * @param words_left if not NULL, the number of words left to train on: it
+ * is decremented by the words read, and the line is cut when it reaches 0.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+int markov_chain_train_line (markov_chain *chain, const char *line,
+                             size_t *words_left);
+
+/**
+ * Trains the chain on a corpus, a tweet per line.
+ * @param chain a markov chain.
+ * @param corpus an open corpus reader.
+ * @param max_words the maximal number of words to train on (0 for all).
+ * @return 1 if the process has succeeded, 0 else (out of memory, or reading
+ * the corpus failed)
+ */
+int markov_chain_train_corpus (markov_chain *chain, corpus_reader *corpus,
+                               size_t max_words);
+
+/**
+ * Trains the chain on a corpus, a tweet per line, on nthreads threads: the
+ * corpus is split at line boundaries, a private chain is trained on each
+ * part, and the parts are merged into the chain in parallel, each thread
+ * owning a partition of the states. The words, ids and counts are the
+ * ones markov_chain_train_corpus gives (the followers of a state may be
+ * iterated in another order).
+ * @param chain a markov chain.
+ * @param corpus an open corpus reader (read into memory first, unless
+ * mapped).
+ * @param nthreads the number of threads (1 or 0 to train sequentially).
+ * @return 1 if the process has succeeded, 0 else (out of memory, or reading
+ * the corpus failed)
+ */
+int markov_chain_train_parallel (markov_chain *chain, corpus_reader *corpus,
+                                 size_t nthreads);
+
+/**
+ * Compiles the followers of the states trained on since the last compile
+ * into alias tables, for markov_chain_next to draw from in O(1). The other
+ * states keep their tables.
+ * @param chain a markov chain.
+ * @return 1 if the process has succeeded, 0 else (out of memory: the
+ * states not compiled keep drawing by walking their followers)
+ */
+int markov_chain_compile (markov_chain *chain);
+
+/**
+ * @param chain a markov chain.
+ * @return the number of states (distinct words) of the chain.
+ */
+size_t markov_chain_size (const markov_chain *chain);
+
+/**
+ * @param chain a markov chain.
+ * @param id a state id.
+ * @return the word of the given state (owned by the chain).
+ */
+const char *markov_chain_word (const markov_chain *chain, uint32_t id);
+
+/**
+ * @param chain a markov chain.
+ * @return the bytes of the chain's transition tables: its states, their
+ * followers, alias tables and contexts (the words excluded).
+ */
+size_t markov_chain_bytes (const markov_chain *chain);
+
+/**
+ * @param chain a markov chain.
+ * @param id a state id.
+ * @return the state of the given id (a pointer into the chain, valid until
+ * the chain is trained on more words).
+ */
+const markov_state *markov_chain_state (const markov_chain *chain,
+                                        uint32_t id);
+
+/**
+ * Draws the first word of a tweet: uniformly among the words which are not
+ * end words.
+ * @param chain a markov chain.
+ * @param rng the random generator to draw by.
+ * @return the state id of the word, UINT32_MAX if all words are end words.
+ */
+uint32_t markov_chain_first (const markov_chain *chain, markov_rng *rng);
+
+/**
+ * Draws the word following the given one, by the frequencies it followed
+ * it in the corpus: in O(1) from the alias table of a compiled state, by
+ * walking the followers of a dirty one.
+ * @param chain a markov chain.
+ * @param id the state id of the current word.
+ * @param rng the random generator to draw by.
+ * @return the state id of the next word, UINT32_MAX if the word has no
+ * followers (an end word, or the last word of the corpus).
+ */
+uint32_t markov_chain_next (const markov_chain *chain, uint32_t id,
+                            markov_rng *rng);
+
+/**
+ * Draws the word following the given words (see markov_chain_next), by the
+ * longest context of up to order latest ones seen in the corpus.
+ * @param chain a markov chain.
+ * @param ids the state ids of the words so far, the latest one last.
+ * @param length the number of words (at least 1).
+ * @param rng the random generator to draw by.
+ * @return the state id of the next word, UINT32_MAX if none.
+ */
+uint32_t markov_chain_next_context (const markov_chain *chain,
+                                    const uint32_t *ids, size_t length,
+                                    markov_rng *rng);
+
+/**
+ * @param chain a markov chain.
+ * @param ids the state ids of the context's words, the latest one last.
+ * @param length the number of words (2 to the chain's order).
+ * @return the state of the given context (valid until the chain is
+ * trained on more words), NULL if it never was followed by a word.
+ */
+const markov_state *markov_chain_context_state (const markov_chain *chain,
+                                                const uint32_t *ids,
+                                                size_t length);
+
+/**
+ * Generates a tweet: a first word, then followers (drawn by the contexts of
+ * up to order words) until an end word, or until the tweet has max_length
+ * words.
+ * @param chain a trained markov chain.
+ * @param out_ids output: the state ids of the tweet's words (at least
+ * max_length of them).
+ * @param max_length the maximal number of words.
+ * @param rng the random generator to draw by.
+ * @return the number of words of the tweet.
+ */
+size_t markov_chain_generate (const markov_chain *chain, uint32_t *out_ids,
+                              size_t max_length, markov_rng *rng);
+
+/**
+ * Generates count tweets on nthreads threads, and writes them to out in
+ * order, as "Tweet <n>: <words>" lines. Tweet n draws by its own generator,
+ * seeded by (seed, n), so the tweets of a seed do not depend on the number
+ * of threads. The threads share the chain read-only (it must not be
+ * trained meanwhile), each formats blocks of MARKOV_WRITE_BLOCK tweets in a
+ * buffer of its own, and the blocks are written whole, in order.
+ * @param chain a trained (preferably compiled) markov chain.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_chain_write_tweets (const markov_chain *chain, uint64_t seed,
+                               size_t count, size_t max_length,
+                               size_t nthreads, FILE *out, size_t *words);
+
+/**
+ * Generates count tweets from a model, see markov_chain_write_tweets.
+ * @param model a model.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_write_tweets (const markov_model *model, uint64_t seed,
+                         size_t count, size_t max_length, size_t nthreads,
+                         FILE *out, size_t *words);
+
+/**
+ * Prints a generated tweet, its words separated by spaces.
+ * @param chain a markov chain.
+ * @param ids the state ids of the tweet's words.
+ * @param length the number of words.
+ * @param out the stream to print to.
+ */
+void markov_chain_print (const markov_chain *chain, const uint32_t *ids,
+                         size_t length, FILE *out);
+
+#endif //MARKOV_CHAIN_H_
@@ -0,0 +1,506 @@
+#include <stdlib.h>
+#include <string.h>
+#include "markov_frozen.h"
+#include "hashmap_group.h"
+
+/**
+ * @def FROZEN_NO_ID
+ * The id of no word (no follower, no context).
+ */
+#define FROZEN_NO_ID SYMTAB_NO_ID
+
+/**
+ * @return the number of bits of value (0 for 0).
+ */
+static inline unsigned bit_width (uint64_t value)
+{
+  return value == 0 ? 0 : 64 - (unsigned) __builtin_clzll (value);
+}
+
+/**
+ * Reads the width (up to 64) bits at bit offset pos of words.
+ */
+static inline uint64_t bits_read (const uint64_t *words, uint64_t pos,
+                                  unsigned width)
+{
+  uint64_t word = pos >> 6;
+  unsigned shift = (unsigned) (pos & 63);
+  uint64_t value = words[word] >> shift;
+  if (shift + width > 64)
+    value |= words[word + 1] << (64 - shift);
+  return width == 64 ? value : value & ((1ULL << width) - 1);
+}
+
+/**
+ * Writes value as the width (up to 64) bits at bit offset pos of words,
+ * which are still 0.
+ */
+static inline void bits_write (uint64_t *words, uint64_t pos, unsigned width,
+                               uint64_t value)
+{
+  uint64_t word = pos >> 6;
+  unsigned shift = (unsigned) (pos & 63);
+  words[word] |= value << shift;
+  if (shift + width > 64)
+    words[word + 1] |= value >> (64 - shift);
+}
+
+/**
+ * @return the number of words of the followers of a frozen chain, one of
+ * padding included (a read may touch the word after its bits).
+ */
+static size_t followers_words (const markov_frozen *frozen)
+{
+  return frozen->rows[frozen->size + frozen->contexts] / 64 + 2;
+}
+
+/**
+ * @return the state of a row of the chain: a word's, then a context's.
+ */
+static const markov_state *row_state (const markov_chain *chain, size_t row)
+{
+  size_t size = chain->states->size;
+  return row < size ? vector_at (chain->states, row)
+                    : vector_at (chain->contexts, row - size);
+}
+
+/**
+ * Compares followers by id, for qsort.
+ */
+static int follower_cmp (const void *a, const void *b)
+{
+  uint32_t id_a = ((const follower_map_slot *) a)->key;
+  uint32_t id_b = ((const follower_map_slot *) b)->key;
+  return (id_a > id_b) - (id_a < id_b);
+}
+
+/**
+ * Lays the rows of the chain's states out: their bit offsets and widths
+ * first, then their followers, sorted by id, bit-packed.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int frozen_rows (markov_frozen *frozen, const markov_chain *chain)
+{
+  size_t nrows = (size_t) frozen->size + frozen->contexts;
+  frozen->rows = malloc ((nrows + 1) * sizeof (*frozen->rows));
+  frozen->count_bits = malloc (nrows + 1);
+  frozen->ends = calloc (frozen->size / 64 + 1, sizeof (*frozen->ends));
+  if (frozen->rows == NULL || frozen->count_bits == NULL
+      || frozen->ends == NULL)
+    return 0;
+
+  // a row's cumulative counts take the bits of its total
+  size_t most = 0;
+  frozen->rows[0] = 0;
+  for (size_t row = 0; row < nrows; row++)
+    {
+      const markov_state *state = row_state (chain, row);
+      size_t n = state->followers == NULL ? 0 : state->followers->size;
+      unsigned count_bits = n == 0 ? 0 : bit_width (state->total);
+      frozen->count_bits[row] = (uint8_t) count_bits;
+      frozen->rows[row + 1] = frozen->rows[row]
+                              + n * (frozen->id_bits + count_bits);
+      frozen->transitions += n;
+      most = n > most ? n : most;
+    }
+
+  frozen->followers = calloc (followers_words (frozen),
+                              sizeof (*frozen->followers));
+  follower_map_slot *sorted = malloc ((most + 1) * sizeof (*sorted));
+  if (frozen->followers == NULL || sorted == NULL)
+    {
+      free (sorted);
+      return 0;
+    }
+  for (size_t row = 0; row < nrows; row++)
+    {
+      const markov_state *state = row_state (chain, row);
+      if (row < frozen->size && state->is_end)
+        frozen->ends[row / 64] |= 1ULL << (row % 64);
+      if (state->followers == NULL)
+        continue;
+
+      size_t n = 0, pos = 0;
+      uint32_t *next, *count;
+      while (follower_map_next (state->followers, &pos, &next, &count))
+        sorted[n++] = (follower_map_slot) {*next, *count};
+      qsort (sorted, n, sizeof (*sorted), follower_cmp);
+
+      unsigned count_bits = frozen->count_bits[row];
+      uint64_t bit = frozen->rows[row], cumulative = 0;
+      for (size_t i = 0; i < n; i++)
+        {
+          cumulative += sorted[i].value;
+          bits_write (frozen->followers, bit, frozen->id_bits, sorted[i].key);
+          bit += frozen->id_bits;
+          bits_write (frozen->followers, bit, count_bits, cumulative);
+          bit += count_bits;
+        }
+    }
+  free (sorted);
+  return 1;
+}
+
+/**
+ * @return the number of words of the keys of a frozen chain, one of padding
+ * included.
+ */
+static size_t keys_words (const markov_frozen *frozen)
+{
+  return (size_t) frozen->contexts * frozen->order * frozen->key_bits / 64
+         + 2;
+}
+
+/**
+ * @return 1 if the key of the given context is key, 0 otherwise.
+ */
+static inline int key_eq (const markov_frozen *frozen, uint32_t context,
+                          markov_key key)
+{
+  uint64_t bit = (uint64_t) context * frozen->order * frozen->key_bits;
+  for (unsigned slot = 0; slot < frozen->order; slot++)
+    if (bits_read (frozen->keys, bit + slot * frozen->key_bits,
+                   frozen->key_bits) != markov_key_slot (key, slot))
+      return 0;
+  return 1;
+}
+
+/**
+ * @return the first index slot of a key.
+ */
+static inline size_t index_slot (const markov_frozen *frozen, markov_key key)
+{
+  return (size_t) mix_hash (markov_key_hash (key)) & frozen->index_mask;
+}
+
+/**
+ * Packs the chain's context keys, and indexes them (at most half of the
+ * index slots are full).
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int frozen_contexts (markov_frozen *frozen, const markov_chain *chain)
+{
+  size_t capacity = 2;
+  while (capacity < 2 * (size_t) frozen->contexts)
+    capacity *= 2;
+  frozen->keys = calloc (keys_words (frozen), sizeof (*frozen->keys));
+  frozen->index = malloc (capacity * sizeof (*frozen->index));
+  if (frozen->keys == NULL || frozen->index == NULL)
+    return 0;
+  memset (frozen->index, 0xFF, capacity * sizeof (*frozen->index));
+  frozen->index_mask = capacity - 1;
+
+  size_t pos = 0;
+  markov_key *key;
+  uint32_t *context;
+  while (context_map_next (chain->context_ids, &pos, &key, &context))
+    {
+      uint64_t bit = (uint64_t) *context * frozen->order * frozen->key_bits;
+      for (unsigned slot = 0; slot < frozen->order; slot++)
+        bits_write (frozen->keys, bit + slot * frozen->key_bits,
+                    frozen->key_bits, markov_key_slot (*key, slot));
+      size_t slot = index_slot (frozen, *key);
+      while (frozen->index[slot] != FROZEN_NO_ID)
+        slot = (slot + 1) & frozen->index_mask;
+      frozen->index[slot] = *context;
+    }
+  return 1;
+}
+
+/**
+ * Copies the chain's words, one after the other.
+ * @return 1 if the process has succeeded, 0 else (out of memory)
+ */
+static int frozen_words (markov_frozen *frozen, const markov_chain *chain)
+{
+  size_t length = 0;
+  for (uint32_t id = 0; id < frozen->size; id++)
+    length += strlen (markov_chain_word (chain, id)) + 1;
+  frozen->text = malloc (length + 1);
+  frozen->offsets = malloc (((size_t) frozen->size + 1)
+                            * sizeof (*frozen->offsets));
+  if (frozen->text == NULL || frozen->offsets == NULL)
+    return 0;
+
+  length = 0;
+  for (uint32_t id = 0; id < frozen->size; id++)
+    {
+      const char *word = markov_chain_word (chain, id);
+      size_t word_length = strlen (word) + 1;
+      memcpy (frozen->text + length, word, word_length);
+      frozen->offsets[id] = length;
+      length += word_length;
+    }
+  return 1;
+}
+
+/**
+ * Freezes a trained markov chain: its followers and contexts are copied
+ * into a new frozen chain (the chain needs not be compiled, and can be
+ * freed afterwards).
+ * @param chain a trained markov chain.
+ * @return pointer to dynamically allocated frozen chain.
+ * @if_fail (out of memory) return NULL.
+ */
+markov_frozen *markov_chain_freeze (const markov_chain *chain)
+{
+  if (chain == NULL)
+    return NULL;
+  markov_frozen *frozen = calloc (1, sizeof (*frozen));
+  if (frozen == NULL)
+    return NULL;
+
+  frozen->order = chain->order;
+  frozen->size = (uint32_t) chain->states->size;
+  frozen->starts = chain->starts;
+  frozen->contexts = (uint32_t) chain->contexts->size;
+  frozen->id_bits = frozen->size > 1 ? bit_width (frozen->size - 1) : 1;
+  frozen->key_bits = frozen->size > 0 ? bit_width (frozen->size) : 1;
+  if (!frozen_rows (frozen, chain) || !frozen_contexts (frozen, chain)
+      || !frozen_words (frozen, chain))
+    markov_frozen_free (&frozen);
+  return frozen;
+}
+
+/**
+ * Frees a frozen chain.
+ * @param p_frozen pointer to dynamically allocated pointer to frozen chain.
+ */
+void markov_frozen_free (markov_frozen **p_frozen)
+{
+  if (p_frozen == NULL || *p_frozen == NULL)
+    return;
+  markov_frozen *frozen = *p_frozen;
+  free (frozen->rows);
+  free (frozen->count_bits);
+  free (frozen->followers);
+  free (frozen->ends);
+  free (frozen->keys);
+  free (frozen->index);
+  free (frozen->text);
+  free (frozen->offsets);
+  free (frozen);
+  *p_frozen = NULL;
+}
+
+/**
+ * @param frozen a frozen chain.
+ * @return the number of words of the frozen chain.
+ */
+size_t markov_frozen_size (const markov_frozen *frozen)
+{
+  return frozen == NULL ? 0 : frozen->size;
+}
+
+/**
+ * @param frozen a frozen chain.
+ * @param id a word id.
+ * @return the word of the given id (owned by the frozen chain).
+ */
+const char *markov_frozen_word (const markov_frozen *frozen, uint32_t id)
+{
+  return frozen->text + frozen->offsets[id];
+}
+
+/**
+ * @param frozen a frozen chain.
+ * @return the bytes of the frozen chain's transition tables: its rows,
+ * followers and contexts (the words excluded, see markov_chain_bytes).
+ */
+size_t markov_frozen_bytes (const markov_frozen *frozen)
+{
+  if (frozen == NULL)
+    return 0;
+  size_t nrows = (size_t) frozen->size + frozen->contexts;
+  return sizeof (*frozen) + (nrows + 1) * (sizeof (*frozen->rows) + 1)
+         + followers_words (frozen) * sizeof (*frozen->followers)
+         + (frozen->size / 64 + 1) * sizeof (*frozen->ends)
+         + keys_words (frozen) * sizeof (*frozen->keys)
+         + (frozen->index_mask + 1) * sizeof (*frozen->index);
+}
+
+/**
+ * Draws a follower of a row by its frequency: the first one whose
+ * cumulative count exceeds a number drawn below the row's total.
+ * @return the id of the follower, FROZEN_NO_ID if the row has none.
+ */
+static uint32_t row_draw (const markov_frozen *frozen, size_t row,
+                          markov_rng *rng)
+{
+  uint64_t start = frozen->rows[row], end = frozen->rows[row + 1];
+  if (start == end)
+    return FROZEN_NO_ID;
+
+  const uint64_t *followers = frozen->followers;
+  unsigned id_bits = frozen->id_bits, count_bits = frozen->count_bits[row];
+  uint64_t width = id_bits + count_bits;
+  uint64_t total = bits_read (followers, end - count_bits, count_bits);
+  uint64_t r = markov_rng_below (rng, total);
+  uint64_t low = 0, high = (end - start) / width - 1;
+  while (low < high)
+    {
+      uint64_t mid = low + (high - low) / 2;
+      if (bits_read (followers, start + mid * width + id_bits, count_bits) > r)
+        high = mid;
+      else
+        low = mid + 1;
+    }
+  return (uint32_t) bits_read (followers, start + low * width, id_bits);
+}
+
+/**
+ * @return the index of the context of the given key, FROZEN_NO_ID if it
+ * was never followed by a word.
+ */
+static uint32_t frozen_context (const markov_frozen *frozen, markov_key key)
+{
+  for (size_t slot = index_slot (frozen, key);;
+       slot = (slot + 1) & frozen->index_mask)
+    {
+      uint32_t context = frozen->index[slot];
+      if (context == FROZEN_NO_ID || key_eq (frozen, context, key))
+        return context;
+    }
+}
+
+/**
+ * Draws the first word of a tweet: uniformly among the words which are not
+ * end words.
+ * @param frozen a frozen chain.
+ * @param rng the random generator to draw by.
+ * @return the id of the word, UINT32_MAX if all words are end words.
+ */
+uint32_t markov_frozen_first (const markov_frozen *frozen, markov_rng *rng)
+{
+  if (frozen == NULL || rng == NULL || frozen->starts == 0)
+    return FROZEN_NO_ID;
+
+  for (;;)
+    {
+      uint32_t id = (uint32_t) markov_rng_below (rng, frozen->size);
+      if (!(frozen->ends[id / 64] >> (id % 64) & 1))
+        return id;
+    }
+}
+
+/**
+ * Draws the word following the given one, by the frequencies it followed
+ * it in the corpus, in O(log followers).
+ * @param frozen a frozen chain.
+ * @param id the id of the current word.
+ * @param rng the random generator to draw by.
+ * @return the id of the next word, UINT32_MAX if the word has no followers.
+ */
+uint32_t markov_frozen_next (const markov_frozen *frozen, uint32_t id,
+                             markov_rng *rng)
+{
+  return row_draw (frozen, id, rng);
+}
+
+/**
+ * Draws the word following the window's words: by the longest context of
+ * up to order of them, backing off to shorter ones (the last word alone at
+ * worst).
+ * @param window the latest words (at least one).
+ * @param filled the number of words of the window.
+ * @return the id of the next word, FROZEN_NO_ID if none.
+ */
+static uint32_t window_next (const markov_frozen *frozen, markov_key window,
+                             size_t filled, markov_rng *rng)
+{
+  for (size_t length = filled; length >= 2; length--)
+    {
+      uint32_t context = frozen_context (frozen,
+                                         markov_key_suffix (window, length));
+      if (context != FROZEN_NO_ID)
+        return row_draw (frozen, (size_t) frozen->size + context, rng);
+    }
+  return row_draw (frozen, markov_key_slot (window, 0) - 1, rng);
+}
+
+/**
+ * Draws the word following the given words, by the longest context of up to
+ * order latest ones seen in the corpus (see markov_chain_next_context).
+ * @param frozen a frozen chain.
+ * @param ids the ids of the words so far, the latest one last.
+ * @param length the number of words (at least 1).
+ * @param rng the random generator to draw by.
+ * @return the id of the next word, UINT32_MAX if none.
+ */
+uint32_t markov_frozen_next_context (const markov_frozen *frozen,
+                                     const uint32_t *ids, size_t length,
+                                     markov_rng *rng)
+{
+  if (frozen == NULL || ids == NULL || length == 0 || rng == NULL)
+    return FROZEN_NO_ID;
+
+  size_t filled = length < frozen->order ? length : frozen->order;
+  markov_key window = {0, 0};
+  for (size_t i = length - filled; i < length; i++)
+    window = markov_key_push (window, ids[i]);
+  return window_next (frozen, window, filled, rng);
+}
+
+/**
+ * Generates a tweet, see markov_chain_generate.
+ * @param frozen a frozen chain.
+ * @param out_ids output: the ids of the tweet's words (at least max_length
+ * of them).
+ * @param max_length the maximal number of words.
+ * @param rng the random generator to draw by.
+ * @return the number of words of the tweet.
+ */
+size_t markov_frozen_generate (const markov_frozen *frozen, uint32_t *out_ids,
+                               size_t max_length, markov_rng *rng)
+{
+  if (frozen == NULL || out_ids == NULL || max_length == 0 || rng == NULL)
+    return 0;
+
+  uint32_t id = markov_frozen_first (frozen, rng);
+  markov_key window = {0, 0};
+  size_t length = 0, filled = 0;
+  while (id != FROZEN_NO_ID && length < max_length)
+    {
+      out_ids[length++] = id;
+      window = markov_key_suffix (markov_key_push (window, id),
+                                  frozen->order);
+      filled += filled < frozen->order;
+      id = window_next (frozen, window, filled, rng);
+    }
+  return length;
+}
+
+static size_t frozen_generate (const void *model, uint32_t *out_ids,
+                               size_t max_length, markov_rng *rng)
+{
+  return markov_frozen_generate (model, out_ids, max_length, rng);
+}
+
+static const char *frozen_word (const void *model, uint32_t id)
+{
+  return markov_frozen_word (model, id);
+}
+
+/**
+ * Generates count tweets on nthreads threads, and writes them to out, see
+ * markov_chain_write_tweets.
+ * @param frozen a frozen chain.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_frozen_write_tweets (const markov_frozen *frozen, uint64_t seed,
+                                size_t count, size_t max_length,
+                                size_t nthreads, FILE *out, size_t *words)
+{
+  if (frozen == NULL)
+    return 0;
+  markov_model model = {frozen, frozen_generate, frozen_word};
+  return markov_write_tweets (&model, seed, count, max_length, nthreads, out,
+                              words);
+}
@@ -0,0 +1,153 @@
+#ifndef MARKOV_FROZEN_H_
+#define MARKOV_FROZEN_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "markov_chain.h"
+
+/**
+ * @struct markov_frozen - a trained markov chain frozen into a compressed
+ * sparse row (CSR) layout, read-only. A row per word, then a row per
+ * context, holds the row's followers sorted by id, each as its id and its
+ * cumulative count (its count plus those of the followers before it),
+ * bit-packed to the fewest bits: a follower is drawn by a binary search of
+ * the cumulative counts, with no pointer chased.
+ * @param order the number of words a next word is drawn by.
+ * @param size the number of words.
+ * @param starts the number of words which are not end words.
+ * @param contexts the number of contexts.
+ * @param transitions the number of followers of all rows.
+ * @param id_bits the bits of a follower id.
+ * @param rows the bit offset in followers of each row, and the end of the
+ * last one (size + contexts + 1 of them).
+ * @param count_bits the bits of the cumulative counts of each row.
+ * @param followers the bit-packed followers: their id, then their
+ * cumulative count.
+ * @param ends a bit per word, set for end words.
+ * @param key_bits the bits of a word of a context key (an id + 1).
+ * @param keys the bit-packed key of each context (its row is size + its
+ * index): order words of key_bits bits, the latest one first, 0 for none.
+ * @param index the contexts by key, probed linearly: the index of a context
+ * in keys, UINT32_MAX for an empty slot.
+ * @param index_mask the number of slots of index (a power of 2) - 1.
+ * @param text the words, NUL-terminated, one after the other.
+ * @param offsets the offset of each word in text.
+ */
+typedef struct markov_frozen {
+    unsigned order;
+    uint32_t size;
+    size_t starts;
+    uint32_t contexts;
+    uint64_t transitions;
+    unsigned id_bits;
+    uint64_t *rows;
+    uint8_t *count_bits;
+    uint64_t *followers;
+    uint64_t *ends;
+    unsigned key_bits;
+    uint64_t *keys;
+    uint32_t *index;
+    size_t index_mask;
+    char *text;
+    size_t *offsets;
+} markov_frozen;
+
+/**
+ * Freezes a trained markov chain: its followers and contexts are copied
+ * into a new frozen chain (the chain needs not be compiled, and can be
+ * freed afterwards).
+ * @param chain a trained markov chain.
+ * @return pointer to dynamically allocated frozen chain.
+ * @if_fail (out of memory) return NULL.
+ */
+markov_frozen *markov_chain_freeze (const markov_chain *chain);
+
+/**
+ * Frees a frozen chain.
+ * @param p_frozen pointer to dynamically allocated pointer to frozen chain.
+ */
+void markov_frozen_free (markov_frozen **p_frozen);
+
+/**
+ * @param frozen a frozen chain.
+ * @return the number of words of the frozen chain.
+ */
+size_t markov_frozen_size (const markov_frozen *frozen);
+
+/**
+ * @param frozen a frozen chain.
+ * @param id a word id.
+ * @return the word of the given id (owned by the frozen chain).
+ */
+const char *markov_frozen_word (const markov_frozen *frozen, uint32_t id);
+
+/**
+ * @param frozen a frozen chain.
+ * @return the bytes of the frozen chain's transition tables: its rows,
+ * followers and contexts (the words excluded, see markov_chain_bytes).
+ */
+size_t markov_frozen_bytes (const markov_frozen *frozen);
+
+/**
+ * Draws the first word of a tweet: uniformly among the words which are not
+ * end words.
+ * @param frozen a frozen chain.
+ * @param rng the random generator to draw by.
+ * @return the id of the word, UINT32_MAX if all words are end words.
+ */
+uint32_t markov_frozen_first (const markov_frozen *frozen, markov_rng *rng);
+
+/**
+ * Draws the word following the given one, by the frequencies it followed
+ * it in the corpus, in O(log followers).
+ * @param frozen a frozen chain.
+ * @param id the id of the current word.
+ * @param rng the random generator to draw by.
+ * @return the id of the next word, UINT32_MAX if the word has no followers.
+ */
+uint32_t markov_frozen_next (const markov_frozen *frozen, uint32_t id,
+                             markov_rng *rng);
+
+/**
+ * Draws the word following the given words, by the longest context of up to
+ * order latest ones seen in the corpus (see markov_chain_next_context).
+ * @param frozen a frozen chain.
+ * @param ids the ids of the words so far, the latest one last.
+ * @param length the number of words (at least 1).
+ * @param rng the random generator to draw by.
+ * @return the id of the next word, UINT32_MAX if none.
+ */
+uint32_t markov_frozen_next_context (const markov_frozen *frozen,
+                                     const uint32_t *ids, size_t length,
+                                     markov_rng *rng);
+
+/**
+ * Generates a tweet, see markov_chain_generate.
+ * @param frozen a frozen chain.
+ * @param out_ids output: the ids of the tweet's words (at least max_length
+ * of them).
+ * @param max_length the maximal number of words.
+ * @param rng the random generator to draw by.
+ * @return the number of words of the tweet.
+ */
+size_t markov_frozen_generate (const markov_frozen *frozen, uint32_t *out_ids,
+                               size_t max_length, markov_rng *rng);
+
+/**
+ * Generates count tweets on nthreads threads, and writes them to out, see
+ * markov_chain_write_tweets.
+ * @param frozen a frozen chain.
+ * @param seed the seed of the tweets.
+ * @param count the number of tweets.
+ * @param max_length the maximal number of words of a tweet.
+ * @param nthreads the number of threads (0 is taken as 1).
+ * @param out the stream to write the tweets to.
+ * @param words output (if not NULL): the number of words written.
+ * @return 1 if the process has succeeded, 0 else (out of memory, or
+ * writing failed)
+ */
+int markov_frozen_write_tweets (const markov_frozen *frozen, uint64_t seed,
+                                size_t count, size_t max_length,
+                                size_t nthreads, FILE *out, size_t *words);
+
+#endif //MARKOV_FROZEN_H_
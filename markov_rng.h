@@ -0,0 +1,83 @@
+#ifndef MARKOV_RNG_H_
+#define MARKOV_RNG_H_
+
+#include <stdint.h>
+
+/**
+ * @struct markov_rng - a xoshiro256** random generator: a few shifts and
+ * rotations a number, and a state of its own for each user (no shared
+ * state, unlike rand).
+ * @param s the state, never all zero.
+ */
+typedef struct markov_rng {
+    uint64_t s[4];
+} markov_rng;
+
+/**
+ * splitmix64: the next number of the sequence of *x.
+ */
+static inline uint64_t markov_splitmix (uint64_t *x)
+{
+  uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Seeds a generator by a seed and a stream number: the generators of the
+ * same seed and stream draw the same numbers, the ones of other streams
+ * (e.g. one per generated tweet) draw independent ones.
+ * @param rng the generator.
+ * @param seed the seed.
+ * @param stream the stream number.
+ */
+static inline void markov_rng_seed (markov_rng *rng, uint64_t seed,
+                                    uint64_t stream)
+{
+  // each stream takes its own 4 numbers of the splitmix sequence of seed
+  uint64_t x = seed + stream * 4 * 0x9E3779B97F4A7C15ULL;
+  for (int i = 0; i < 4; i++)
+    rng->s[i] = markov_splitmix (&x);
+}
+
+static inline uint64_t markov_rng_rotl (uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+/**
+ * @return the next 64 random bits of the generator.
+ */
+static inline uint64_t markov_rng_next (markov_rng *rng)
+{
+  uint64_t *s = rng->s;
+  uint64_t result = markov_rng_rotl (s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = markov_rng_rotl (s[3], 45);
+  return result;
+}
+
+/**
+ * @return a random number in [0, bound), by a multiply (bound > 0).
+ */
+static inline uint64_t markov_rng_below (markov_rng *rng, uint64_t bound)
+{
+  return (uint64_t) (((unsigned __int128) markov_rng_next (rng) * bound)
+                     >> 64);
+}
+
+/**
+ * @return a random double in [0, 1).
+ */
+static inline double markov_rng_unit (markov_rng *rng)
+{
+  return (double) (markov_rng_next (rng) >> 11) * 0x1.0p-53;
+}
+
+#endif //MARKOV_RNG_H_
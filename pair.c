@@ -1,28 +1,236 @@
+#include <stddef.h>
+#include <string.h>
 #include "pair.h"
 
+/**
+ * @def PAIR_INLINE_ALIGN
+ * The largest alignment of an inline value inside the pair's storage: the
+ * storage itself starts at this alignment (malloc and the arena align to
+ * it), so a value aligned within the storage is aligned in memory.
+ */
+#define PAIR_INLINE_ALIGN _Alignof (max_align_t)
+
+_Static_assert (offsetof (pair, storage) % PAIR_INLINE_ALIGN == 0,
+                "the pair's storage must start aligned");
+
+/**
+ * @enum elem_place
+ * Where a key / value of a pair is stored.
+ * ELEM_INLINE - inside the pair's storage.
+ * ELEM_ARENA - in its own arena block, copied bytewise.
+ * ELEM_HEAP - copied (and freed) by the type's functions.
+ */
+typedef enum elem_place {
+    ELEM_INLINE,
+    ELEM_ARENA,
+    ELEM_HEAP
+} elem_place;
+
+/**
+ * @struct pair_layout - the storage layout of one pair.
+ * @param key_bytes, value_bytes - the byte size of the key / value, 0 if
+ * unknown.
+ * @param key_place, value_place - where the key / value are stored.
+ * @param value_offset - the offset of an inline value in the storage.
+ * @param size - the byte size of the pair's allocation.
+ */
+typedef struct pair_layout {
+    size_t key_bytes;
+    size_t value_bytes;
+    elem_place key_place;
+    elem_place value_place;
+    size_t value_offset;
+    size_t size;
+} pair_layout;
+
+/**
+ * @return where an element of the given byte size (0 if unknown) is stored.
+ */
+static elem_place place_of (size_t bytes, const arena *arena)
+{
+  if (bytes > 0 && bytes <= PAIR_INLINE_MAX)
+    {
+      return ELEM_INLINE;
+    }
+  return (bytes > 0 && arena) ? ELEM_ARENA : ELEM_HEAP;
+}
+
+/**
+ * @return the alignment of an inline value of the given byte size: its
+ * natural one (the largest power of two dividing the size, as an object's
+ * alignment always divides its size), capped at PAIR_INLINE_ALIGN.
+ */
+static size_t inline_align_of (size_t bytes)
+{
+  size_t align = bytes & (~bytes + 1);
+  return align < PAIR_INLINE_ALIGN ? align : PAIR_INLINE_ALIGN;
+}
+
+/**
+ * Computes the storage layout of a pair of the given key and value.
+ */
+static pair_layout layout_of (const_keyT key, const_valueT value,
+                              const pair_type *type, const arena *arena)
+{
+  pair_layout layout;
+  layout.key_bytes = type->key_size;
+  if (!layout.key_bytes && type->key_len)
+    {
+      layout.key_bytes = type->key_len (key);
+    }
+  layout.value_bytes = type->value_size;
+  if (!layout.value_bytes && type->value_len)
+    {
+      layout.value_bytes = type->value_len (value);
+    }
+  layout.key_place = place_of (layout.key_bytes, arena);
+  layout.value_place = place_of (layout.value_bytes, arena);
+
+  layout.value_offset = 0;
+  if (layout.key_place == ELEM_INLINE)
+    {
+      layout.value_offset = layout.key_bytes;
+      if (layout.value_place == ELEM_INLINE)
+        {
+          size_t align = inline_align_of (layout.value_bytes);
+          layout.value_offset = (layout.key_bytes + align - 1)
+                                & ~(align - 1);
+        }
+    }
+  layout.size = sizeof (pair) + layout.value_offset;
+  if (layout.value_place == ELEM_INLINE)
+    {
+      layout.size += layout.value_bytes;
+    }
+  return layout;
+}
+
+/**
+ * Frees a pair of the given layout, and its (non-NULL) key and value.
+ */
+static void pair_release (arena *arena, pair *p, const pair_layout *layout)
+{
+  // inline elements live in the pair's own allocation
+  if (p->key && layout->key_place == ELEM_ARENA)
+    {
+      arena_release (arena, p->key, layout->key_bytes);
+    }
+  else if (p->key && layout->key_place == ELEM_HEAP)
+    {
+      p->type->key_free (&p->key);
+      if (arena)
+        {
+          arena->heap_elements--;
+        }
+    }
+
+  if (p->value && layout->value_place == ELEM_ARENA)
+    {
+      arena_release (arena, p->value, layout->value_bytes);
+    }
+  else if (p->value && layout->value_place == ELEM_HEAP)
+    {
+      p->type->value_free (&p->value);
+      if (arena)
+        {
+          arena->heap_elements--;
+        }
+    }
+
+  if (arena)
+    {
+      arena_release (arena, p, layout->size);
+    }
+  else
+    {
+      free (p);
+    }
+}
+
 /**
  * Allocates dynamically a new pair.
  * @param key, value - the key and value.
- * @param key_cpy, value_cpy - copy functions for key and value.
- * @param key_cmp, value_cmp - compare functions for key and value.
- * @param key_free, value_free - free functions for key and value.
- * @return dynamically allocated pair.
+ * @param type - the descriptor of the key and value.
+ * @return dynamically allocated pair, NULL if failed.
  */
-pair *pair_alloc (
-    const_keyT key, const_valueT value,
-    const pair_key_cpy key_cpy, const pair_value_cpy value_cpy,
-    const pair_key_cmp key_cmp, const pair_value_cmp value_cmp,
-    const pair_key_free key_free, const pair_value_free value_free)
+pair *pair_alloc (const_keyT key, const_valueT value, const pair_type *type)
 {
-  pair *p = malloc (sizeof (pair));
-  p->key = key_cpy (key);
-  p->value = value_cpy (value);
-  p->key_cpy = key_cpy;
-  p->value_cpy = value_cpy;
-  p->key_cmp = key_cmp;
-  p->value_cmp = value_cmp;
-  p->key_free = key_free;
-  p->value_free = value_free;
+  return pair_alloc_in (NULL, key, value, type);
+}
+
+/**
+ * Allocates a new pair from an arena: the pair, and the elements of known
+ * size which are not stored inline, are carved from the arena's slabs.
+ * Elements of unknown size are still copied with the type's copy
+ * functions (and counted in arena->heap_elements).
+ * @param arena an arena, or NULL to allocate like pair_alloc.
+ * @param key, value - the key and value.
+ * @param type - the descriptor of the key and value.
+ * @return the new pair, NULL if failed. Free it with pair_free_in.
+ */
+pair *pair_alloc_in (arena *arena, const_keyT key, const_valueT value,
+                     const pair_type *type)
+{
+  if (!key || !value || !type)
+    {
+      return NULL;
+    }
+
+  pair_layout layout = layout_of (key, value, type, arena);
+  pair *p = arena ? arena_malloc (arena, layout.size)
+                  : malloc (layout.size);
+  if (!p)
+    {
+      return NULL;
+    }
+  p->type = type;
+  p->hash = 0;
+
+  if (layout.key_place == ELEM_INLINE)
+    {
+      p->key = memcpy (p->storage, key, layout.key_bytes);
+    }
+  else if (layout.key_place == ELEM_ARENA)
+    {
+      p->key = arena_malloc (arena, layout.key_bytes);
+      if (p->key)
+        {
+          memcpy (p->key, key, layout.key_bytes);
+        }
+    }
+  else
+    {
+      p->key = type->key_cpy (key);
+    }
+
+  if (layout.value_place == ELEM_INLINE)
+    {
+      p->value = memcpy (p->storage + layout.value_offset, value,
+                         layout.value_bytes);
+    }
+  else if (layout.value_place == ELEM_ARENA)
+    {
+      p->value = arena_malloc (arena, layout.value_bytes);
+      if (p->value)
+        {
+          memcpy (p->value, value, layout.value_bytes);
+        }
+    }
+  else
+    {
+      p->value = type->value_cpy (value);
+    }
+
+  if (arena)
+    {
+      arena->heap_elements += (layout.key_place == ELEM_HEAP && p->key)
+                              + (layout.value_place == ELEM_HEAP && p->value);
+    }
+  if (!p->key || !p->value)
+    {
+      pair_release (arena, p, &layout);
+      return NULL;
+    }
   return p;
 }
 
@@ -32,17 +240,23 @@ pair *pair_alloc (
  * @return new dynamically allocated old_pair if succeeded, NULL otherwise.
  */
 void *pair_copy (const void *p)
+{
+  return pair_copy_in (NULL, p);
+}
+
+/**
+ * Creates a new copy of the given pair, allocated from an arena.
+ * @param arena an arena, or NULL to copy like pair_copy.
+ * @param p pair to be copied.
+ * @return the new pair if succeeded, NULL otherwise.
+ */
+pair *pair_copy_in (arena *arena, const pair *p)
 {
   if (!p)
     {
       return NULL;
     }
-  const pair *old_pair = (const pair *) p;
-  pair *new_pair = pair_alloc (old_pair->key, old_pair->value,
-                               old_pair->key_cpy, old_pair->value_cpy,
-                               old_pair->key_cmp, old_pair->value_cmp,
-                               old_pair->key_free, old_pair->value_free);
-  return new_pair;
+  return pair_alloc_in (arena, p->key, p->value, p->type);
 }
 
 
@@ -55,16 +269,44 @@ int pair_cmp (const void *p1, const void *p2)
   const pair *pair1 = (const pair *) p1;
   const pair *pair2 = (const pair *) p2;
 
-  int key_cmp = pair1->key_cmp (pair1->key, pair2->key);
-  int val_cmp = pair1->value_cmp (pair1->value, pair2->value);
+  int key_cmp = pair1->type->key_cmp (pair1->key, pair2->key);
+  int val_cmp = pair1->type->value_cmp (pair1->value, pair2->value);
   return key_cmp && val_cmp;
 }
 
+/**
+ * Reports the bytes a pair takes: its own allocation (with its inline key
+ * and value), and its key and value stored outside of it.
+ * @param p a pair.
+ * @param pair_bytes output: the bytes of the pair's allocation.
+ * @param key_bytes, value_bytes output: the bytes of the key / value stored
+ * outside of the pair, 0 if inline or of unknown size (no key_len).
+ */
+void pair_footprint (const pair *p, size_t *pair_bytes, size_t *key_bytes,
+                     size_t *value_bytes)
+{
+  pair_layout layout = layout_of (p->key, p->value, p->type, NULL);
+  *pair_bytes = layout.size;
+  *key_bytes = layout.key_place == ELEM_INLINE ? 0 : layout.key_bytes;
+  *value_bytes = layout.value_place == ELEM_INLINE ? 0 : layout.value_bytes;
+}
+
 /**
  * This function frees a pair and everything it allocated dynamically.
  * @param p_pair pointer to dynamically allocated pair to be freed.
  */
 void pair_free (void ** p)
+{
+  pair_free_in (NULL, p);
+}
+
+/**
+ * This function frees a pair allocated from an arena, and everything it
+ * allocated.
+ * @param arena the arena the pair was allocated from (NULL for pair_free).
+ * @param p pointer to the pair to be freed.
+ */
+void pair_free_in (arena *arena, void **p)
 {
   if (!p || !(*p))
     {
@@ -72,8 +314,8 @@ void pair_free (void ** p)
     }
 
   pair **p_pair = (pair **) p;
-  (*p_pair)->key_free (&(*p_pair)->key);
-  (*p_pair)->value_free (&(*p_pair)->value);
-  free (*p_pair);
+  pair_layout layout = layout_of ((*p_pair)->key, (*p_pair)->value,
+                                  (*p_pair)->type, arena);
+  pair_release (arena, *p_pair, &layout);
   *p_pair = NULL;
 }
@@ -2,6 +2,7 @@
 #define PAIR_H_
 
 #include <stdlib.h>
+#include "arena.h"
 
 /**
  * @typedef keyT, valueT, const_keyT, const_valueT
@@ -34,36 +35,90 @@ typedef void (*pair_key_free) (keyT *);
 typedef void (*pair_value_free) (valueT *);
 
 /**
- * @struct pair - represent a pair '''{key: value}'''.
- * @param key, value - the key and value.
- * @param key_cpy, value_cpy - copy functions for key and value.
+ * @typedef pair_key_len, pair_value_len
+ * Byte length functions for variable-size keys and values (e.g. strlen + 1
+ * for strings). Optional: they let such elements be copied bytewise, inline
+ * when small, or into the arena of an arena-backed map.
+ */
+typedef size_t (*pair_key_len) (const_keyT);
+typedef size_t (*pair_value_len) (const_valueT);
+
+/**
+ * @def PAIR_INLINE_MAX
+ * Keys and values of a fixed size up to PAIR_INLINE_MAX bytes are stored
+ * inline, inside the pair's own allocation. Larger (or variable-size) ones
+ * are dynamically copied with the type's copy functions.
+ * An inline value follows the key at its natural alignment: the largest
+ * power of two dividing its size, up to the alignment of max_align_t (so a
+ * 16-byte long double after a 1-byte key is 16-aligned).
+ */
+#define PAIR_INLINE_MAX 16UL
+
+/**
+ * @struct pair_type - describes the keys and values of a kind of pairs.
+ * All the pairs of one kind (e.g. all the pairs of a map) share one
+ * descriptor, usually a static const one.
+ * @param key_size, value_size - the fixed size of a key / value in bytes,
+ * or 0 for variable-size elements (such as strings).
+ * @param key_cpy, value_cpy - copy functions for key and value, used only
+ * for the elements which are not stored inline.
  * @param key_cmp, value_cmp - compare functions for key and value.
- * @param key_free, value_free - free functions for key and value.
+ * @param key_free, value_free - free functions for key and value, used only
+ * for the elements which are not stored inline.
+ * @param key_len, value_len - optional byte length functions of
+ * variable-size keys and values (may be NULL).
  */
-typedef struct pair {
-    keyT key;
-    valueT value;
+typedef struct pair_type {
+    size_t key_size;
+    size_t value_size;
     pair_key_cpy key_cpy;
     pair_value_cpy value_cpy;
     pair_key_cmp key_cmp;
     pair_value_cmp value_cmp;
     pair_key_free key_free;
     pair_value_free value_free;
+    pair_key_len key_len;
+    pair_value_len value_len;
+} pair_type;
+
+/**
+ * @struct pair - represent a pair '''{key: value}'''.
+ * @param key, value - the key and value (they point into storage when stored
+ * inline).
+ * @param type - the descriptor of the pair's key and value.
+ * @param hash - the full hash of the key, cached by the hash map which
+ * stores the pair (so it is never recomputed on resize, and key_cmp is
+ * called only for keys of equal hash).
+ * @param storage - the inline key and value bytes, sized per pair.
+ */
+typedef struct pair {
+    keyT key;
+    valueT value;
+    const pair_type *type;
+    size_t hash;
+    unsigned char storage[];
 } pair;
 
 /**
  * Allocates dynamically a new pair.
  * @param key, value - the key and value.
- * @param key_cpy, value_cpy - copy functions for key and value.
- * @param key_cmp, value_cmp - compare functions for key and value.
- * @param key_free, value_free - free functions for key and value.
- * @return dynamically allocated pair.
+ * @param type - the descriptor of the key and value.
+ * @return dynamically allocated pair, NULL if failed.
+ */
+pair *pair_alloc (const_keyT key, const_valueT value, const pair_type *type);
+
+/**
+ * Allocates a new pair from an arena: the pair, and the elements of known
+ * size which are not stored inline, are carved from the arena's slabs.
+ * Elements of unknown size are still copied with the type's copy
+ * functions (and counted in arena->heap_elements).
+ * @param arena an arena, or NULL to allocate like pair_alloc.
+ * @param key, value - the key and value.
+ * @param type - the descriptor of the key and value.
+ * @return the new pair, NULL if failed. Free it with pair_free_in.
  */
-pair *pair_alloc (
-    const_keyT key, const_valueT value,
-    pair_key_cpy key_cpy, pair_value_cpy value_cpy,
-    pair_key_cmp key_cmp, pair_value_cmp value_cmp,
-    pair_key_free key_free, pair_value_free value_free);
+pair *pair_alloc_in (arena *arena, const_keyT key, const_valueT value,
+                     const pair_type *type);
 
 /**
  * Creates a new (dynamically allocated) copy of the given old_pair.
@@ -72,6 +127,14 @@ pair *pair_alloc (
  */
 void *pair_copy (const void *p);
 
+/**
+ * Creates a new copy of the given pair, allocated from an arena.
+ * @param arena an arena, or NULL to copy like pair_copy.
+ * @param p pair to be copied.
+ * @return the new pair if succeeded, NULL otherwise.
+ */
+pair *pair_copy_in (arena *arena, const pair *p);
+
 /**
  * Compares two pairs
  * @param pair1 first pair
@@ -80,10 +143,29 @@ void *pair_copy (const void *p);
  */
 int pair_cmp(const void *p1, const void *p2);
 
+/**
+ * Reports the bytes a pair takes: its own allocation (with its inline key
+ * and value), and its key and value stored outside of it.
+ * @param p a pair.
+ * @param pair_bytes output: the bytes of the pair's allocation.
+ * @param key_bytes, value_bytes output: the bytes of the key / value stored
+ * outside of the pair, 0 if inline or of unknown size (no key_len).
+ */
+void pair_footprint (const pair *p, size_t *pair_bytes, size_t *key_bytes,
+                     size_t *value_bytes);
+
 /**
  * This function frees a pair and everything it allocated dynamically.
  * @param p_pair pointer to dynamically allocated pair to be freed.
  */
 void pair_free (void **p);
 
+/**
+ * This function frees a pair allocated from an arena, and everything it
+ * allocated.
+ * @param arena the arena the pair was allocated from (NULL for pair_free).
+ * @param p pointer to the pair to be freed.
+ */
+void pair_free_in (arena *arena, void **p);
+
 #endif //PAIR_H_
@@ -0,0 +1,219 @@
+#include <stdlib.h>
+#include <string.h>
+#include "symtab.h"
+#include "hash_funcs.h"
+
+/**
+ * @def SYMTAB_WORD_BUFFER
+ * The size of the stack buffer a new string is NUL-terminated in before
+ * its insertion (longer strings are copied into a dynamically allocated
+ * one).
+ */
+#define SYMTAB_WORD_BUFFER 256UL
+
+static keyT word_cpy (const_keyT word)
+{
+  size_t len = strlen (word) + 1;
+  char *new_word = malloc (len);
+  if (new_word != NULL)
+    memcpy (new_word, word, len);
+  return new_word;
+}
+
+static int word_cmp (const_keyT word_1, const_keyT word_2)
+{
+  return strcmp (word_1, word_2) == 0;
+}
+
+static void word_free (keyT *word)
+{
+  free (*word);
+  *word = NULL;
+}
+
+static size_t word_len (const_keyT word)
+{
+  return strlen (word) + 1;
+}
+
+static valueT id_cpy (const_valueT id)
+{
+  uint32_t *new_id = malloc (sizeof (uint32_t));
+  if (new_id != NULL)
+    *new_id = *(const uint32_t *) id;
+  return new_id;
+}
+
+static int id_cmp (const_valueT id_1, const_valueT id_2)
+{
+  return *(const uint32_t *) id_1 == *(const uint32_t *) id_2;
+}
+
+static void id_free (valueT *id)
+{
+  free (*id);
+  *id = NULL;
+}
+
+/**
+ * The table's pairs: string -> id. The strings are copied bytewise (inline
+ * or into the table's arena), the ids are stored inline.
+ */
+static const pair_type word_type = {
+    0, sizeof (uint32_t), word_cpy, id_cpy,
+    word_cmp, id_cmp, word_free, id_free,
+    word_len, NULL
+};
+
+/**
+ * @struct symtab_view - a looked-up string, not NUL-terminated.
+ */
+typedef struct symtab_view {
+    const char *ptr;
+    size_t len;
+} symtab_view;
+
+/**
+ * Compares a string of the table with a looked-up view.
+ */
+static int word_view_cmp (const_keyT word, const void *probe)
+{
+  const symtab_view *view = probe;
+  return strncmp (word, view->ptr, view->len) == 0
+         && ((const char *) word)[view->len] == '\0';
+}
+
+/**
+ * @return the pair of the viewed string in the table, NULL if not in it.
+ */
+static pair *symtab_find (const symtab *table, const symtab_view *view,
+                          size_t hash)
+{
+  return hashmap_find_probe (table->ids, view, hash, word_view_cmp);
+}
+
+/**
+ * Allocates dynamically a new, empty, symbol table.
+ * @return pointer to dynamically allocated symbol table.
+ * @if_fail return NULL.
+ */
+symtab *symtab_alloc (void)
+{
+  symtab *table = malloc (sizeof (*table));
+  if (table == NULL)
+    return NULL;
+
+  // the compact backend keeps the strings in id order
+  table->ids = hashmap_alloc_arena (hash_string, HASHMAP_COMPACT);
+  table->words = vector_alloc_by_value (sizeof (const char *), NULL, NULL,
+                                        NULL);
+  if (table->ids == NULL || table->words == NULL)
+    symtab_free (&table);
+  return table;
+}
+
+/**
+ * Frees a symbol table and its strings.
+ * @param p_table pointer to dynamically allocated pointer to symbol table.
+ */
+void symtab_free (symtab **p_table)
+{
+  if (p_table == NULL || *p_table == NULL)
+    return;
+  vector_free (&(*p_table)->words);
+  hashmap_free (&(*p_table)->ids);
+  free (*p_table);
+  *p_table = NULL;
+}
+
+/**
+ * Looks the string up by its (pointer, length) view, without copying it.
+ * @param table a symbol table.
+ * @param str the chars of the string (not necessarily NUL-terminated).
+ * @param len the number of chars of the string.
+ * @return the id of the string, SYMTAB_NO_ID if it was never interned.
+ */
+uint32_t symtab_lookup (const symtab *table, const char *str, size_t len)
+{
+  if (table == NULL || str == NULL)
+    return SYMTAB_NO_ID;
+
+  symtab_view view = {str, len};
+  pair *found = symtab_find (table, &view, hash_string_n (str, len));
+  return found == NULL ? SYMTAB_NO_ID : *(const uint32_t *) found->value;
+}
+
+/**
+ * Returns the id of the string, giving it the next id (and copying it into
+ * the table) the first time it is interned.
+ * @param table a symbol table.
+ * @param str the chars of the string (not necessarily NUL-terminated, it
+ * may not contain a NUL).
+ * @param len the number of chars of the string.
+ * @return the id of the string, SYMTAB_NO_ID if failed (out of memory, or
+ * out of ids).
+ */
+uint32_t symtab_intern (symtab *table, const char *str, size_t len)
+{
+  if (table == NULL || str == NULL)
+    return SYMTAB_NO_ID;
+
+  // hash_string_n of the view is hash_string of the stored string, so a
+  // known string is neither copied nor hashed as a C string
+  symtab_view view = {str, len};
+  size_t hash = hash_string_n (str, len);
+  pair *found = symtab_find (table, &view, hash);
+  if (found != NULL)
+    return *(const uint32_t *) found->value;
+
+  if (table->words->size >= SYMTAB_NO_ID)
+    return SYMTAB_NO_ID;
+  char stack_word[SYMTAB_WORD_BUFFER];
+  char *word = stack_word;
+  if (len >= sizeof (stack_word))
+    {
+      word = malloc (len + 1);
+      if (word == NULL)
+        return SYMTAB_NO_ID;
+    }
+  memcpy (word, str, len);
+  word[len] = '\0';
+
+  uint32_t id = (uint32_t) table->words->size;
+  pair probe = {(keyT) word, &id, &word_type, 0};
+  int inserted = hashmap_insert_hashed (table->ids, &probe, hash);
+  if (word != stack_word)
+    free (word);
+  if (!inserted)
+    return SYMTAB_NO_ID;
+
+  // the id's entry points at the table's copy of the string
+  const char *stored = symtab_find (table, &view, hash)->key;
+  if (!vector_push_back (table->words, &stored))
+    {
+      hashmap_erase (table->ids, stored);
+      return SYMTAB_NO_ID;
+    }
+  return id;
+}
+
+/**
+ * @param table a symbol table.
+ * @param id an id given by the table.
+ * @return the NUL-terminated string of the id (owned by the table, valid
+ * until it is freed).
+ */
+const char *symtab_word (const symtab *table, uint32_t id)
+{
+  const char *const *word = vector_at (table->words, id);
+  return word == NULL ? NULL : *word;
+}
+
+/**
+ * @param table a symbol table.
+ * @return the number of strings in the table.
+ */
+size_t symtab_size (const symtab *table)
+{
+  return table == NULL ? 0 : table->words->size;
+}
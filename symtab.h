@@ -0,0 +1,76 @@
+#ifndef SYMTAB_H_
+#define SYMTAB_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+#include "vector.h"
+
+/**
+ * @def SYMTAB_NO_ID
+ * The id of no symbol (a failed or missed lookup).
+ */
+#define SYMTAB_NO_ID UINT32_MAX
+
+/**
+ * @struct symtab - interns strings as dense 32-bit ids: the n-th distinct
+ * string gets id n. Each string is stored once, so structures built on
+ * the ids (counters, transitions, n-grams) key on small integers.
+ * @param ids string -> its id (a uint32_t), the strings are copied once,
+ * on their first interning, into its arena.
+ * @param words id -> the table's copy of its string (a const char *).
+ */
+typedef struct symtab {
+    hashmap *ids;
+    vector *words;
+} symtab;
+
+/**
+ * Allocates dynamically a new, empty, symbol table.
+ * @return pointer to dynamically allocated symbol table.
+ * @if_fail return NULL.
+ */
+symtab *symtab_alloc (void);
+
+/**
+ * Frees a symbol table and its strings.
+ * @param p_table pointer to dynamically allocated pointer to symbol table.
+ */
+void symtab_free (symtab **p_table);
+
+/**
+ * Looks the string up by its (pointer, length) view, without copying it.
+ * @param table a symbol table.
+ * @param str the chars of the string (not necessarily NUL-terminated).
+ * @param len the number of chars of the string.
+ * @return the id of the string, SYMTAB_NO_ID if it was never interned.
+ */
+uint32_t symtab_lookup (const symtab *table, const char *str, size_t len);
+
+/**
+ * Returns the id of the string, giving it the next id (and copying it into
+ * the table) the first time it is interned.
+ * @param table a symbol table.
+ * @param str the chars of the string (not necessarily NUL-terminated, it
+ * may not contain a NUL).
+ * @param len the number of chars of the string.
+ * @return the id of the string, SYMTAB_NO_ID if failed (out of memory, or
+ * out of ids).
+ */
+uint32_t symtab_intern (symtab *table, const char *str, size_t len);
+
+/**
+ * @param table a symbol table.
+ * @param id an id given by the table.
+ * @return the NUL-terminated string of the id (owned by the table, valid
+ * until it is freed).
+ */
+const char *symtab_word (const symtab *table, uint32_t id);
+
+/**
+ * @param table a symbol table.
+ * @return the number of strings in the table.
+ */
+size_t symtab_size (const symtab *table);
+
+#endif //SYMTAB_H_
@@ -75,6 +75,14 @@ void *str_key_cpy (const_keyT key)
   return new_str;
 }
 
+/**
+ * Byte length of the String key of the pair.
+ */
+size_t str_key_len (const_keyT key)
+{
+  return strlen ((char *) key) + 1;
+}
+
 /**
  * Copies the double value of the pair.
  */
@@ -125,6 +133,88 @@ void double_value_free (valueT *val)
     }
 }
 
+/**
+ * Copies the long double value of the pair.
+ */
+void *long_double_value_cpy (const_valueT value)
+{
+  long double *new_long_double = malloc (sizeof (long double));
+  *new_long_double = *((long double *) value);
+  return new_long_double;
+}
+
+/**
+ * Compares the long double value of the pair.
+ */
+int long_double_value_cmp (const_valueT val_1, const_valueT val_2)
+{
+  return *((long double *) val_1) == *((long double *) val_2);
+}
+
+/**
+ * Number of keys and values dynamically allocated by the counted copy
+ * funcs below.
+ */
+size_t counted_allocs = 0;
+
+/**
+ * Copies the String key of the pair, and counts the allocation.
+ */
+void *counted_str_key_cpy (const_keyT key)
+{
+  counted_allocs++;
+  return str_key_cpy (key);
+}
+
+/**
+ * Copies the int value of the pair, and counts the allocation.
+ */
+void *counted_int_value_cpy (const_valueT value)
+{
+  counted_allocs++;
+  return int_value_cpy (value);
+}
+
+/**
+ * char -> int pairs, both stored inline.
+ */
+const pair_type char_int_type = {
+    sizeof (char), sizeof (int), char_key_cpy, int_value_cpy,
+    char_key_cmp, int_value_cmp, char_key_free, int_value_free,
+    NULL, NULL};
+
+/**
+ * char -> long double pairs, both stored inline.
+ */
+const pair_type char_long_double_type = {
+    sizeof (char), sizeof (long double), char_key_cpy, long_double_value_cpy,
+    char_key_cmp, long_double_value_cmp, char_key_free, double_value_free,
+    NULL, NULL};
+
+/**
+ * string -> double pairs, short string keys are stored inline.
+ */
+const pair_type str_double_type = {
+    0, sizeof (double), str_key_cpy, double_value_cpy,
+    str_key_cmp, double_value_cmp, str_key_free, double_value_free,
+    str_key_len, NULL};
+
+/**
+ * string -> int pairs, short string keys are stored inline.
+ */
+const pair_type str_int_type = {
+    0, sizeof (int), str_key_cpy, int_value_cpy,
+    str_key_cmp, int_value_cmp, str_key_free, int_value_free,
+    str_key_len, NULL};
+
+/**
+ * string -> int pairs, both dynamically copied by the counted copy funcs.
+ */
+const pair_type counted_str_int_type = {
+    0, 0, counted_str_key_cpy, counted_int_value_cpy,
+    str_key_cmp, int_value_cmp, str_key_free, int_value_free,
+    NULL, NULL};
+
 /**
  * @param elem pointer to a char (keyT of pair_char_int)
  * @return 1 if the char represents a digit, else - 0
@@ -3,8 +3,16 @@
 #include "hash_funcs.h"
 #include "test_suite.h"
 #include "hashmap.h"
+#include "hashmap_typed.h"
+#include "concurrent_hashmap.h"
+#include "hashmap_snapshot.h"
+#include "markov_chain.h"
+#include "markov_frozen.h"
+#include "corpus.h"
+#include "symtab.h"
 #include <stdlib.h>
 #include <assert.h>
+#include <unistd.h>
 
 #define FAIL 0
 #define SUCCESS 1
@@ -26,9 +34,7 @@ void test_hash_map_insert (void)
       // keys are capital letters, values are {0, ... ,25}
       char key = (char) (j + 65);
       int value = j;
-      pairs[j] = pair_alloc (&key, &value, char_key_cpy, int_value_cpy,
-                             char_key_cmp, int_value_cmp, char_key_free,
-                             int_value_free);
+      pairs[j] = pair_alloc (&key, &value, &char_int_type);
       assert (pairs[j] != NULL && "INSERTION-TEST: Failed to allocate pair");
     }
 
@@ -119,9 +125,7 @@ void test_hash_map_at (void)
       // keys are capital letters, values are {0, ... ,25}
       char key = (char) (j + 65);
       int value = j;
-      pairs[j] = pair_alloc (&key, &value, char_key_cpy, int_value_cpy,
-                             char_key_cmp, int_value_cmp, char_key_free,
-                             int_value_free);
+      pairs[j] = pair_alloc (&key, &value, &char_int_type);
       assert (
           pairs[j] != NULL && "HASHMAP-AT-TEST: Failed to allocate pair");
     }
@@ -186,9 +190,7 @@ void test_hash_map_erase (void)
   // allocate the pairs:
   for (int j = 0; j < 16; ++j)
     {
-      pairs[j] = pair_alloc (keys[j], &values[j], str_key_cpy,
-                             double_value_cpy, str_key_cmp,
-                             double_value_cmp, str_key_free, double_value_free);
+      pairs[j] = pair_alloc (keys[j], &values[j], &str_double_type);
       assert (pairs[j] != NULL && "ERASE-TEST: Failed to allocate pair");
     }
 
@@ -325,9 +327,7 @@ void test_hash_map_apply_if ()
 
   for (int j = 0; j < 16; ++j)
     {
-      pairs[j] = pair_alloc (keys[j], &values[j], str_key_cpy,
-                             int_value_cpy, str_key_cmp, int_value_cmp,
-                             str_key_free, int_value_free);
+      pairs[j] = pair_alloc (keys[j], &values[j], &str_int_type);
       assert (pairs[j] != NULL && "APPLY-IF-TEST: Failed to allocate pair");
     }
 
@@ -381,3 +381,1955 @@ void test_hash_map_apply_if ()
 
 
 
+
+/**
+ * This function checks the open-addressing backend of the hashmap library:
+ * insert / at / erase / apply_if must behave exactly like the chained one.
+ * If the backend fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_open_addressing (void)
+{
+  hashmap *map = hashmap_alloc_backend (hash_char, HASHMAP_OPEN_ADDRESSING);
+  assert (map != NULL && "OPEN-ADDRESSING-TEST: Failed to allocate hash map");
+
+  // Create char-to-int Pairs, keys are capital letters and digits:
+  void *pairs[36];
+  for (int j = 0; j < 36; ++j)
+    {
+      char key = (char) (j < 26 ? j + 65 : j - 26 + 48);
+      int value = j;
+      pairs[j] = pair_alloc (&key, &value, &char_int_type);
+      assert (pairs[j] != NULL
+              && "OPEN-ADDRESSING-TEST: Failed to allocate pair");
+    }
+
+  for (int j = 0; j < 36; ++j)
+    {
+      int insertion_flag = hashmap_insert (map, pairs[j]);
+      assert (insertion_flag == SUCCESS
+              && "OPEN-ADDRESSING-TEST: Failed to insert pair.");
+    }
+  assert (map->size == 36 && map->capacity == HASH_MAP_INITIAL_CAP * 4
+          && "OPEN-ADDRESSING-TEST: Table size didn't resize.");
+  int insertion_flag = hashmap_insert (map, pairs[3]);
+  assert (insertion_flag == FAIL
+          && "OPEN-ADDRESSING-TEST: Hashed 2 pairs with same keys.");
+
+  for (int j = 0; j < 36; ++j)
+    {
+      pair *cur_pair = (pair *) (pairs[j]);
+      assert (int_value_cmp (hashmap_at (map, cur_pair->key), cur_pair->value)
+              && "OPEN-ADDRESSING-TEST: Wrong value returned for key.");
+    }
+
+  // only the 10 digits keys are doubled:
+  int changes = hashmap_apply_if (map, is_digit, double_value);
+  assert (changes == 10
+          && "OPEN-ADDRESSING-TEST: ERROR -> Expected to 10 changes.");
+  int expected_value = 2 * 30;
+  assert (int_value_cmp (hashmap_at (map, ((pair *) pairs[30])->key),
+                         &expected_value)
+          && "OPEN-ADDRESSING-TEST: Value change didn't worked properly.");
+
+  // erase the letters, the map shrinks back:
+  for (int j = 0; j < 26; ++j)
+    {
+      pair *cur_pair = (pair *) (pairs[j]);
+      int action_flag = hashmap_erase (map, cur_pair->key);
+      assert (action_flag == SUCCESS
+              && "OPEN-ADDRESSING-TEST: Failed to erase pair.");
+      assert (hashmap_at (map, cur_pair->key) == NULL
+              && "OPEN-ADDRESSING-TEST: Found value for erased key.");
+    }
+  int action_flag = hashmap_erase (map, ((pair *) pairs[0])->key);
+  assert (action_flag == FAIL
+          && "OPEN-ADDRESSING-TEST: Double-erasing took place.");
+  assert (map->size == 10 && map->capacity == HASH_MAP_INITIAL_CAP * 2
+          && "OPEN-ADDRESSING-TEST: Failed to rehash map.");
+
+  hashmap_free (&map);
+  assert (map == NULL && "OPEN-ADDRESSING-TEST: Failed to free the hash-map.");
+  for (int j = 0; j < 36; ++j)
+    pair_free (&(pairs[j]));
+
+  // a const hash func puts all the keys in one probe sequence, which must
+  // keep working across many groups, tombstones and rehashes:
+  map = hashmap_alloc_backend (hash_const, HASHMAP_OPEN_ADDRESSING);
+  char key[8];
+  int value = 0;
+  for (int round = 0; round < 3; ++round)
+    {
+      for (int j = 0; j < 100; ++j)
+        {
+          sprintf (key, "k%03d", j);
+          pair *p = pair_alloc (key, &value, &str_int_type);
+          insertion_flag = hashmap_insert (map, p);
+          assert (insertion_flag == SUCCESS
+                  && "OPEN-ADDRESSING-TEST: Failed to insert colliding pair.");
+          pair_free ((void **) &p);
+        }
+      for (int j = 0; j < 100; j += 2)
+        {
+          sprintf (key, "k%03d", j);
+          action_flag = hashmap_erase (map, key);
+          assert (action_flag == SUCCESS
+                  && "OPEN-ADDRESSING-TEST: Failed to erase colliding pair.");
+        }
+      for (int j = 0; j < 100; ++j)
+        {
+          sprintf (key, "k%03d", j);
+          assert ((hashmap_at (map, key) != NULL) == (j % 2 == 1)
+                  && "OPEN-ADDRESSING-TEST: Wrong lookup of colliding key.");
+        }
+      for (int j = 1; j < 100; j += 2)
+        {
+          sprintf (key, "k%03d", j);
+          action_flag = hashmap_erase (map, key);
+          assert (action_flag == SUCCESS
+                  && "OPEN-ADDRESSING-TEST: Failed to erase colliding pair.");
+        }
+    }
+  assert (map->size == 0 && "OPEN-ADDRESSING-TEST: Map should be empty.");
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks that resizing the hash map moves the pairs instead
+ * of copying them: the allocations made by an insertion are the same
+ * whether or not it triggers a resize, for any number of entries.
+ * If the resize copies pairs, the functions exits with exit code 1.
+ */
+void test_hash_map_resize (void)
+{
+  hashmap_backend backends[] = {HASHMAP_CHAINED, HASHMAP_OPEN_ADDRESSING,
+                                HASHMAP_COMPACT};
+  for (int b = 0; b < 3; ++b)
+    {
+      hashmap *map = hashmap_alloc_backend (hash_string, backends[b]);
+      assert (map != NULL && "RESIZE-TEST: Failed to allocate hash map");
+
+      char key[16];
+      int value = 0;
+      size_t resizes = 0;
+      valueT first_value = NULL;
+      for (int j = 0; j < 3000; ++j)
+        {
+          sprintf (key, "word-%d", j);
+          value = j;
+          pair *p = pair_alloc (key, &value, &counted_str_int_type);
+
+          // an insertion allocates only its own key & value copies:
+          size_t prev_capacity = map->capacity;
+          size_t prev_allocs = counted_allocs;
+          int insertion_flag = hashmap_insert (map, p);
+          assert (insertion_flag == SUCCESS
+                  && "RESIZE-TEST: Failed to insert pair.");
+          assert (counted_allocs - prev_allocs == 2
+                  && "RESIZE-TEST: Resize copied the pairs.");
+          resizes += map->capacity != prev_capacity;
+          pair_free ((void **) &p);
+
+          if (j == 0)
+            first_value = hashmap_at (map, "word-0");
+        }
+      assert (resizes >= 8 && "RESIZE-TEST: Table size didn't resize.");
+
+      // values stay in place across the resizes:
+      assert (hashmap_at (map, "word-0") == first_value
+              && "RESIZE-TEST: Value moved by a resize.");
+
+      // an explicit resize takes powers of 2 which hold the pairs:
+      size_t capacity = map->capacity;
+      int resize_flag = hashmap_resize (map, 3 * capacity);
+      int small_resize_flag = hashmap_resize (map, capacity / 4);
+      assert (resize_flag == FAIL && small_resize_flag == FAIL
+              && map->capacity == capacity
+              && "RESIZE-TEST: Resized to an invalid capacity.");
+      size_t prev_resize_allocs = counted_allocs;
+      resize_flag = hashmap_resize (map, 4 * capacity);
+      assert (resize_flag == SUCCESS && map->capacity == 4 * capacity
+              && "RESIZE-TEST: Failed to resize explicitly.");
+      resize_flag = hashmap_resize (map, capacity);
+      assert (resize_flag == SUCCESS && map->capacity == capacity
+              && "RESIZE-TEST: Failed to resize explicitly.");
+      assert (counted_allocs == prev_resize_allocs
+              && hashmap_at (map, "word-0") == first_value
+              && *(int *) hashmap_at (map, "word-2999") == 2999
+              && "RESIZE-TEST: Explicit resize copied the pairs.");
+
+      // shrinking doesn't copy either:
+      size_t prev_allocs = counted_allocs;
+      for (int j = 1; j < 3000; ++j)
+        {
+          sprintf (key, "word-%d", j);
+          int action_flag = hashmap_erase (map, key);
+          assert (action_flag == SUCCESS
+                  && "RESIZE-TEST: Failed to erase pair.");
+        }
+      assert (counted_allocs == prev_allocs
+              && "RESIZE-TEST: Shrinking copied the pairs.");
+      assert (map->capacity <= HASH_MAP_INITIAL_CAP
+              && "RESIZE-TEST: Table size didn't shrink.");
+      assert (hashmap_at (map, "word-0") == first_value
+              && "RESIZE-TEST: Value moved by a resize.");
+
+      hashmap_free (&map);
+    }
+}
+
+/**
+ * This function checks the pair_type descriptor of the pair library: small
+ * fixed-size keys and values live inside the pair, larger ones are copied.
+ * If pair_alloc fails at some points, the functions exits with exit code 1.
+ */
+void test_pair_inline (void)
+{
+  char key = 'K';
+  int value = 7;
+  pair *p = pair_alloc (&key, &value, &char_int_type);
+  assert (p != NULL && "PAIR-INLINE-TEST: Failed to allocate pair");
+
+  // key and value are stored in the pair's own allocation:
+  unsigned char *begin = (unsigned char *) p;
+  unsigned char *end = p->storage + 2 * PAIR_INLINE_MAX;
+  assert ((unsigned char *) p->key >= begin && (unsigned char *) p->key < end
+          && (unsigned char *) p->value >= begin
+          && (unsigned char *) p->value < end
+          && "PAIR-INLINE-TEST: Small key/value were not stored inline.");
+  assert (p->type == &char_int_type
+          && "PAIR-INLINE-TEST: Pair doesn't refer its type.");
+
+  // a copy has its own storage:
+  pair *copy = pair_copy (p);
+  assert (copy != NULL && pair_cmp (p, copy)
+          && "PAIR-INLINE-TEST: Failed to copy pair.");
+  *((int *) copy->value) = 8;
+  assert (*((int *) p->value) == 7 && !pair_cmp (p, copy)
+          && "PAIR-INLINE-TEST: Copy shares its value with the original.");
+  pair_free ((void **) &copy);
+  pair_free ((void **) &p);
+
+  // variable-size keys are dynamically copied, the value stays inline:
+  double dvalue = 2.5;
+  p = pair_alloc ("a-long-string-key-for-the-heap", &dvalue, &str_double_type);
+  assert (p != NULL && "PAIR-INLINE-TEST: Failed to allocate pair");
+  assert ((void *) p->value == (void *) p->storage
+          && ((size_t) p->value) % sizeof (double) == 0
+          && "PAIR-INLINE-TEST: Inline value is misplaced.");
+  assert (str_key_cmp (p->key, "a-long-string-key-for-the-heap")
+          && double_value_cmp (p->value, &dvalue)
+          && "PAIR-INLINE-TEST: Wrong key/value stored.");
+  pair_free ((void **) &p);
+
+  // a wide value after a 1-byte key is aligned to its size, also in an
+  // arena:
+  long double wide = 1.25L;
+  arena *pool = arena_alloc ();
+  pair *pairs[] = {pair_alloc (&key, &wide, &char_long_double_type),
+                   pair_alloc_in (pool, &key, &wide, &char_long_double_type)};
+  for (size_t i = 0; i < sizeof (pairs) / sizeof (*pairs); ++i)
+    {
+      assert (pairs[i] != NULL
+              && (unsigned char *) pairs[i]->value > pairs[i]->storage
+              && ((size_t) pairs[i]->value) % _Alignof (long double) == 0
+              && long_double_value_cmp (pairs[i]->value, &wide)
+              && "PAIR-INLINE-TEST: Wide inline value is misaligned.");
+    }
+  pair_free ((void **) &pairs[0]);
+  pair_free_in (pool, (void **) &pairs[1]);
+  arena_free (&pool);
+  assert (p == NULL && "PAIR-INLINE-TEST: Failed to free pair.");
+}
+
+/**
+ * This function checks the hashmap_insert_move and hashmap_extract functions
+ * of the hashmap library: pairs are handed over without any copy.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_move (void)
+{
+  hashmap *src = hashmap_alloc_backend (hash_string, HASHMAP_CHAINED);
+  hashmap *dst = hashmap_alloc_backend (hash_string, HASHMAP_OPEN_ADDRESSING);
+  assert (src != NULL && dst != NULL
+          && "MOVE-TEST: Failed to allocate hash map");
+
+  char key[16];
+  int value;
+  pair *moved[100];
+  for (int j = 0; j < 100; ++j)
+    {
+      sprintf (key, "move-%d", j);
+      value = j;
+      moved[j] = pair_alloc (key, &value, &counted_str_int_type);
+      assert (moved[j] != NULL && "MOVE-TEST: Failed to allocate pair");
+    }
+
+  // the map owns the given pairs themselves:
+  size_t prev_allocs = counted_allocs;
+  for (int j = 0; j < 100; ++j)
+    {
+      int insertion_flag = hashmap_insert_move (src, moved[j]);
+      assert (insertion_flag == SUCCESS
+              && "MOVE-TEST: Failed to insert pair.");
+      assert (hashmap_at (src, moved[j]->key) == moved[j]->value
+              && "MOVE-TEST: Inserted pair was copied.");
+    }
+
+  // a duplicated key is rejected, and stays owned by the caller:
+  value = -1;
+  pair *duplicate = pair_alloc ("move-7", &value, &counted_str_int_type);
+  int insertion_flag = hashmap_insert_move (src, duplicate);
+  assert (insertion_flag == FAIL
+          && "MOVE-TEST: Hashed 2 pairs with same keys.");
+  pair_free ((void **) &duplicate);
+  prev_allocs += 2;
+
+  // move all the pairs to another map:
+  for (int j = 0; j < 100; ++j)
+    {
+      sprintf (key, "move-%d", j);
+      pair *out = hashmap_extract (src, key);
+      assert (out == moved[j] && "MOVE-TEST: Wrong pair extracted.");
+      assert (hashmap_at (src, key) == NULL
+              && "MOVE-TEST: Extracted pair still in map.");
+      insertion_flag = hashmap_insert_move (dst, out);
+      assert (insertion_flag == SUCCESS
+              && "MOVE-TEST: Failed to reinsert pair.");
+    }
+  assert (src->size == 0 && dst->size == 100
+          && "MOVE-TEST: Wrong sizes after moving.");
+  pair *none = hashmap_extract (src, "move-0");
+  assert (none == NULL
+          && "MOVE-TEST: Extracted a pair from an empty map.");
+  assert (counted_allocs == prev_allocs
+          && "MOVE-TEST: Moving pairs made allocations.");
+
+  // dst frees the moved pairs:
+  hashmap_free (&src);
+  hashmap_free (&dst);
+}
+
+/**
+ * The former byte-sum string hash, kept as the distribution baseline.
+ */
+static size_t byte_sum_hash (const void *elem)
+{
+  size_t hash = 0;
+  for (const char *s = elem; *s; s++)
+    hash += *s;
+  return hash;
+}
+
+/**
+ * @return the length of the longest bucket of a chained map.
+ */
+static size_t max_chain_length (const hashmap *map)
+{
+  size_t max_chain = 0;
+  for (size_t i = 0; i < map->capacity; i++)
+    if (map->buckets[i] != NULL && map->buckets[i]->size > max_chain)
+      max_chain = map->buckets[i]->size;
+  return max_chain;
+}
+
+/**
+ * This function checks the hash_string / hash_string_n hash funcs: equal
+ * bytes hash equally, and the words of an English word list spread over
+ * the buckets of a chained map.
+ * If the distribution is bad, the functions exits with exit code 1.
+ */
+void test_hash_string_distribution (void)
+{
+  // a token inside a larger buffer hashes like the same NUL-terminated word
+  const char *line = "the quick brown fox jumps over the lazy dog";
+  assert (hash_string_n (line + 4, 5) == hash_string ("quick")
+          && hash_string_n (line, 3) == hash_string_n (line + 31, 3)
+          && hash_string_n (line, 0) == hash_string ("")
+          && "HASH-STRING-TEST: Equal tokens hashed differently.");
+  assert (hash_string ("listen") != hash_string ("silent")
+          && "HASH-STRING-TEST: Anagrams collided.");
+
+  const char *stems[] = {
+      "time", "year", "people", "way", "day", "man", "thing", "woman",
+      "life", "child", "world", "school", "state", "family", "student",
+      "group", "country", "problem", "hand", "part", "place", "case",
+      "week", "company", "system", "program", "question", "work",
+      "government", "number", "night", "point", "home", "water", "room",
+      "mother", "area", "money", "story", "fact", "month", "lot", "right",
+      "study", "book", "eye", "job", "word", "business", "issue", "side",
+      "kind", "head", "house", "service", "friend", "father", "power",
+      "hour", "game", "line", "end", "member", "law", "car", "city",
+      "community", "name", "president", "team", "minute", "idea", "kid",
+      "body", "information", "back", "parent", "face", "others", "level",
+      "office", "door", "health", "person", "art", "war", "history",
+      "party", "result", "change", "morning", "reason", "research", "girl",
+      "guy", "moment", "air", "teacher", "force", "education", "foot",
+      "boy", "age", "policy", "music", "market", "sense", "nation", "plan",
+      "college", "interest", "death", "experience", "effect", "class",
+      "control", "care", "field", "development", "role", "effort", "rate",
+      "heart", "drug", "show", "leader", "light", "voice", "wife", "police",
+      "mind", "price", "report", "decision", "son", "view", "relationship",
+      "town", "road", "arm", "difference", "value", "building", "action",
+      "model", "season", "society", "tax", "director", "position", "player",
+      "record", "paper", "space", "ground", "form", "event", "official",
+      "matter", "center", "couple", "site", "project", "activity", "star",
+      "table", "need", "court", "oil", "situation", "cost", "industry",
+      "figure", "street", "image", "phone", "data", "picture", "practice",
+      "piece", "land", "product", "doctor", "wall", "patient", "worker",
+      "news", "test", "movie", "north", "love", "support", "technology",
+      "step", "baby", "computer", "type", "attention", "film", "tree",
+      "source", "organization", "hair", "window", "evidence", "population",
+      "listen", "silent", "enlist", "tinsel", "stop", "pots", "tops", "spot",
+      "post", "opts", "evil", "vile", "live", "veil", "act", "cat", "tac"};
+  const char *affixes[] = {"", "s", "ed", "ing", "er", "less", "ful", "ly",
+                           "un", "re", "pre", "over"};
+  size_t n_stems = sizeof (stems) / sizeof (stems[0]);
+  size_t n_affixes = sizeof (affixes) / sizeof (affixes[0]);
+
+  hash_func funcs[] = {hash_string, byte_sum_hash};
+  size_t max_chains[2];
+  int value = 0;
+  for (int f = 0; f < 2; ++f)
+    {
+      hashmap *map = hashmap_alloc (funcs[f]);
+      char word[64];
+      for (size_t i = 0; i < n_stems; i++)
+        for (size_t j = 0; j < n_affixes; j++)
+          {
+            // the first affixes are suffixes, the last ones prefixes
+            if (j < 8)
+              sprintf (word, "%s%s", stems[i], affixes[j]);
+            else
+              sprintf (word, "%s%s", affixes[j], stems[i]);
+            pair *p = pair_alloc (word, &value, &str_int_type);
+            if (!hashmap_insert_move (map, p))
+              pair_free ((void **) &p);
+          }
+      max_chains[f] = max_chain_length (map);
+      if (f == 0)
+        printf ("hash_string: %zu words, %zu buckets, max chain %zu "
+                "(byte-sum hash: ", map->size, map->capacity, max_chains[f]);
+      hashmap_free (&map);
+    }
+  printf ("%zu)\n", max_chains[1]);
+
+  // with a load factor <= 0.75, a uniform hash keeps the chains short:
+  assert (max_chains[0] <= 8
+          && "HASH-STRING-TEST: Words collided into long chains.");
+  assert (max_chains[0] < max_chains[1]
+          && "HASH-STRING-TEST: Worse than the byte-sum hash.");
+}
+
+/**
+ * This function checks the arena-backed hash maps of the hashmap library.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_arena (void)
+{
+  hashmap_backend backends[] = {HASHMAP_CHAINED, HASHMAP_OPEN_ADDRESSING,
+                                HASHMAP_COMPACT};
+  const pair_type *types[] = {&str_int_type, &counted_str_int_type};
+  for (int b = 0; b < 3; ++b)
+    for (int t = 0; t < 2; ++t)
+      {
+        hashmap *map = hashmap_alloc_arena (hash_string, backends[b]);
+        assert (map != NULL && map->arena != NULL
+                && "ARENA-TEST: Failed to allocate hash map");
+
+        // short keys are stored inline, long ones in the arena's slabs:
+        char key[64];
+        int value;
+        for (int j = 0; j < 2000; ++j)
+          {
+            sprintf (key, j % 2 ? "k%d" : "a-longer-key-in-the-slabs-%d", j);
+            value = j;
+            pair *p = pair_alloc (key, &value, types[t]);
+            int action_flag = j % 3 ? hashmap_insert (map, p)
+                                    : hashmap_insert_move (map, p);
+            assert (action_flag == SUCCESS
+                    && "ARENA-TEST: Failed to insert pair.");
+            if (j % 3)
+              pair_free ((void **) &p);
+          }
+        assert ((map->arena->heap_elements == 0) == (t == 0)
+                && "ARENA-TEST: Wrong count of elements out of the arena.");
+
+        // erase half, and reinsert them into the released blocks:
+        for (int round = 0; round < 2; ++round)
+          {
+            for (int j = 0; j < 2000; j += 2)
+              {
+                sprintf (key, "a-longer-key-in-the-slabs-%d", j);
+                int action_flag = hashmap_erase (map, key);
+                assert (action_flag == SUCCESS
+                        && "ARENA-TEST: Failed to erase pair.");
+              }
+            for (int j = 0; j < 2000; j += 2)
+              {
+                sprintf (key, "a-longer-key-in-the-slabs-%d", j);
+                value = j;
+                pair *p = pair_alloc (key, &value, types[t]);
+                int action_flag = hashmap_insert_move (map, p);
+                assert (action_flag == SUCCESS
+                        && "ARENA-TEST: Failed to reinsert pair.");
+              }
+          }
+        for (int j = 0; j < 2000; ++j)
+          {
+            sprintf (key, j % 2 ? "k%d" : "a-longer-key-in-the-slabs-%d", j);
+            assert (int_value_cmp (hashmap_at (map, key), &j)
+                    && "ARENA-TEST: Wrong value returned for inserted key.");
+          }
+
+        // an extracted pair is a heap copy, owned by the caller:
+        pair *out = hashmap_extract (map, "k1");
+        assert (out != NULL && str_key_cmp (out->key, "k1")
+                && hashmap_at (map, "k1") == NULL
+                && "ARENA-TEST: Failed to extract pair.");
+        pair_free ((void **) &out);
+        assert (map->size == 1999 && "ARENA-TEST: Wrong map size.");
+
+        // keys larger than the largest size class get slabs of their own:
+        size_t huge_sizes[] = {4097, 64 * 1024};
+        for (int h = 0; h < 2; ++h)
+          {
+            char *huge = malloc (huge_sizes[h]);
+            assert (huge != NULL && "ARENA-TEST: Failed to allocate key.");
+            memset (huge, 'h' + h, huge_sizes[h] - 1);
+            huge[huge_sizes[h] - 1] = '\0';
+            value = h;
+            pair *p = pair_alloc (huge, &value, types[t]);
+            int action_flag = hashmap_insert_move (map, p);
+            assert (action_flag == SUCCESS
+                    && int_value_cmp (hashmap_at (map, huge), &h)
+                    && "ARENA-TEST: Failed to insert a huge key.");
+            action_flag = hashmap_erase (map, huge);
+            assert (action_flag == SUCCESS && hashmap_at (map, huge) == NULL
+                    && "ARENA-TEST: Failed to erase a huge key.");
+            free (huge);
+          }
+
+        // the map's pairs are released with its slabs:
+        hashmap_free (&map);
+        assert (map == NULL && "ARENA-TEST: Failed to free the hash-map.");
+      }
+}
+
+/**
+ * This function checks the capacity management of the vector library:
+ * bulk insertion, reserve, shrink_to_fit, clear and policies.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_vector_capacity (void)
+{
+  vector *vec = vector_alloc (int_value_cpy, int_value_cmp, int_value_free);
+  assert (vec != NULL && "VECTOR-CAPACITY-TEST: Failed to allocate vector");
+
+  int values[1000];
+  const void *value_ptrs[1000];
+  for (int j = 0; j < 1000; ++j)
+    {
+      values[j] = j;
+      value_ptrs[j] = &values[j];
+    }
+
+  // a bulk insertion ends with the capacity of single insertions:
+  int action_flag = vector_push_back_n (vec, value_ptrs, 100);
+  assert (action_flag == SUCCESS
+          && vec->size == 100 && vec->capacity == 256
+          && "VECTOR-CAPACITY-TEST: Wrong bulk insertion.");
+  for (int j = 0; j < 100; ++j)
+    assert (int_value_cmp (vector_at (vec, j), &values[j])
+            && "VECTOR-CAPACITY-TEST: Wrong element after bulk insertion.");
+  const void *bad_values[] = {&values[0], NULL};
+  action_flag = vector_push_back_n (vec, bad_values, 2);
+  assert (action_flag == FAIL && vec->size == 100
+          && "VECTOR-CAPACITY-TEST: Failed bulk insertion changed vector.");
+  const void *grow_values[200];
+  for (int j = 0; j < 200; ++j)
+    grow_values[j] = j < 199 ? &values[j] : NULL;
+  action_flag = vector_push_back_n (vec, grow_values, 200);
+  assert (action_flag == FAIL && vec->size == 100 && vec->capacity == 256
+          && "VECTOR-CAPACITY-TEST: Failed bulk insertion grew vector.");
+
+  vector_clear (vec);
+  assert (vec->size == 0 && vec->capacity == VECTOR_INITIAL_CAP
+          && "VECTOR-CAPACITY-TEST: Clear didn't reset the vector.");
+
+  // no growth below the reserved capacity:
+  action_flag = vector_reserve (vec, 1000);
+  assert (action_flag == SUCCESS && vec->capacity == 1000
+          && "VECTOR-CAPACITY-TEST: Failed to reserve.");
+  for (int j = 0; j < 500; ++j)
+    vector_push_back (vec, &values[j]);
+  assert (vec->capacity == 1000
+          && "VECTOR-CAPACITY-TEST: Grew below the reserved capacity.");
+  action_flag = vector_shrink_to_fit (vec);
+  assert (action_flag == SUCCESS && vec->capacity == 500
+          && "VECTOR-CAPACITY-TEST: Failed to shrink to fit.");
+
+  // a tight policy: grow only when full, never decrease:
+  vector_policy invalid = {2, 1.0, 0.5};
+  action_flag = vector_set_policy (vec, invalid);
+  assert (action_flag == FAIL
+          && "VECTOR-CAPACITY-TEST: Invalid policy was set.");
+  vector_policy tight = {2, 1.0, 0.0};
+  action_flag = vector_set_policy (vec, tight);
+  assert (action_flag == SUCCESS
+          && "VECTOR-CAPACITY-TEST: Failed to set policy.");
+  for (int j = 500; j < 1000; ++j)
+    vector_push_back (vec, &values[j]);
+  assert (vec->size == 1000 && vec->capacity == 1000
+          && "VECTOR-CAPACITY-TEST: Tight policy over-allocated.");
+  while (vec->size > 1)
+    vector_erase (vec, 0);
+  assert (vec->capacity == 1000
+          && "VECTOR-CAPACITY-TEST: Policy without decreasing decreased.");
+  assert (vector_find (vec, &values[1]) == 0
+          && "VECTOR-CAPACITY-TEST: Wrong element left.");
+
+  vector_free (&vec);
+  assert (vec == NULL && "VECTOR-CAPACITY-TEST: Failed to free the vector.");
+
+  // a growth factor above the capacity never shrinks it to 0:
+  vec = vector_alloc (int_value_cpy, int_value_cmp, int_value_free);
+  vector_policy triple = {3, 0.75, 0.2};
+  action_flag = vector_set_policy (vec, triple);
+  assert (action_flag == SUCCESS
+          && "VECTOR-CAPACITY-TEST: Failed to set policy.");
+  vector_push_back (vec, &values[0]);
+  vector_push_back (vec, &values[1]);
+  action_flag = vector_shrink_to_fit (vec);
+  assert (action_flag == SUCCESS && vec->capacity == 2
+          && "VECTOR-CAPACITY-TEST: Failed to shrink to fit.");
+  vector_erase (vec, 0);
+  vector_erase (vec, 0);
+  assert (vec->size == 0 && vec->capacity == 1
+          && "VECTOR-CAPACITY-TEST: Shrank below one element.");
+  action_flag = vector_push_back (vec, &values[2]);
+  assert (action_flag == SUCCESS
+          && int_value_cmp (vector_at (vec, 0), &values[2])
+          && "VECTOR-CAPACITY-TEST: Failed to push after shrinking.");
+  vector_free (&vec);
+}
+
+/**
+ * Number of elements released by the counting destroy hook below.
+ */
+static int destroyed_elems = 0;
+
+/**
+ * Destroy hook of a by-value vector of char pointers: frees the string.
+ */
+static void destroy_owned_str (void *elem)
+{
+  free (*((char **) elem));
+  destroyed_elems++;
+}
+
+/**
+ * This function checks the by-value vectors of the vector library.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_vector_by_value (void)
+{
+  vector *vec = vector_alloc_by_value (sizeof (int), NULL, NULL, NULL);
+  assert (vec != NULL && "VECTOR-BY-VALUE-TEST: Failed to allocate vector");
+
+  for (int j = 0; j < 1000; ++j)
+    {
+      int action_flag = vector_push_back (vec, &j);
+      assert (action_flag == SUCCESS
+              && "VECTOR-BY-VALUE-TEST: Failed to push back.");
+    }
+
+  // the elements are stored contiguously, by value:
+  int *first = vector_at (vec, 0);
+  for (int j = 0; j < 1000; ++j)
+    assert ((int *) vector_at (vec, j) == first + j && first[j] == j
+            && "VECTOR-BY-VALUE-TEST: Elements are not contiguous.");
+  int key = 765;
+  assert (vector_find (vec, &key) == 765
+          && "VECTOR-BY-VALUE-TEST: Failed to find element.");
+  int action_flag = vector_push_back_ptr (vec, &key);
+  void *extracted = vector_extract (vec, 0);
+  assert (action_flag == FAIL && extracted == NULL
+          && "VECTOR-BY-VALUE-TEST: Pointer operations on by-value vector.");
+
+  // erasing moves the last element into the hole:
+  action_flag = vector_erase (vec, 0);
+  assert (action_flag == SUCCESS
+          && *((int *) vector_at (vec, 0)) == 999 && vec->size == 999
+          && "VECTOR-BY-VALUE-TEST: Failed to erase element.");
+  while (vec->size > 0)
+    vector_erase (vec, vec->size - 1);
+  assert (vec->capacity < 1000
+          && "VECTOR-BY-VALUE-TEST: Vector didn't decrease.");
+  vector_free (&vec);
+
+  // elements owning memory are released by the destroy hook:
+  vec = vector_alloc_by_value (sizeof (char *), NULL, NULL,
+                               destroy_owned_str);
+  for (int j = 0; j < 40; ++j)
+    {
+      char *s = str_key_cpy ("owned");
+      vector_push_back (vec, &s);
+    }
+  vector_erase (vec, 3);
+  assert (destroyed_elems == 1
+          && "VECTOR-BY-VALUE-TEST: Erased element wasn't destroyed.");
+  vector_clear (vec);
+  assert (destroyed_elems == 40 && vec->size == 0
+          && "VECTOR-BY-VALUE-TEST: Cleared elements weren't destroyed.");
+  vector_free (&vec);
+  assert (vec == NULL && "VECTOR-BY-VALUE-TEST: Failed to free the vector.");
+}
+
+static inline size_t int_hash (int key)
+{
+  return (size_t) key;
+}
+
+static inline int int_eq (int a, int b)
+{
+  return a == b;
+}
+
+HASHMAP_DECLARE (int_map, int, int, int_hash, int_eq)
+
+static int is_even_key (const int *key)
+{
+  return *key % 2 == 0;
+}
+
+static void negate_value (int *value)
+{
+  *value = -*value;
+}
+
+/**
+ * This function checks the maps generated by HASHMAP_DECLARE.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_typed_hashmap (void)
+{
+  int_map *map = int_map_alloc ();
+  assert (map != NULL && "TYPED-TEST: Failed to allocate hash map");
+
+  for (int j = 0; j < 1000; ++j)
+    {
+      int insertion_flag = int_map_insert (map, j, j * j);
+      assert (insertion_flag == SUCCESS && "TYPED-TEST: Failed to insert.");
+    }
+  int action_flag = int_map_insert (map, 7, 0);
+  assert (action_flag == FAIL && *int_map_at (map, 7) == 49
+          && "TYPED-TEST: Inserted an existing key.");
+  assert (map->size == 1000
+          && int_map_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR
+          && "TYPED-TEST: Map didn't grow.");
+  for (int j = 0; j < 1000; ++j)
+    assert (*int_map_at (map, j) == j * j && "TYPED-TEST: Wrong value.");
+  assert (int_map_at (map, 1000) == NULL
+          && "TYPED-TEST: Found a missing key.");
+
+  // get_or_insert counts in place:
+  for (int j = 0; j < 10; ++j)
+    *int_map_get_or_insert (map, 5000, 0) += 1;
+  assert (*int_map_at (map, 5000) == 10
+          && "TYPED-TEST: get_or_insert didn't count.");
+
+  int changes = int_map_apply_if (map, is_even_key, negate_value);
+  assert (changes == 501 && *int_map_at (map, 4) == -16
+          && *int_map_at (map, 3) == 9
+          && "TYPED-TEST: Failed to apply.");
+
+  size_t pos = 0, visited = 0;
+  int *key, *value;
+  while (int_map_next (map, &pos, &key, &value))
+    {
+      assert (*int_map_at (map, *key) == *value
+              && "TYPED-TEST: Iteration returned a wrong entry.");
+      visited++;
+    }
+  assert (visited == map->size && "TYPED-TEST: Iteration missed entries.");
+
+  for (int j = 0; j < 1000; ++j)
+    {
+      action_flag = int_map_erase (map, j);
+      assert (action_flag == SUCCESS && "TYPED-TEST: Failed to erase.");
+    }
+  action_flag = int_map_erase (map, 3);
+  assert (action_flag == FAIL && map->size == 1
+          && *int_map_at (map, 5000) == -10
+          && "TYPED-TEST: Erased a missing key.");
+  assert (map->capacity < 1000 && "TYPED-TEST: Map didn't decrease.");
+  int_map_free (&map);
+  assert (map == NULL && "TYPED-TEST: Failed to free the map.");
+}
+
+/**
+ * This function checks the hashmap_at_batch and hashmap_insert_batch
+ * functions, on both backends.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_batch (void)
+{
+  for (int backend = 0; backend <= HASHMAP_COMPACT; ++backend)
+    {
+      hashmap *map = hashmap_alloc_backend (hash_string, backend);
+      char keys[300][8];
+      pair *pairs[300];
+      const_keyT lookup[301];
+      valueT values[301];
+      for (int j = 0; j < 300; ++j)
+        {
+          snprintf (keys[j], sizeof (keys[j]), "k%d", j % 250);
+          pairs[j] = pair_alloc (keys[j], &j, &str_int_type);
+          lookup[j] = keys[j];
+        }
+      lookup[300] = "missing";
+
+      // the last 50 keys repeat earlier ones of the batch:
+      size_t inserted = hashmap_insert_batch (
+          map, (const pair *const *) pairs, 300);
+      assert (inserted == 250 && map->size == 250
+              && "BATCH-TEST: Failed to insert the batch.");
+      assert (hashmap_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR
+              && "BATCH-TEST: Map didn't grow.");
+      size_t found = hashmap_at_batch (map, lookup, 301, values);
+      assert (found == 300 && values[300] == NULL
+              && "BATCH-TEST: Failed to look the batch up.");
+      for (int j = 0; j < 300; ++j)
+        assert (*(int *) values[j] == j % 250
+                && values[j] == hashmap_at (map, keys[j])
+                && "BATCH-TEST: Wrong value.");
+      // a batch of keys already in the map doesn't grow it:
+      size_t capacity = map->capacity;
+      inserted = hashmap_insert_batch (map, (const pair *const *) pairs,
+                                       300);
+      assert (inserted == 0 && "BATCH-TEST: Inserted existing keys.");
+      assert (map->capacity == capacity
+              && "BATCH-TEST: Grew for existing keys.");
+
+      for (int j = 0; j < 300; ++j)
+        pair_free ((void **) &pairs[j]);
+      hashmap_free (&map);
+    }
+}
+
+/**
+ * @struct decay_ctx
+ * The context of the parallel apply test: keys of key_len chars are
+ * multiplied by factor.
+ */
+typedef struct decay_ctx {
+    size_t key_len;
+    int factor;
+} decay_ctx;
+
+static int key_len_is (const_keyT key, void *ctx)
+{
+  return strlen (key) == ((decay_ctx *) ctx)->key_len;
+}
+
+static void multiply_by (valueT value, void *ctx)
+{
+  *(int *) value *= ((decay_ctx *) ctx)->factor;
+}
+
+/**
+ * This function checks the hashmap_apply_if_parallel function, on both
+ * backends and several thread counts.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_apply_if_parallel (void)
+{
+  for (int backend = 0; backend <= HASHMAP_COMPACT; ++backend)
+    {
+      hashmap *map = hashmap_alloc_backend (hash_string, backend);
+      char key[8];
+      for (int j = 0; j < 1000; ++j)
+        {
+          snprintf (key, sizeof (key), "k%d", j);
+          pair *p = pair_alloc (key, &j, &str_int_type);
+          hashmap_insert_move (map, p);
+        }
+
+      // keys "k100".."k999" are 4 chars long:
+      decay_ctx ctx = {4, 2};
+      size_t threads[] = {0, 1, 3, 8};
+      for (size_t t = 0; t < sizeof (threads) / sizeof (*threads); ++t)
+        {
+          int changes = hashmap_apply_if_parallel (map, threads[t],
+                                                   key_len_is, multiply_by,
+                                                   &ctx);
+          assert (changes == 900
+                  && "APPLY-IF-PARALLEL-TEST: Wrong number of changes.");
+        }
+      for (int j = 0; j < 1000; ++j)
+        {
+          snprintf (key, sizeof (key), "k%d", j);
+          assert (*(int *) hashmap_at (map, key) == (j < 100 ? j : j * 16)
+                  && "APPLY-IF-PARALLEL-TEST: Wrong value.");
+        }
+      int changes = hashmap_apply_if_parallel (NULL, 4, key_len_is,
+                                               multiply_by, &ctx);
+      assert (changes == 0
+              && "APPLY-IF-PARALLEL-TEST: Applied on NULL map.");
+      hashmap_free (&map);
+    }
+}
+
+/**
+ * @struct writer_job
+ * The work of one writer thread of the concurrent map test.
+ */
+typedef struct writer_job {
+    concurrent_hashmap *map;
+    int first;
+} writer_job;
+
+static void increment (valueT value, void *ctx)
+{
+  (void) ctx;
+  (*(int *) value)++;
+}
+
+static int any_key (const_keyT key, void *ctx)
+{
+  (void) key;
+  (void) ctx;
+  return 1;
+}
+
+/**
+ * Inserts 1000 keys of its own, and counts 1000 times the keys shared by
+ * all the writers.
+ */
+static void *concurrent_writer (void *arg)
+{
+  writer_job *job = arg;
+  char key[16];
+  int zero = 0;
+  for (int j = job->first; j < job->first + 1000; ++j)
+    {
+      snprintf (key, sizeof (key), "own-%d", j);
+      pair *p = pair_alloc (key, &j, &str_int_type);
+      int insertion_flag = concurrent_hashmap_insert_move (job->map, p);
+      assert (insertion_flag == SUCCESS
+              && "CONCURRENT-TEST: Failed to insert.");
+
+      snprintf (key, sizeof (key), "shared-%d", j % 10);
+      while (!concurrent_hashmap_update (job->map, key, increment, NULL))
+        {
+          // first writer to count this key inserts it, the others retry
+          pair *shared = pair_alloc (key, &zero, &str_int_type);
+          if (!concurrent_hashmap_insert_move (job->map, shared))
+            pair_free ((void **) &shared);
+        }
+    }
+  return NULL;
+}
+
+/**
+ * This function checks the concurrent hash map, with several writers.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_concurrent_hashmap (void)
+{
+  for (int backend = 0; backend <= HASHMAP_COMPACT; ++backend)
+    {
+      concurrent_hashmap *map = concurrent_hashmap_alloc (hash_string,
+                                                          backend, 6);
+      assert (map != NULL && map->shard_count == 8
+              && "CONCURRENT-TEST: Failed to allocate the map.");
+
+      pthread_t threads[4];
+      writer_job jobs[4];
+      for (int t = 0; t < 4; ++t)
+        {
+          jobs[t] = (writer_job) {map, t * 1000};
+          pthread_create (&threads[t], NULL, concurrent_writer, &jobs[t]);
+        }
+      for (int t = 0; t < 4; ++t)
+        pthread_join (threads[t], NULL);
+
+      assert (concurrent_hashmap_size (map) == 4010
+              && "CONCURRENT-TEST: Wrong size.");
+      assert (*(int *) concurrent_hashmap_at (map, "own-3999") == 3999
+              && *(int *) concurrent_hashmap_at (map, "shared-7") == 400
+              && "CONCURRENT-TEST: Wrong value.");
+      int changes = concurrent_hashmap_apply_if (map, any_key, increment,
+                                                 NULL);
+      assert (changes == 4010
+              && *(int *) concurrent_hashmap_at (map, "own-0") == 1
+              && "CONCURRENT-TEST: Failed to apply.");
+      int action_flag = concurrent_hashmap_erase (map, "own-0");
+      int second_flag = concurrent_hashmap_erase (map, "own-0");
+      assert (action_flag == SUCCESS && second_flag == FAIL
+              && concurrent_hashmap_at (map, "own-0") == NULL
+              && "CONCURRENT-TEST: Failed to erase.");
+      concurrent_hashmap_free (&map);
+      assert (map == NULL && "CONCURRENT-TEST: Failed to free the map.");
+    }
+}
+
+/**
+ * This function checks the iterator API, and the insertion order of the
+ * compact backend.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_iter (void)
+{
+  for (int backend = 0; backend <= HASHMAP_COMPACT; ++backend)
+    {
+      hashmap *map = hashmap_alloc_backend (hash_string, backend);
+      hashmap_iter iter = hashmap_iter_begin (map);
+      pair *first = hashmap_iter_next (&iter);
+      assert (first == NULL && "ITER-TEST: Iterated an empty map.");
+
+      char key[16];
+      for (int j = 0; j < 1000; ++j)
+        {
+          snprintf (key, sizeof (key), "k%d", j);
+          pair *p = pair_alloc (key, &j, &str_int_type);
+          hashmap_insert_move (map, p);
+        }
+      // erase every key but multiples of 5 (the compact entries keep holes,
+      // then get compacted):
+      for (int j = 0; j < 1000; ++j)
+        if (j % 5)
+          {
+            snprintf (key, sizeof (key), "k%d", j);
+            hashmap_erase (map, key);
+          }
+
+      int visited = 0, last = -1;
+      iter = hashmap_iter_begin (map);
+      for (pair *p = hashmap_iter_next (&iter); p != NULL;
+           p = hashmap_iter_next (&iter))
+        {
+          int value = *(int *) p->value;
+          assert (value % 5 == 0 && hashmap_at (map, p->key) == p->value
+                  && "ITER-TEST: Iteration returned a wrong pair.");
+          if (backend == HASHMAP_COMPACT)
+            assert (value > last && "ITER-TEST: Lost the insertion order.");
+          last = value;
+          visited++;
+        }
+      pair *after_end = hashmap_iter_next (&iter);
+      assert (visited == 200 && after_end == NULL
+              && "ITER-TEST: Iteration missed pairs.");
+      if (backend == HASHMAP_COMPACT)
+        assert (map->entries_used <= 2 * map->size
+                && "ITER-TEST: Compact entries weren't compacted.");
+
+      // a cursor may stop early:
+      iter = hashmap_iter_begin (map);
+      first = hashmap_iter_next (&iter);
+      pair *second = hashmap_iter_next (&iter);
+      assert (first != NULL && second != NULL && first != second
+              && "ITER-TEST: Failed to start an iteration.");
+      hashmap_free (&map);
+    }
+}
+
+/**
+ * This function checks the hashmap_stats function, for all backends: the
+ * histogram, the memory and (with HASHMAP_STATS) the running counters.
+ * If hashmap_stats fails at some points, the functions exits with exit
+ * code 1.
+ */
+void test_hash_map_stats (void)
+{
+  hashmap_backend backends[] = {HASHMAP_CHAINED, HASHMAP_OPEN_ADDRESSING,
+                                HASHMAP_COMPACT};
+  hashmap_statistics stats;
+  char key[64];
+  for (int b = 0; b < 3; ++b)
+    {
+      hashmap *map = hashmap_alloc_backend (hash_string, backends[b]);
+      size_t key_bytes = 0;
+      for (int j = 0; j < 2000; ++j)
+        {
+          // some keys are too long to be stored inline
+          snprintf (key, sizeof (key), j % 10 ? "key-%d" : "%030d", j);
+          if (strlen (key) + 1 > PAIR_INLINE_MAX)
+            key_bytes += strlen (key) + 1;
+          pair *p = pair_alloc (key, &j, &str_int_type);
+          hashmap_insert_move (map, p);
+        }
+      int stats_flag = hashmap_stats (map, &stats);
+      assert (stats_flag == SUCCESS
+              && stats.size == 2000 && stats.capacity == map->capacity
+              && "STATS-TEST: Failed to report the stats.");
+
+      // every bucket (chained) or pair (probing) falls in a bin:
+      size_t binned = 0;
+      for (int i = 0; i < HASH_MAP_STATS_BINS; ++i)
+        binned += stats.histogram[i];
+      if (backends[b] == HASHMAP_CHAINED)
+        assert (binned == stats.buckets && stats.buckets == stats.capacity
+                && stats.used_buckets == stats.buckets - stats.histogram[0]
+                && stats.vector_bytes > 0
+                && "STATS-TEST: Wrong chained histogram.");
+      else
+        assert (binned == stats.size && stats.histogram[0] == 0
+                && stats.histogram[1] > stats.size / 2
+                && stats.vector_bytes == 0
+                && "STATS-TEST: Wrong probe histogram.");
+      assert (stats.max_bucket >= 1 && stats.used_buckets > 0
+              && stats.used_buckets <= stats.buckets
+              && "STATS-TEST: Wrong bucket lengths.");
+
+      assert (stats.key_bytes == key_bytes && stats.value_bytes == 0
+              && stats.pair_bytes >= stats.size * sizeof (pair)
+              && stats.table_bytes >= stats.capacity * sizeof (uint32_t)
+              && stats.total_bytes == sizeof (hashmap) + stats.table_bytes
+                                      + stats.vector_bytes
+                                      + stats.pair_bytes + stats.key_bytes
+                                      + stats.value_bytes
+              && "STATS-TEST: Wrong memory.");
+
+      // the running counters count only with HASHMAP_STATS:
+      size_t lookups = stats.lookups, key_cmps = stats.key_cmps;
+      for (int j = 0; j < 2000; ++j)
+        {
+          snprintf (key, sizeof (key), j % 10 ? "key-%d" : "%030d", j);
+          assert (hashmap_at (map, key) != NULL
+                  && "STATS-TEST: Failed to find a key.");
+        }
+      hashmap_stats (map, &stats);
+#ifdef HASHMAP_STATS
+      assert (stats.resizes >= 7 && stats.lookups - lookups == 2000
+              && stats.key_cmps - key_cmps == 2000
+              && "STATS-TEST: Wrong running counters.");
+#else
+      assert (stats.resizes == 0 && stats.resize_ns == 0
+              && stats.lookups == 0 && lookups == 0
+              && stats.key_cmps == 0 && key_cmps == 0
+              && "STATS-TEST: Counted without HASHMAP_STATS.");
+#endif
+
+      // erased pairs leave tombstones (holes) behind:
+      for (int j = 0; j < 1000; ++j)
+        {
+          snprintf (key, sizeof (key), j % 10 ? "key-%d" : "%030d", j);
+          hashmap_erase (map, key);
+        }
+      hashmap_stats (map, &stats);
+      if (backends[b] == HASHMAP_OPEN_ADDRESSING)
+        assert (stats.tombstones == map->tombstones
+                && "STATS-TEST: Wrong tombstones.");
+      else if (backends[b] == HASHMAP_COMPACT)
+        assert (stats.tombstones == map->entries_used - map->size
+                && "STATS-TEST: Wrong holes.");
+      else
+        assert (stats.tombstones == 0 && "STATS-TEST: Wrong tombstones.");
+      hashmap_free (&map);
+    }
+
+  // a collapsed hash puts all the pairs in one bucket:
+  hashmap *map = hashmap_alloc (hash_const);
+  for (int j = 0; j < 100; ++j)
+    {
+      snprintf (key, sizeof (key), "key-%d", j);
+      pair *p = pair_alloc (key, &j, &str_int_type);
+      hashmap_insert_move (map, p);
+    }
+  int stats_flag = hashmap_stats (map, &stats);
+  assert (stats_flag == SUCCESS && stats.used_buckets == 1
+          && stats.max_bucket == 100
+          && stats.histogram[HASH_MAP_STATS_BINS - 1] == 1
+          && stats.histogram[0] == stats.capacity - 1
+          && "STATS-TEST: Wrong collapsed histogram.");
+  stats_flag = hashmap_stats (NULL, &stats);
+  assert (stats_flag == FAIL && "STATS-TEST: Reported the stats of NULL.");
+  stats_flag = hashmap_stats (map, NULL);
+  assert (stats_flag == FAIL && "STATS-TEST: Reported the stats of NULL.");
+  hashmap_free (&map);
+}
+
+/**
+ * This function checks the hashmap_save and hashmap_open_mmap functions.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_snapshot (void)
+{
+  const char *path = "test_suite.snapshot";
+  const hashmap_codec double_codec = {NULL, sizeof (double)};
+  hashmap *map = hashmap_alloc_backend (hash_string, HASHMAP_COMPACT);
+  char key[64];
+  for (int j = 0; j < 1000; ++j)
+    {
+      // some keys are longer than the lookup's stack buffer
+      snprintf (key, sizeof (key), j % 100 ? "key-%d" : "%060d", j);
+      double value = j / 4.0;
+      pair *p = pair_alloc (key, &value, &str_double_type);
+      hashmap_insert_move (map, p);
+    }
+  int save_flag = hashmap_save (map, path, &hashmap_string_codec,
+                                &double_codec);
+  assert (save_flag == SUCCESS && "SNAPSHOT-TEST: Failed to save the map.");
+
+  hashmap_snapshot *snapshot = hashmap_open_mmap (path,
+                                                  &hashmap_string_codec);
+  assert (snapshot != NULL && hashmap_snapshot_size (snapshot) == 1000
+          && "SNAPSHOT-TEST: Failed to open the snapshot.");
+  for (int j = 0; j < 1000; ++j)
+    {
+      snprintf (key, sizeof (key), j % 100 ? "key-%d" : "%060d", j);
+      const double *value = hashmap_snapshot_at (snapshot, key);
+      assert (value != NULL && *value == j / 4.0
+              && "SNAPSHOT-TEST: Wrong value.");
+    }
+  assert (hashmap_snapshot_at (snapshot, "key-1000") == NULL
+          && hashmap_snapshot_at (snapshot, "") == NULL
+          && "SNAPSHOT-TEST: Found a missing key.");
+  hashmap_snapshot_close (&snapshot);
+  assert (snapshot == NULL && "SNAPSHOT-TEST: Failed to close.");
+  hashmap_free (&map);
+
+  // an empty map, and a file which is not a snapshot:
+  map = hashmap_alloc (hash_string);
+  save_flag = hashmap_save (map, path, &hashmap_string_codec,
+                            &double_codec);
+  assert (save_flag == SUCCESS
+          && "SNAPSHOT-TEST: Failed to save an empty map.");
+  snapshot = hashmap_open_mmap (path, &hashmap_string_codec);
+  assert (snapshot != NULL && hashmap_snapshot_size (snapshot) == 0
+          && hashmap_snapshot_at (snapshot, "key-1") == NULL
+          && "SNAPSHOT-TEST: Wrong empty snapshot.");
+  hashmap_snapshot_close (&snapshot);
+  hashmap_free (&map);
+
+  FILE *file = fopen (path, "w");
+  fputs ("not a snapshot, just some text long enough for a header", file);
+  fclose (file);
+  snapshot = hashmap_open_mmap (path, &hashmap_string_codec);
+  assert (snapshot == NULL && "SNAPSHOT-TEST: Opened an invalid file.");
+  snapshot = hashmap_open_mmap ("no-such.snapshot", &hashmap_string_codec);
+  assert (snapshot == NULL && "SNAPSHOT-TEST: Opened a missing file.");
+  remove (path);
+}
+
+/**
+ * @return the id of the given word in the chain, UINT32_MAX if not in it.
+ */
+static uint32_t word_id (const markov_chain *chain, const char *word)
+{
+  return symtab_lookup (chain->words, word, strlen (word));
+}
+
+/**
+ * This function checks the training and generation of the markov chain.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain (void)
+{
+  markov_chain *chain = markov_chain_alloc ();
+  assert (chain != NULL && "MARKOV-TEST: Failed to allocate the chain");
+
+  char lines[][64] = {"just do it.\n", "just do more. now\n",
+                      "do it now\n", "a-word-longer-than-inline-storage do"};
+  for (size_t i = 0; i < sizeof (lines) / sizeof (*lines); ++i)
+    {
+      int train_flag = markov_chain_train_line (chain, lines[i], NULL);
+      assert (train_flag == SUCCESS && "MARKOV-TEST: Failed to train.");
+    }
+  assert (markov_chain_size (chain) == 7 && chain->tokens == 12
+          && chain->starts == 5 && "MARKOV-TEST: Wrong states.");
+
+  // "do" was followed by "it." once, "more." once, "it" once:
+  const markov_state *state_do = markov_chain_state (chain,
+                                                     word_id (chain, "do"));
+  assert (state_do->total == 3 && state_do->followers->size == 3
+          && *follower_map_at (state_do->followers,
+                               word_id (chain, "more.")) == 1
+          && "MARKOV-TEST: Wrong followers.");
+  // an end word has no followers, even when a word comes after it:
+  const markov_state *state_more = markov_chain_state (
+      chain, word_id (chain, "more."));
+  assert (state_more->is_end && state_more->total == 0
+          && state_more->followers == NULL
+          && "MARKOV-TEST: End word has followers.");
+  assert (strcmp (markov_chain_word (chain, 6),
+                  "a-word-longer-than-inline-storage") == 0
+          && "MARKOV-TEST: Wrong word.");
+
+  // every generated tweet follows the trained transitions:
+  uint32_t ids[4];
+  markov_rng rng;
+  markov_rng_seed (&rng, 7, 0);
+  for (int j = 0; j < 200; ++j)
+    {
+      size_t length = markov_chain_generate (chain, ids, 4, &rng);
+      assert (length >= 1 && length <= 4
+              && !markov_chain_state (chain, ids[0])->is_end
+              && "MARKOV-TEST: Wrong tweet length.");
+      for (size_t k = 1; k < length; ++k)
+        {
+          const markov_state *prev = markov_chain_state (chain, ids[k - 1]);
+          assert (!prev->is_end
+                  && follower_map_at (prev->followers, ids[k]) != NULL
+                  && "MARKOV-TEST: Generated an unseen transition.");
+        }
+    }
+
+  // compiled, the states draw their followers from alias tables, by the
+  // same frequencies ("do" -> "it.", "more.", "it" once each):
+  int compile_flag = markov_chain_compile (chain);
+  assert (compile_flag == SUCCESS && chain->dirty->size == 0
+          && !state_do->dirty && state_do->alias->size == 3
+          && "MARKOV-TEST: Failed to compile.");
+  char more[] = "do it. do it. do it. do it. do it. do it. do it.";
+  int train_flag = markov_chain_train_line (chain, more, NULL);
+  assert (train_flag == SUCCESS && state_do->dirty
+          && chain->dirty->size == 1
+          && "MARKOV-TEST: Failed to mark a state dirty.");
+  compile_flag = markov_chain_compile (chain);
+  assert (compile_flag == SUCCESS && !state_do->dirty
+          && "MARKOV-TEST: Failed to recompile a dirty state.");
+  uint32_t id_do = word_id (chain, "do"), id_end = word_id (chain, "it.");
+  int drawn_end = 0;
+  for (int j = 0; j < 10000; ++j)
+    {
+      uint32_t next = markov_chain_next (chain, id_do, &rng);
+      assert (follower_map_at (state_do->followers, next) != NULL
+              && "MARKOV-TEST: Drew an unseen follower.");
+      drawn_end += next == id_end;
+    }
+  // "it." followed "do" 8 times out of 10:
+  assert (drawn_end > 7500 && drawn_end < 8500
+          && "MARKOV-TEST: Wrong alias table frequencies.");
+
+  // a limited number of words:
+  markov_chain_free (&chain);
+  chain = markov_chain_alloc ();
+  char line[] = "one two three four";
+  size_t words_left = 2;
+  markov_chain_train_line (chain, line, &words_left);
+  assert (words_left == 0 && markov_chain_size (chain) == 2
+          && "MARKOV-TEST: Trained past the words limit.");
+  markov_chain_free (&chain);
+  assert (chain == NULL && "MARKOV-TEST: Failed to free the chain.");
+}
+
+/**
+ * Checks the lines a corpus reader yields for the corpus of test_corpus.
+ */
+static void check_corpus_lines (corpus_reader *reader)
+{
+  const char *expected[][3] = {{"just", "do", "it."}, {NULL},
+                               {"a", "b", NULL}, {"last", NULL}};
+  const token_view *tokens;
+  size_t n;
+  for (size_t i = 0; i < sizeof (expected) / sizeof (*expected); ++i)
+    {
+      int read_flag = corpus_next_line (reader, &tokens, &n);
+      assert (read_flag == SUCCESS && "CORPUS-TEST: Missing line.");
+      size_t j = 0;
+      for (; j < 3 && expected[i][j] != NULL; ++j)
+        assert (j < n && tokens[j].len == strlen (expected[i][j])
+                && memcmp (tokens[j].ptr, expected[i][j], tokens[j].len) == 0
+                && "CORPUS-TEST: Wrong token.");
+      assert (n == j && "CORPUS-TEST: Wrong number of tokens.");
+    }
+  int read_flag = corpus_next_line (reader, &tokens, &n);
+  assert (read_flag == FAIL && !reader->error
+          && "CORPUS-TEST: Read past the corpus.");
+}
+
+/**
+ * This function checks the corpus reader, and the training of the markov chain on it.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_corpus (void)
+{
+  const char *path = "test_suite.corpus";
+  const char text[] = "just do it.\n\n  a\tb\r\nlast";
+  FILE *file = fopen (path, "w");
+  assert (file != NULL && "CORPUS-TEST: Failed to create the corpus.");
+  int written = fputs (text, file);
+  int closed = fclose (file);
+  assert (written >= 0 && closed == 0
+          && "CORPUS-TEST: Failed to write the corpus.");
+
+  // a regular file is mapped:
+  corpus_reader *reader = corpus_open (path);
+  assert (reader != NULL && reader->buffer == NULL
+          && "CORPUS-TEST: Failed to map the corpus.");
+  check_corpus_lines (reader);
+  corpus_close (&reader);
+  assert (reader == NULL && "CORPUS-TEST: Failed to close the corpus.");
+
+  // a pipe is read:
+  int fds[2];
+  int pipe_flag = pipe (fds);
+  assert (pipe_flag == 0 && "CORPUS-TEST: Failed to create the pipe.");
+  ssize_t sent = write (fds[1], text, sizeof (text) - 1);
+  closed = close (fds[1]);
+  assert (sent == sizeof (text) - 1 && closed == 0
+          && "CORPUS-TEST: Failed to write the pipe.");
+  reader = corpus_open_fd (fds[0]);
+  assert (reader != NULL && reader->buffer != NULL
+          && "CORPUS-TEST: Failed to open the pipe.");
+  check_corpus_lines (reader);
+  corpus_close (&reader);
+
+  // a too long line is split:
+  file = fopen (path, "w");
+  for (size_t i = 0; i <= CORPUS_MAX_TOKENS; ++i)
+    fputs ("w ", file);
+  fputs ("\nnext\n", file);
+  fclose (file);
+  reader = corpus_open (path);
+  const token_view *tokens;
+  size_t n;
+  int read_flag = corpus_next_line (reader, &tokens, &n);
+  assert (read_flag == SUCCESS && n == CORPUS_MAX_TOKENS
+          && "CORPUS-TEST: Wrong long line split.");
+  read_flag = corpus_next_line (reader, &tokens, &n);
+  assert (read_flag == SUCCESS && n == 1
+          && "CORPUS-TEST: Wrong long line split.");
+  read_flag = corpus_next_line (reader, &tokens, &n);
+  assert (read_flag == SUCCESS && n == 1 && tokens[0].len == 4
+          && "CORPUS-TEST: Wrong long line split.");
+  corpus_close (&reader);
+
+  // training on the corpus equals training on its lines:
+  file = fopen (path, "w");
+  fputs ("just do it.\njust do more. now\ndo it now\n"
+         "a-word-longer-than-inline-storage do", file);
+  fclose (file);
+  markov_chain *chain = markov_chain_alloc ();
+  reader = corpus_open (path);
+  int train_flag = markov_chain_train_corpus (chain, reader, 0);
+  assert (train_flag == SUCCESS
+          && markov_chain_size (chain) == 7 && chain->tokens == 12
+          && chain->starts == 5 && "CORPUS-TEST: Wrong training.");
+  const markov_state *state_do = markov_chain_state (chain,
+                                                     word_id (chain, "do"));
+  assert (state_do->total == 3
+          && strcmp (markov_chain_word (chain, word_id (chain, "do")),
+                     "do") == 0
+          && "CORPUS-TEST: Wrong followers.");
+  corpus_close (&reader);
+  markov_chain_free (&chain);
+  remove (path);
+}
+
+/**
+ * This function checks the interning of strings by the symtab library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_symtab (void)
+{
+  symtab *table = symtab_alloc ();
+  assert (table != NULL && "SYMTAB-TEST: Failed to allocate the table");
+
+  // ids are dense, in first-interning order, and a view is enough:
+  const char text[] = "the cat the hat";
+  uint32_t ids[] = {symtab_intern (table, text, 3),
+                    symtab_intern (table, text + 4, 3),
+                    symtab_intern (table, text + 8, 3),
+                    symtab_intern (table, text + 12, 3)};
+  assert (ids[0] == 0 && ids[1] == 1 && ids[2] == 0 && ids[3] == 2
+          && symtab_size (table) == 3 && "SYMTAB-TEST: Wrong ids.");
+  assert (strcmp (symtab_word (table, 1), "cat") == 0
+          && symtab_lookup (table, "hat", 3) == 2
+          && symtab_lookup (table, "ha", 2) == SYMTAB_NO_ID
+          && symtab_lookup (table, "hats", 4) == SYMTAB_NO_ID
+          && symtab_size (table) == 3 && "SYMTAB-TEST: Wrong lookup.");
+
+  // many strings, and one longer than the stack buffer:
+  char word[32];
+  for (int j = 0; j < 5000; ++j)
+    {
+      int len = sprintf (word, "w%d", j);
+      uint32_t interned = symtab_intern (table, word, (size_t) len);
+      assert (interned == (uint32_t) j + 3 && "SYMTAB-TEST: Wrong id.");
+    }
+  char long_word[1000];
+  memset (long_word, 'x', sizeof (long_word));
+  uint32_t id = symtab_intern (table, long_word, sizeof (long_word));
+  assert (id == 5003 && strlen (symtab_word (table, id)) == sizeof (long_word)
+          && symtab_lookup (table, long_word, sizeof (long_word)) == id
+          && "SYMTAB-TEST: Wrong long string.");
+  for (int j = 0; j < 5000; j += 499)
+    {
+      sprintf (word, "w%d", j);
+      assert (strcmp (symtab_word (table, (uint32_t) j + 3), word) == 0
+              && "SYMTAB-TEST: Wrong string.");
+    }
+
+  symtab_free (&table);
+  assert (table == NULL && "SYMTAB-TEST: Failed to free the table.");
+}
+
+/**
+ * Checks that two chains have the same words, and the same follower counts,
+ * and that, once compiled, they generate the same tweets from a seed.
+ */
+static void check_same_chain (markov_chain *chain, markov_chain *expected)
+{
+  assert (markov_chain_size (chain) == markov_chain_size (expected)
+          && chain->tokens == expected->tokens
+          && chain->starts == expected->starts
+          && "PARALLEL-TRAIN-TEST: Wrong chain size.");
+  for (uint32_t id = 0; id < markov_chain_size (expected); ++id)
+    {
+      const markov_state *state = markov_chain_state (chain, id);
+      const markov_state *other = markov_chain_state (expected, id);
+      assert (strcmp (markov_chain_word (chain, id),
+                      markov_chain_word (expected, id)) == 0
+              && state->total == other->total && state->is_end == other->is_end
+              && (other->alias != NULL || state->dirty == other->dirty)
+              && "PARALLEL-TRAIN-TEST: Wrong state.");
+      size_t pos = 0;
+      uint32_t *next, *count;
+      while (other->total > 0
+             && follower_map_next (other->followers, &pos, &next, &count))
+        assert (*follower_map_at (state->followers, *next) == *count
+                && "PARALLEL-TRAIN-TEST: Wrong follower count.");
+    }
+
+  // the same words have the same ids, so the contexts have the same keys:
+  assert (chain->contexts->size == expected->contexts->size
+          && "PARALLEL-TRAIN-TEST: Wrong number of contexts.");
+  size_t pos = 0;
+  markov_key *key;
+  uint32_t *index;
+  while (context_map_next (expected->context_ids, &pos, &key, &index))
+    {
+      const markov_state *other = vector_at (expected->contexts, *index);
+      const uint32_t *merged = context_map_at (chain->context_ids, *key);
+      assert (merged != NULL
+              && ((const markov_state *) vector_at (chain->contexts, *merged))
+                     ->total == other->total
+              && "PARALLEL-TRAIN-TEST: Wrong context.");
+    }
+
+  // the compiled chains draw the same words, whatever their map orders:
+  int compiled = markov_chain_compile (chain)
+                 && markov_chain_compile (expected);
+  assert (compiled == SUCCESS && "PARALLEL-TRAIN-TEST: Failed to compile.");
+  uint32_t ids[MARKOV_MAX_TWEET_LENGTH], expected_ids[MARKOV_MAX_TWEET_LENGTH];
+  for (uint64_t tweet = 0; tweet < 500; ++tweet)
+    {
+      markov_rng rng;
+      markov_rng_seed (&rng, 42, tweet);
+      size_t length = markov_chain_generate (chain, ids,
+                                             MARKOV_MAX_TWEET_LENGTH, &rng);
+      markov_rng_seed (&rng, 42, tweet);
+      size_t expected_length = markov_chain_generate (
+          expected, expected_ids, MARKOV_MAX_TWEET_LENGTH, &rng);
+      assert (length == expected_length
+              && memcmp (ids, expected_ids, length * sizeof (*ids)) == 0
+              && "PARALLEL-TRAIN-TEST: Generated another tweet.");
+    }
+}
+
+/**
+ * This function checks the markov_chain_train_parallel function.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_train_parallel (void)
+{
+  const char *path = "test_suite.corpus";
+  FILE *file = fopen (path, "w");
+  assert (file != NULL && "PARALLEL-TRAIN-TEST: Failed to write the corpus.");
+  srand (11);
+  for (int line = 0; line < 2000; ++line)
+    {
+      int words = rand () % 12;
+      for (int j = 0; j < words; ++j)
+        fprintf (file, "w%d%s ", rand () % (1 + rand () % 300),
+                 rand () % 10 == 0 ? "." : "");
+      fputc ('\n', file);
+    }
+  fclose (file);
+
+  markov_chain *expected = markov_chain_alloc ();
+  corpus_reader *corpus = corpus_open (path);
+  int train_flag = markov_chain_train_corpus (expected, corpus, 0);
+  assert (train_flag == SUCCESS && "PARALLEL-TRAIN-TEST: Failed to train.");
+  corpus_close (&corpus);
+
+  // more threads than lines leaves some parts empty
+  size_t threads[] = {1, 2, 3, 8, 4096};
+  for (size_t i = 0; i < sizeof (threads) / sizeof (*threads); ++i)
+    {
+      markov_chain *chain = markov_chain_alloc ();
+      corpus = corpus_open (path);
+      train_flag = markov_chain_train_parallel (chain, corpus, threads[i]);
+      assert (train_flag == SUCCESS
+              && "PARALLEL-TRAIN-TEST: Failed to train.");
+      check_same_chain (chain, expected);
+      corpus_close (&corpus);
+      markov_chain_free (&chain);
+    }
+
+  // the contexts of a higher order chain merge too:
+  markov_chain_free (&expected);
+  expected = markov_chain_alloc_order (3);
+  corpus = corpus_open (path);
+  train_flag = markov_chain_train_corpus (expected, corpus, 0);
+  assert (train_flag == SUCCESS && expected->contexts->size > 0
+          && "PARALLEL-TRAIN-TEST: Failed to train.");
+  corpus_close (&corpus);
+  for (size_t i = 0; i < sizeof (threads) / sizeof (*threads); ++i)
+    {
+      markov_chain *chain = markov_chain_alloc_order (3);
+      corpus = corpus_open (path);
+      train_flag = markov_chain_train_parallel (chain, corpus, threads[i]);
+      assert (train_flag == SUCCESS
+              && "PARALLEL-TRAIN-TEST: Failed to train.");
+      check_same_chain (chain, expected);
+      corpus_close (&corpus);
+      markov_chain_free (&chain);
+    }
+
+  // a pipe is read whole first, and a trained chain trains on:
+  markov_chain *chain = markov_chain_alloc ();
+  const char text[] = "just do it.\njust do more. now\n";
+  int fds[2];
+  int pipe_flag = pipe (fds);
+  assert (pipe_flag == 0
+          && "PARALLEL-TRAIN-TEST: Failed to create the pipe.");
+  ssize_t sent = write (fds[1], text, sizeof (text) - 1);
+  int closed = close (fds[1]);
+  assert (sent == sizeof (text) - 1 && closed == 0
+          && "PARALLEL-TRAIN-TEST: Failed to write the pipe.");
+  corpus = corpus_open_fd (fds[0]);
+  train_flag = markov_chain_train_line (chain, "do now do", NULL);
+  assert (train_flag == SUCCESS
+          && "PARALLEL-TRAIN-TEST: Failed to train on a line.");
+  train_flag = markov_chain_train_parallel (chain, corpus, 2);
+  assert (train_flag == SUCCESS
+          && markov_chain_size (chain) == 5 && chain->tokens == 10
+          && markov_chain_state (chain, word_id (chain, "do"))->total == 3
+          && "PARALLEL-TRAIN-TEST: Wrong training on a pipe.");
+  corpus_close (&corpus);
+  markov_chain_free (&chain);
+  markov_chain_free (&expected);
+  remove (path);
+}
+
+/**
+ * This function checks the markov chains of orders 2 to MARKOV_MAX_ORDER.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_order (void)
+{
+  markov_chain *chain = markov_chain_alloc_order (0);
+  assert (chain == NULL && "ORDER-TEST: Allocated an invalid order.");
+  chain = markov_chain_alloc_order (MARKOV_MAX_ORDER + 1);
+  assert (chain == NULL && "ORDER-TEST: Allocated an invalid order.");
+  chain = markov_chain_alloc_order (3);
+  assert (chain != NULL && "ORDER-TEST: Failed to allocate the chain");
+  const char *lines[] = {"a b c d", "a b e", "x b c f"};
+  for (size_t i = 0; i < sizeof (lines) / sizeof (*lines); ++i)
+    {
+      int train_flag = markov_chain_train_line (chain, lines[i], NULL);
+      assert (train_flag == SUCCESS && "ORDER-TEST: Failed to train.");
+    }
+  // [a b] [b c] [a b c] [x b] [x b c]:
+  assert (chain->contexts->size == 5 && "ORDER-TEST: Wrong contexts.");
+
+  uint32_t a = word_id (chain, "a"), b = word_id (chain, "b"),
+      c = word_id (chain, "c"), d = word_id (chain, "d"),
+      e = word_id (chain, "e"), f = word_id (chain, "f"),
+      x = word_id (chain, "x");
+  uint32_t a_b[] = {a, b}, b_c[] = {b, c}, a_b_c[] = {a, b, c},
+      e_b_c[] = {e, b, c}, c_a[] = {c, a};
+  const markov_state *state = markov_chain_context_state (chain, a_b, 2);
+  assert (state != NULL && state->total == 2
+          && *follower_map_at (state->followers, e) == 1
+          && markov_chain_context_state (chain, b_c, 2)->total == 2
+          && markov_chain_context_state (chain, a_b_c, 3)->total == 1
+          && markov_chain_context_state (chain, e_b_c, 3) == NULL
+          && "ORDER-TEST: Wrong context followers.");
+
+  // the longest context seen draws, shorter ones back it off:
+  markov_rng rng;
+  markov_rng_seed (&rng, 5, 0);
+  int compile_flag = markov_chain_compile (chain);
+  assert (compile_flag == SUCCESS && "ORDER-TEST: Failed to compile.");
+  for (int j = 0; j < 100; ++j)
+    {
+      uint32_t next = markov_chain_next_context (chain, e_b_c, 3, &rng);
+      uint32_t after_a_b_c = markov_chain_next_context (chain, a_b_c, 3,
+                                                        &rng);
+      uint32_t after_c_a = markov_chain_next_context (chain, c_a, 2, &rng);
+      assert (after_a_b_c == d && (next == d || next == f)
+              && after_c_a == b && "ORDER-TEST: Wrong context draw.");
+    }
+
+  // a tweet starting with "a" goes on as a line did, one with "x" has one
+  // way to go on (unlike by "b c" alone):
+  uint32_t ids[8];
+  for (int j = 0; j < 200; ++j)
+    {
+      size_t length = markov_chain_generate (chain, ids, 8, &rng);
+      if (ids[0] == a)
+        assert (ids[1] == b
+                && ((length == 3 && ids[2] == e)
+                    || (length == 4 && ids[2] == c && ids[3] == d))
+                && "ORDER-TEST: Wrong tweet.");
+      if (ids[0] == x)
+        assert (length == 4 && ids[3] == f && "ORDER-TEST: Wrong tweet.");
+    }
+
+  // an end word ends the contexts:
+  int train_flag = markov_chain_train_line (chain, "p q. r s t", NULL);
+  assert (train_flag == SUCCESS && chain->contexts->size == 6
+          && "ORDER-TEST: Context after end.");
+  markov_chain_free (&chain);
+}
+
+/**
+ * Reads a whole stream from its start.
+ * @return the dynamically allocated, NUL-terminated content.
+ */
+static char *read_stream (FILE *file)
+{
+  long length = ftell (file);
+  char *content = malloc ((size_t) length + 1);
+  rewind (file);
+  assert (content != NULL && "WRITE-TWEETS-TEST: Failed to allocate.");
+  size_t bytes = fread (content, 1, (size_t) length, file);
+  assert (bytes == (size_t) length
+          && "WRITE-TWEETS-TEST: Failed to read the tweets.");
+  content[length] = '\0';
+  return content;
+}
+
+/**
+ * This function checks the markov_rng generator and the markov_chain_write_tweets function.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_write_tweets (void)
+{
+  // the same seed and stream draw the same numbers, in bounds:
+  markov_rng rng, same, other;
+  markov_rng_seed (&rng, 42, 3);
+  markov_rng_seed (&same, 42, 3);
+  markov_rng_seed (&other, 42, 4);
+  uint64_t first = markov_rng_next (&rng);
+  uint64_t same_first = markov_rng_next (&same);
+  uint64_t second = markov_rng_next (&rng);
+  uint64_t other_first = markov_rng_next (&other);
+  assert (first == same_first && second != other_first
+          && "WRITE-TWEETS-TEST: Wrong seeding.");
+  for (int j = 0; j < 1000; ++j)
+    {
+      double unit = markov_rng_unit (&rng);
+      uint64_t below = markov_rng_below (&rng, 7);
+      assert (below < 7 && unit >= 0 && unit < 1
+              && "WRITE-TWEETS-TEST: Out of bounds.");
+    }
+
+  markov_chain *chain = markov_chain_alloc_order (2);
+  const char *corpus[] = {"just do it. just do more. now",
+                          "do it now and then do it"};
+  for (size_t i = 0; i < sizeof (corpus) / sizeof (*corpus); ++i)
+    {
+      int train_flag = markov_chain_train_line (chain, corpus[i], NULL);
+      assert (train_flag == SUCCESS
+              && "WRITE-TWEETS-TEST: Failed to train.");
+    }
+  int compile_flag = markov_chain_compile (chain);
+  assert (compile_flag == SUCCESS && "WRITE-TWEETS-TEST: Failed to compile.");
+
+  // more tweets than a block, the same whatever the number of threads:
+  size_t count = 2 * MARKOV_WRITE_BLOCK + 17;
+  char *expected = NULL;
+  size_t threads[] = {1, 2, 5};
+  for (size_t i = 0; i < sizeof (threads) / sizeof (*threads); ++i)
+    {
+      FILE *file = tmpfile ();
+      size_t words;
+      assert (file != NULL && "WRITE-TWEETS-TEST: Failed to open a file.");
+      int write_flag = markov_chain_write_tweets (chain, 42, count, 6,
+                                                  threads[i], file, &words);
+      assert (write_flag == SUCCESS && words >= count && words <= 6 * count
+              && "WRITE-TWEETS-TEST: Failed to write.");
+      char *content = read_stream (file);
+      fclose (file);
+      if (expected == NULL)
+        {
+          expected = content;
+          continue;
+        }
+      assert (strcmp (content, expected) == 0
+              && "WRITE-TWEETS-TEST: Output depends on the threads.");
+      free (content);
+    }
+
+  // in order, a line per tweet:
+  size_t lines = 0;
+  char prefix[32];
+  for (char *line = expected; *line != '\0'; line = strchr (line, '\n') + 1)
+    {
+      sprintf (prefix, "Tweet %zu: ", ++lines);
+      assert (strncmp (line, prefix, strlen (prefix)) == 0
+              && "WRITE-TWEETS-TEST: Wrong line.");
+    }
+  assert (lines == count && "WRITE-TWEETS-TEST: Wrong number of tweets.");
+  free (expected);
+
+  // another seed, other tweets:
+  FILE *file = tmpfile ();
+  FILE *other_file = tmpfile ();
+  int write_flag = markov_chain_write_tweets (chain, 1, 200, 6, 2, file,
+                                              NULL);
+  assert (write_flag == SUCCESS && "WRITE-TWEETS-TEST: Failed to write.");
+  write_flag = markov_chain_write_tweets (chain, 2, 200, 6, 2, other_file,
+                                          NULL);
+  assert (write_flag == SUCCESS && "WRITE-TWEETS-TEST: Failed to write.");
+  char *content = read_stream (file);
+  char *other_content = read_stream (other_file);
+  assert (strcmp (content, other_content) != 0
+          && "WRITE-TWEETS-TEST: Seed ignored.");
+  free (content);
+  free (other_content);
+  fclose (file);
+  fclose (other_file);
+  markov_chain_free (&chain);
+}
+
+/**
+ * Checks that whatever a frozen chain draws after a state, the chain's
+ * state was followed by in the corpus.
+ */
+static void check_frozen_draws (const markov_state *state, uint32_t next)
+{
+  if (state->total == 0)
+    assert (next == UINT32_MAX && "FROZEN-TEST: Drew a follower of none.");
+  else
+    assert (next != UINT32_MAX && follower_map_at (state->followers, next)
+                                  != NULL
+            && "FROZEN-TEST: Drew an unseen follower.");
+}
+
+/**
+ * This function checks the freezing of a markov chain, and the generation from the frozen chain.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_frozen (void)
+{
+  markov_chain *chain = markov_chain_alloc_order (3);
+  const char *lines[] = {"just do it. just do more. now",
+                         "do it. do it. do it. do it.",
+                         "now do it now just do it"};
+  for (size_t i = 0; i < sizeof (lines) / sizeof (*lines); ++i)
+    {
+      int train_flag = markov_chain_train_line (chain, lines[i], NULL);
+      assert (train_flag == SUCCESS && "FROZEN-TEST: Failed to train.");
+    }
+  markov_frozen *frozen = markov_chain_freeze (chain);
+  assert (frozen != NULL && markov_frozen_size (frozen) == 6
+          && frozen->starts == chain->starts
+          && frozen->contexts == chain->contexts->size
+          && "FROZEN-TEST: Failed to freeze.");
+  for (uint32_t id = 0; id < markov_frozen_size (frozen); ++id)
+    assert (strcmp (markov_frozen_word (frozen, id),
+                    markov_chain_word (chain, id)) == 0
+            && "FROZEN-TEST: Wrong word.");
+
+  // "it." followed "do" 5 times out of 8:
+  markov_rng rng;
+  markov_rng_seed (&rng, 3, 0);
+  uint32_t id_do = word_id (chain, "do"), id_end = word_id (chain, "it.");
+  int drawn_end = 0;
+  for (int j = 0; j < 8000; ++j)
+    {
+      uint32_t next = markov_frozen_next (frozen, id_do, &rng);
+      check_frozen_draws (markov_chain_state (chain, id_do), next);
+      drawn_end += next == id_end;
+    }
+  assert (drawn_end > 4600 && drawn_end < 5400
+          && "FROZEN-TEST: Wrong frequencies.");
+  // "now do" was followed by "it" once, "just do" by "it.", "more." or "it":
+  uint32_t now_do[] = {word_id (chain, "now"), id_do};
+  uint32_t just_do[] = {word_id (chain, "just"), id_do};
+  uint32_t id_it = word_id (chain, "it"), id_more = word_id (chain, "more.");
+  for (int j = 0; j < 100; ++j)
+    {
+      uint32_t next = markov_frozen_next_context (frozen, just_do, 2, &rng);
+      uint32_t after_now_do = markov_frozen_next_context (frozen, now_do, 2,
+                                                          &rng);
+      assert (after_now_do == id_it
+              && (next == id_end || next == id_more || next == id_it)
+              && "FROZEN-TEST: Wrong context followers.");
+    }
+  markov_frozen_free (&frozen);
+  markov_chain_free (&chain);
+  assert (frozen == NULL && "FROZEN-TEST: Failed to free.");
+
+  // a larger chain: every state draws only its followers, and its frozen
+  // form is much smaller
+  chain = markov_chain_alloc_order (2);
+  char line[256];
+  srand (13);
+  for (int n = 0; n < 3000; ++n)
+    {
+      size_t length = 0;
+      int words = 1 + rand () % 12;
+      for (int j = 0; j < words; ++j)
+        length += (size_t) sprintf (line + length, "w%d%s ",
+                                    rand () % (1 + rand () % 2000),
+                                    rand () % 10 == 0 ? "." : "");
+      int train_flag = markov_chain_train_line (chain, line, NULL);
+      assert (train_flag == SUCCESS && "FROZEN-TEST: Failed to train.");
+    }
+  int compile_flag = markov_chain_compile (chain);
+  assert (compile_flag == SUCCESS && "FROZEN-TEST: Failed to compile.");
+  frozen = markov_chain_freeze (chain);
+  assert (frozen != NULL && "FROZEN-TEST: Failed to freeze.");
+  uint64_t transitions = 0;
+  for (uint32_t id = 0; id < markov_chain_size (chain); ++id)
+    {
+      const markov_state *state = markov_chain_state (chain, id);
+      transitions += state->followers == NULL ? 0 : state->followers->size;
+      for (int j = 0; j < 8; ++j)
+        check_frozen_draws (state, markov_frozen_next (frozen, id, &rng));
+    }
+  size_t pos = 0;
+  markov_key *key;
+  uint32_t *context;
+  while (context_map_next (chain->context_ids, &pos, &key, &context))
+    {
+      const markov_state *state = vector_at (chain->contexts, *context);
+      uint32_t ids[] = {markov_key_slot (*key, 1) - 1,
+                        markov_key_slot (*key, 0) - 1};
+      transitions += state->followers->size;
+      for (int j = 0; j < 8; ++j)
+        check_frozen_draws (state, markov_frozen_next_context (frozen, ids, 2,
+                                                               &rng));
+    }
+  assert (frozen->transitions == transitions
+          && 4 * markov_frozen_bytes (frozen) < markov_chain_bytes (chain)
+          && "FROZEN-TEST: Wrong layout.");
+
+  // the tweets of a seed do not depend on the number of threads:
+  FILE *file = tmpfile (), *other_file = tmpfile ();
+  size_t words, other_words;
+  int write_flag = markov_frozen_write_tweets (frozen, 9, 5000, 10, 1, file,
+                                               &words);
+  int other_flag = markov_frozen_write_tweets (frozen, 9, 5000, 10, 3,
+                                               other_file, &other_words);
+  assert (write_flag == SUCCESS && other_flag == SUCCESS
+          && words == other_words && "FROZEN-TEST: Failed to write.");
+  char *content = read_stream (file);
+  char *other_content = read_stream (other_file);
+  assert (strcmp (content, other_content) == 0
+          && "FROZEN-TEST: Output depends on the threads.");
+  free (content);
+  free (other_content);
+  fclose (file);
+  fclose (other_file);
+  markov_frozen_free (&frozen);
+  markov_chain_free (&chain);
+}
@@ -36,6 +36,140 @@ void test_hash_map_get_load_factor(void);
  */
 void test_hash_map_apply_if();
 
+/**
+ * This function checks the open-addressing backend of the hashmap library.
+ * If the backend fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_open_addressing(void);
+
+/**
+ * This function checks that hashmap resizing moves pairs without copying.
+ * If a resize copies pairs, the functions exits with exit code 1.
+ */
+void test_hash_map_resize(void);
+
+/**
+ * This function checks the inline storage of pairs.
+ * If pair_alloc fails at some points, the functions exits with exit code 1.
+ */
+void test_pair_inline(void);
+
+/**
+ * This function checks the hashmap_insert_move and hashmap_extract functions.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_move(void);
+
+/**
+ * This function checks the distribution of the hash_string hash func.
+ * If the distribution is bad, the functions exits with exit code 1.
+ */
+void test_hash_string_distribution(void);
+
+/**
+ * This function checks the arena-backed hash maps.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_arena(void);
+
+/**
+ * This function checks the capacity management of the vector library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_vector_capacity(void);
+
+/**
+ * This function checks the by-value vectors of the vector library.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_vector_by_value(void);
+
+/**
+ * This function checks the maps generated by HASHMAP_DECLARE.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_typed_hashmap(void);
+
+/**
+ * This function checks the hashmap_at_batch and hashmap_insert_batch functions.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_batch(void);
+
+/**
+ * This function checks the hashmap_apply_if_parallel function of the hashmap library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_apply_if_parallel(void);
+
+/**
+ * This function checks the concurrent hash map, with several writer threads.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_concurrent_hashmap(void);
+
+/**
+ * This function checks the iterator API and the compact backend of the hashmap library.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_iter(void);
+
+/**
+ * This function checks the hashmap_stats function, for all backends: the
+ * histogram, the memory and (with HASHMAP_STATS) the running counters.
+ * If hashmap_stats fails at some points, the functions exits with exit
+ * code 1.
+ */
+void test_hash_map_stats(void);
+
+/**
+ * This function checks the hashmap_save and hashmap_open_mmap functions.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_hash_map_snapshot(void);
+
+/**
+ * This function checks the training and generation of the markov chain.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain(void);
+
+/**
+ * This function checks the corpus reader, and the training of the markov chain on it.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_corpus(void);
+
+/**
+ * This function checks the markov_chain_train_parallel function.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_train_parallel(void);
+
+/**
+ * This function checks the markov chains of orders 2 to MARKOV_MAX_ORDER.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_order(void);
+
+/**
+ * This function checks the markov_rng generator and the markov_chain_write_tweets function.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_chain_write_tweets(void);
+
+/**
+ * This function checks the freezing of a markov chain, and the generation from the frozen chain.
+ * If they fail at some points, the functions exits with exit code 1.
+ */
+void test_markov_frozen(void);
+
+/**
+ * This function checks the interning of strings by the symtab library.
+ * If it fails at some points, the functions exits with exit code 1.
+ */
+void test_symtab(void);
+
 int main()
 {
   test_hash_map_insert();
@@ -53,6 +187,72 @@ int main()
   test_hash_map_apply_if();
   printf("TEST-APPLY-IF SUCCEED!\n");
 
+  test_hash_map_open_addressing();
+  printf("TEST-OPEN-ADDRESSING SUCCEED!\n");
+
+  test_hash_map_resize();
+  printf("TEST-RESIZE SUCCEED!\n");
+
+  test_pair_inline();
+  printf("TEST-PAIR-INLINE SUCCEED!\n");
+
+  test_hash_map_move();
+  printf("TEST-MOVE SUCCEED!\n");
+
+  test_hash_string_distribution();
+  printf("TEST-HASH-STRING SUCCEED!\n");
+
+  test_hash_map_arena();
+  printf("TEST-ARENA SUCCEED!\n");
+
+  test_vector_capacity();
+  printf("TEST-VECTOR-CAPACITY SUCCEED!\n");
+
+  test_vector_by_value();
+  printf("TEST-VECTOR-BY-VALUE SUCCEED!\n");
+
+  test_typed_hashmap();
+  printf("TEST-TYPED-HASHMAP SUCCEED!\n");
+
+  test_hash_map_batch();
+  printf("TEST-BATCH SUCCEED!\n");
+
+  test_hash_map_apply_if_parallel();
+  printf("TEST-APPLY-IF-PARALLEL SUCCEED!\n");
+
+  test_concurrent_hashmap();
+  printf("TEST-CONCURRENT SUCCEED!\n");
+
+  test_hash_map_iter();
+  printf("TEST-ITER SUCCEED!\n");
+
+  test_hash_map_snapshot();
+  printf("TEST-SNAPSHOT SUCCEED!\n");
+
+  test_hash_map_stats();
+  printf("TEST-STATS SUCCEED!\n");
+
+  test_markov_chain();
+  printf("TEST-MARKOV SUCCEED!\n");
+
+  test_corpus();
+  printf("TEST-CORPUS SUCCEED!\n");
+
+  test_markov_chain_train_parallel();
+  printf("TEST-PARALLEL-TRAIN SUCCEED!\n");
+
+  test_markov_chain_order();
+  printf("TEST-ORDER SUCCEED!\n");
+
+  test_markov_chain_write_tweets();
+  printf("TEST-WRITE-TWEETS SUCCEED!\n");
+
+  test_markov_frozen();
+  printf("TEST-FROZEN SUCCEED!\n");
+
+  test_symtab();
+  printf("TEST-SYMTAB SUCCEED!\n");
+
 }
 
 #endif //TESTSUITE_H_
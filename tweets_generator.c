@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "markov_chain.h"
+#include "markov_frozen.h"
+
+/**
+ * Generates tweets from a markov chain trained on a corpus of tweets.
+ * Usage: tweets_generator --corpus PATH [--seed N] [--count N] [--words N]
+ *                         [--max-length N] [--order N] [--threads N]
+ *                         [--freeze] [--stats]
+ *   --corpus      the corpus file, a tweet per line ("-" for stdin).
+ *   --seed        the seed of the random generator (default: the time).
+ *   --count       the number of tweets to generate (default: 1).
+ *   --words       the number of corpus words to train on (default: all).
+ *   --max-length  the maximal number of words of a tweet (default: 20).
+ *   --order       the number of words a next word is drawn by, 1 to 4
+ *                 (default: 1).
+ *   --threads     the number of training and generating threads (default:
+ *                 1), the tweets a seed draws from a corpus do not depend
+ *                 on it.
+ *   --freeze      generate from the chain frozen into a compact (CSR) model.
+ *   --stats       report the training and generation throughput, and the
+ *                 model's size, to stderr.
+ */
+
+#define USAGE "Usage: tweets_generator --corpus PATH [--seed N] [--count N]" \
+              " [--words N] [--max-length N] [--order N] [--threads N]" \
+              " [--freeze] [--stats]\n"
+
+/**
+ * @struct generator_args - the parsed command line.
+ */
+typedef struct generator_args {
+    const char *corpus;
+    uint64_t seed;
+    size_t count;
+    size_t words;
+    size_t max_length;
+    size_t order;
+    size_t threads;
+    int freeze;
+    int stats;
+} generator_args;
+
+/**
+ * @return a monotonic time stamp, in seconds.
+ */
+static double now_seconds (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec + (double) ts.tv_nsec * 1e-9;
+}
+
+/**
+ * Parses a non-negative number argument.
+ * @return 1 if the process has succeeded, 0 else
+ */
+static int parse_size (const char *text, size_t *out)
+{
+  char *end;
+  unsigned long long value = strtoull (text, &end, 10);
+  if (*text == '\0' || *text == '-' || *end != '\0')
+    return 0;
+  *out = (size_t) value;
+  return 1;
+}
+
+/**
+ * Parses the command line into args.
+ * @return 1 if the process has succeeded, 0 else (a usage error)
+ */
+static int parse_args (int argc, char *argv[], generator_args *args)
+{
+  *args = (generator_args) {NULL, (uint64_t) time (NULL), 1, 0,
+                            MARKOV_MAX_TWEET_LENGTH, 1, 1, 0, 0};
+  for (int i = 1; i < argc; i++)
+    {
+      size_t seed;
+      if (strcmp (argv[i], "--stats") == 0)
+        args->stats = 1;
+      else if (strcmp (argv[i], "--freeze") == 0)
+        args->freeze = 1;
+      else if (i + 1 == argc)
+        return 0;
+      else if (strcmp (argv[i], "--corpus") == 0)
+        args->corpus = argv[++i];
+      else if (strcmp (argv[i], "--seed") == 0)
+        {
+          if (!parse_size (argv[++i], &seed))
+            return 0;
+          args->seed = (uint64_t) seed;
+        }
+      else if (strcmp (argv[i], "--count") == 0)
+        {
+          if (!parse_size (argv[++i], &args->count))
+            return 0;
+        }
+      else if (strcmp (argv[i], "--words") == 0)
+        {
+          if (!parse_size (argv[++i], &args->words))
+            return 0;
+        }
+      else if (strcmp (argv[i], "--max-length") == 0)
+        {
+          if (!parse_size (argv[++i], &args->max_length)
+              || args->max_length == 0)
+            return 0;
+        }
+      else if (strcmp (argv[i], "--order") == 0)
+        {
+          if (!parse_size (argv[++i], &args->order) || args->order == 0
+              || args->order > MARKOV_MAX_ORDER)
+            return 0;
+        }
+      else if (strcmp (argv[i], "--threads") == 0)
+        {
+          if (!parse_size (argv[++i], &args->threads) || args->threads == 0)
+            return 0;
+        }
+      else
+        return 0;
+    }
+  return args->corpus != NULL;
+}
+
+int main (int argc, char *argv[])
+{
+  generator_args args;
+  if (!parse_args (argc, argv, &args))
+    {
+      fprintf (stderr, USAGE);
+      return EXIT_FAILURE;
+    }
+
+  corpus_reader *corpus = corpus_open (args.corpus);
+  if (corpus == NULL)
+    {
+      fprintf (stderr, "Error: cannot open corpus %s\n", args.corpus);
+      return EXIT_FAILURE;
+    }
+  markov_chain *chain = markov_chain_alloc_order ((unsigned) args.order);
+  if (chain == NULL)
+    {
+      fprintf (stderr, "Allocation failure: cannot allocate the chain\n");
+      corpus_close (&corpus);
+      return EXIT_FAILURE;
+    }
+
+  double start = now_seconds ();
+  // a words limit cuts the corpus in order, so it trains sequentially
+  int trained = (args.words > 0
+                 ? markov_chain_train_corpus (chain, corpus, args.words)
+                 : markov_chain_train_parallel (chain, corpus, args.threads))
+                && (args.freeze || markov_chain_compile (chain));
+  int read_failed = corpus->error;
+  corpus_close (&corpus);
+  if (!trained)
+    {
+      if (read_failed)
+        fprintf (stderr, "Error: cannot read corpus %s\n", args.corpus);
+      else
+        fprintf (stderr, "Allocation failure: cannot train the chain\n");
+      markov_chain_free (&chain);
+      return EXIT_FAILURE;
+    }
+  double train_end = now_seconds ();
+
+  // the frozen model replaces the chain, which is freed before generating
+  unsigned long long tokens = (unsigned long long) chain->tokens;
+  size_t states = markov_chain_size (chain);
+  size_t chain_bytes = markov_chain_bytes (chain), model_bytes = chain_bytes;
+  markov_frozen *frozen = NULL;
+  if (args.freeze)
+    {
+      frozen = markov_chain_freeze (chain);
+      markov_chain_free (&chain);
+      if (frozen == NULL)
+        {
+          fprintf (stderr, "Allocation failure: cannot freeze the chain\n");
+          return EXIT_FAILURE;
+        }
+      model_bytes = markov_frozen_bytes (frozen);
+    }
+  double freeze_end = now_seconds ();
+
+  size_t words;
+  int written = (frozen != NULL
+                 ? markov_frozen_write_tweets (frozen, args.seed, args.count,
+                                               args.max_length, args.threads,
+                                               stdout, &words)
+                 : markov_chain_write_tweets (chain, args.seed, args.count,
+                                              args.max_length, args.threads,
+                                              stdout, &words))
+                && fflush (stdout) == 0;
+  double generate_end = now_seconds ();
+  if (!written)
+    {
+      fprintf (stderr, "Error: cannot write the tweets\n");
+      markov_frozen_free (&frozen);
+      markov_chain_free (&chain);
+      return EXIT_FAILURE;
+    }
+
+  if (args.stats)
+    {
+      double train_time = train_end - start;
+      double generate_time = generate_end - freeze_end;
+      fprintf (stderr, "training:   %llu tokens, %zu states, %.3f s, "
+                       "%.0f tokens/s\n",
+               tokens, states, train_time, (double) tokens / train_time);
+      fprintf (stderr, "generation: %zu tweets, %zu words, %.3f s, "
+                       "%.0f tweets/s, %.0f words/s\n",
+               args.count, words, generate_time,
+               (double) args.count / generate_time,
+               (double) words / generate_time);
+      fprintf (stderr, "model:      %zu bytes (%s), trained chain %zu bytes",
+               model_bytes, frozen != NULL ? "frozen" : "alias tables",
+               chain_bytes);
+      if (frozen != NULL)
+        fprintf (stderr, ", %llu transitions, %.2f bytes each, "
+                         "frozen in %.3f s",
+                 (unsigned long long) frozen->transitions,
+                 (double) model_bytes / (double) frozen->transitions,
+                 freeze_end - train_end);
+      fputc ('\n', stderr);
+    }
+
+  markov_frozen_free (&frozen);
+  markov_chain_free (&chain);
+  return EXIT_SUCCESS;
+}
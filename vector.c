@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "vector.h"
 
 /**
@@ -35,9 +36,68 @@ elem_cmp_func, vector_elem_free elem_free_func)
   v->elem_cmp_func = elem_cmp_func;
   v->elem_copy_func = elem_copy_func;
   v->elem_free_func = elem_free_func;
+  v->policy = VECTOR_DEFAULT_POLICY;
+  v->elem_size = 0;
+  v->elem_copy_into = NULL;
+  v->elem_destroy = NULL;
   return v;
 }
 
+/**
+ * Dynamically allocates a new by-value vector, which stores its elements
+ * contiguously (no allocation per element). vector_at / vector_find work
+ * with pointers into the vector's buffer, valid until it is resized.
+ * @param elem_size the size of an element.
+ * @param elem_cmp_func func which is used to compare elements stored in the
+ * vector (memcmp of elem_size bytes if NULL).
+ * @param elem_copy_into optional copy hook (memcpy if NULL).
+ * @param elem_destroy optional destroy hook (nothing if NULL).
+ * @return pointer to dynamically allocated vector.
+ * @if_fail return NULL.
+ */
+vector *vector_alloc_by_value (size_t elem_size, vector_elem_cmp
+elem_cmp_func, vector_elem_copy_into elem_copy_into, vector_elem_destroy
+elem_destroy)
+{
+  if (elem_size == 0)
+    return NULL;
+
+  vector *v = malloc (sizeof (*v));
+  if (v == NULL)
+    return NULL;
+
+  v->bytes = malloc (elem_size * VECTOR_INITIAL_CAP);
+  if (v->bytes == NULL)
+    {
+      free (v);
+      return NULL;
+    }
+  v->capacity = VECTOR_INITIAL_CAP;
+  v->size = 0;
+  v->elem_cmp_func = elem_cmp_func;
+  v->elem_copy_func = NULL;
+  v->elem_free_func = NULL;
+  v->policy = VECTOR_DEFAULT_POLICY;
+  v->elem_size = elem_size;
+  v->elem_copy_into = elem_copy_into;
+  v->elem_destroy = elem_destroy;
+  return v;
+}
+
+/**
+ * Frees (or destroys, in a by-value vector) the element at the given index.
+ */
+static void vector_free_elem (vector *vector, size_t ind)
+{
+  if (vector->elem_size == 0)
+    {
+      vector->elem_free_func (&(vector->data[ind]));
+      vector->data[ind] = NULL;
+    }
+  else if (vector->elem_destroy != NULL)
+    vector->elem_destroy (vector->bytes + ind * vector->elem_size);
+}
+
 /**
  * Frees a vector and the elements the vector itself allocated.
  * @param p_vector pointer to dynamically allocated pointer to vector.
@@ -46,8 +106,9 @@ void vector_free (vector **p_vector)
 {
   if (p_vector != NULL && *p_vector != NULL)
     {
-      vector_clear(*p_vector);
-      // free the data array, and the vector itself
+      // free the elements, the data array, and the vector itself
+      for (size_t i = 0; i < (*p_vector)->size; i++)
+        vector_free_elem (*p_vector, i);
       free ((*p_vector)->data);
       free (*p_vector);
       *p_vector = NULL;
@@ -66,6 +127,8 @@ void *vector_at (const vector *vector, size_t ind)
   if (vector == NULL || ind >= vector->size)
     return NULL;
   // valid input, go to the ind element in the vector's array
+  if (vector->elem_size != 0)
+    return vector->bytes + ind * vector->elem_size;
   return (vector->data)[ind];
 }
 
@@ -83,7 +146,10 @@ int vector_find (const vector *vector, const void *value)
     return -1;
   for (int i = 0; i < (int) vector->size; i++)
     {
-      if (vector->elem_cmp_func (vector->data[i], value))
+      const void *elem = vector_at (vector, i);
+      if (vector->elem_cmp_func != NULL
+          ? vector->elem_cmp_func (elem, value)
+          : !memcmp (elem, value, vector->elem_size))
         return i;
     }
   return -1;
@@ -97,7 +163,11 @@ int vector_find (const vector *vector, const void *value)
  */
 int vector_resize (vector *vec, size_t new_capacity)
 {
-  void **tmp = realloc (vec->data, new_capacity * sizeof (void *));
+  // realloc to 0 bytes may free the data and return NULL
+  if (new_capacity == 0)
+    return 0;
+  size_t elem_bytes = vec->elem_size ? vec->elem_size : sizeof (void *);
+  void *tmp = realloc (vec->data, new_capacity * elem_bytes);
   if (tmp == NULL)
     return 0;
   vec->data = tmp;
@@ -105,6 +175,68 @@ int vector_resize (vector *vec, size_t new_capacity)
   return 1;
 }
 
+/**
+ * @return the capacity the vector grows to, so it can hold at least
+ * min_capacity elements.
+ */
+static size_t vector_grown_capacity (const vector *vector, size_t min_capacity)
+{
+  size_t new_capacity = vector->capacity > 0 ? vector->capacity : 1;
+  while (new_capacity < min_capacity)
+    new_capacity *= vector->policy.growth_factor;
+  return new_capacity;
+}
+
+/**
+ * Grows a full vector before an insertion (needed when its max load
+ * factor is 1.0).
+ * @return 1 if there is room for one more element, 0 else
+ */
+static int vector_make_room (vector *vector)
+{
+  if (vector->size < vector->capacity)
+    return 1;
+  return vector_resize (vector, vector_grown_capacity (vector,
+                                                       vector->size + 1));
+}
+
+/**
+ * Checks if the load factor is out of the max range after an insertion, and
+ * resizes the vector (if the resize failed, the next insertion grows first).
+ */
+static void vector_check_max_load (vector *vector)
+{
+  double load_factor = vector_get_load_factor (vector);
+  if (load_factor > vector->policy.max_load_factor)
+    vector_resize (vector, vector->capacity * vector->policy.growth_factor);
+}
+
+/**
+ * Checks if the load factor is out of the min range after an erasing, and
+ * resizes the vector (the element is removed even if the resize failed).
+ */
+static void vector_check_min_load (vector *vector)
+{
+  double load_factor = vector_get_load_factor (vector);
+  // a growth factor above the capacity would shrink it to 0: keep 1
+  size_t new_capacity = vector->capacity / vector->policy.growth_factor;
+  if (load_factor < vector->policy.min_load_factor && vector->capacity > 1)
+    vector_resize (vector, new_capacity > 0 ? new_capacity : 1);
+}
+
+/**
+ * Copies the element at src into the ind element storage of a by-value
+ * vector.
+ */
+static void vector_copy_into (vector *vector, size_t ind, const void *src)
+{
+  void *dst = vector->bytes + ind * vector->elem_size;
+  if (vector->elem_copy_into != NULL)
+    vector->elem_copy_into (dst, src);
+  else
+    memcpy (dst, src, vector->elem_size);
+}
+
 /**
  * Adds a new value to the back (index vector_size) of the vector.
  * @param vector a pointer to vector.
@@ -116,16 +248,148 @@ int vector_push_back (vector *vector, const void *value)
   if (vector == NULL || value == NULL)
     return 0;
 
+  if (vector->elem_size != 0)
+    {
+      // copying the element into the array:
+      if (!vector_make_room (vector))
+        return 0;
+      vector_copy_into (vector, vector->size, value);
+      vector->size++;
+      vector_check_max_load (vector);
+      return 1;
+    }
+
   // adding the element to the array:
   void *new_val = vector->elem_copy_func (value);
-  vector->data[vector->size] = new_val;
+  if (new_val == NULL)
+    return 0;
+  if (!vector_push_back_ptr (vector, new_val))
+    {
+      vector->elem_free_func (&new_val);
+      return 0;
+    }
+  return 1;
+}
+
+/**
+ * Adds the given value itself (not a copy of it) to the back of the vector.
+ * The vector takes ownership of value, and frees it with elem_free_func.
+ * @param vector a pointer to vector.
+ * @param value a dynamically allocated element to be added to the vector.
+ * @return 1 if the adding has been done successfully, 0 otherwise (value is
+ * then still owned by the caller).
+ */
+int vector_push_back_ptr (vector *vector, void *value)
+{
+  if (vector == NULL || value == NULL || vector->elem_size != 0)
+    return 0;
+
+  if (!vector_make_room (vector))
+    return 0;
+
+  vector->data[vector->size] = value;
   vector->size++;
+  vector_check_max_load (vector);
+  return 1;
+}
 
-  // check if the load factor out of the max range, and resize it
-  double load_factor = vector_get_load_factor (vector);
-  if (load_factor > VECTOR_MAX_LOAD_FACTOR)
-    return vector_resize (vector, vector->capacity * VECTOR_GROWTH_FACTOR);
+/**
+ * Adds copies of n values to the back of the vector, growing its capacity
+ * at most once.
+ * @param vector a pointer to vector.
+ * @param values an array of n values to be added to the vector.
+ * @param n the number of values.
+ * @return 1 if the adding has been done successfully, 0 otherwise (then the
+ * vector is left unchanged, its capacity included).
+ */
+int vector_push_back_n (vector *vector, const void *const *values, size_t n)
+{
+  if (vector == NULL || (values == NULL && n > 0))
+    return 0;
+
+  // grow once, to the capacity the n insertions would have ended with
+  size_t new_size = vector->size + n;
+  size_t old_capacity = vector->capacity, new_capacity = old_capacity;
+  while ((double) new_size
+         > vector->policy.max_load_factor * (double) new_capacity
+         || new_size > new_capacity)
+    new_capacity = vector_grown_capacity (vector, new_capacity + 1);
+  if (new_capacity != vector->capacity
+      && !vector_resize (vector, new_capacity))
+    return 0;
 
+  for (size_t i = 0; i < n; i++)
+    {
+      if (values[i] != NULL && vector->elem_size != 0)
+        {
+          vector_copy_into (vector, vector->size++, values[i]);
+          continue;
+        }
+      void *new_val = values[i] ? vector->elem_copy_func (values[i]) : NULL;
+      if (new_val == NULL)
+        {
+          // undo the insertions of this call, and its growth
+          while (i-- > 0)
+            vector_free_elem (vector, --vector->size);
+          if (vector->capacity != old_capacity)
+            vector_resize (vector, old_capacity);
+          return 0;
+        }
+      vector->data[vector->size++] = new_val;
+    }
+  return 1;
+}
+
+/**
+ * Ensures the vector can hold at least capacity elements, with a single
+ * resize at most.
+ * @param vector a pointer to vector.
+ * @param capacity the minimal capacity.
+ * @return 1 if the process has succeeded, 0 else.
+ */
+int vector_reserve (vector *vector, size_t capacity)
+{
+  if (vector == NULL)
+    return 0;
+  if (capacity <= vector->capacity)
+    return 1;
+  return vector_resize (vector, capacity);
+}
+
+/**
+ * Decreases the capacity of the vector to its size (at least 1).
+ * @param vector a pointer to vector.
+ * @return 1 if the process has succeeded, 0 else.
+ */
+int vector_shrink_to_fit (vector *vector)
+{
+  if (vector == NULL)
+    return 0;
+  size_t new_capacity = vector->size > 0 ? vector->size : 1;
+  if (new_capacity == vector->capacity)
+    return 1;
+  return vector_resize (vector, new_capacity);
+}
+
+/**
+ * Sets the capacity management rules of the vector (applied from the next
+ * insertion or erasing on).
+ * @param vector a pointer to vector.
+ * @param policy the new policy (growth_factor >= 2,
+ * 0 <= min_load_factor < max_load_factor / growth_factor,
+ * max_load_factor <= 1).
+ * @return 1 if the policy is valid and was set, 0 else.
+ */
+int vector_set_policy (vector *vector, vector_policy policy)
+{
+  // the min load factor must stay below the load a vector is left with
+  // right after growing, or it would shrink straight back
+  if (vector == NULL || policy.growth_factor < 2
+      || policy.max_load_factor > 1.0 || policy.min_load_factor < 0.0
+      || policy.min_load_factor
+         >= policy.max_load_factor / (double) policy.growth_factor)
+    return 0;
+  vector->policy = policy;
   return 1;
 }
 
@@ -155,24 +419,51 @@ int vector_erase (vector *vector, size_t ind)
   if (vector == NULL || ind >= vector->size)
     return 0;
 
-  // erasing the element:
-  vector->elem_free_func (&(vector->data[ind]));
+  if (vector->elem_size == 0)
+    {
+      // erasing the element:
+      void *elem = vector_extract (vector, ind);
+      vector->elem_free_func (&elem);
+      return 1;
+    }
+
+  // destroy the element, and move the last element to its place:
+  vector_free_elem (vector, ind);
+  vector->size--;
+  if (ind != vector->size)
+    memcpy (vector->bytes + ind * vector->elem_size,
+            vector->bytes + vector->size * vector->elem_size,
+            vector->elem_size);
+  vector_check_min_load (vector);
+  return 1;
+}
+
+/**
+ * Removes the element at the given index from the vector, without freeing
+ * it. alters the indices of the remaining elements like vector_erase.
+ * @param vector a pointer to vector.
+ * @param ind the index of the element to be removed.
+ * @return the removed element (the caller now owns it), NULL if failed.
+ */
+void *vector_extract (vector *vector, size_t ind)
+{
+  if (vector == NULL || ind >= vector->size || vector->elem_size != 0)
+    return NULL;
+
+  void *elem = vector->data[ind];
   vector->size--;
 
   // move the last element to the empty indices:
   vector->data[ind] = vector->data[vector->size];
   vector->data[vector->size] = NULL;
 
-  // check if the load factor out of the min range, and resize it:
-  double load_factor = vector_get_load_factor (vector);
-  if (load_factor < VECTOR_MIN_LOAD_FACTOR && vector->capacity > 1)
-    return vector_resize (vector, vector->capacity / VECTOR_GROWTH_FACTOR);
-
-  return 1;
+  vector_check_min_load (vector);
+  return elem;
 }
 
 /**
- * Deletes all the elements in the vector.
+ * Deletes all the elements in the vector, and decreases its capacity back
+ * to VECTOR_INITIAL_CAP (if it was larger) with a single resize.
  * @param vector vector a pointer to vector.
  */
 void vector_clear (vector *vector)
@@ -180,8 +471,10 @@ void vector_clear (vector *vector)
   if (vector == NULL)
     return;
 
-  for (int i = vector->size - 1; i >= 0; i--)
-    {
-      vector_erase (vector, i);
-    }
+  // free all the elements, then resize once (not once per erasing)
+  for (size_t i = 0; i < vector->size; i++)
+    vector_free_elem (vector, i);
+  vector->size = 0;
+  if (vector->capacity > VECTOR_INITIAL_CAP)
+    vector_resize (vector, VECTOR_INITIAL_CAP);
 }
\ No newline at end of file
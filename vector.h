@@ -29,6 +29,28 @@
  */
 #define VECTOR_MIN_LOAD_FACTOR 0.25
 
+/**
+ * @struct vector_policy - the capacity management rules of a vector.
+ * @param growth_factor the factor the capacity grows (and shrinks) by.
+ * @param max_load_factor the vector is extended once an insertion leaves
+ * its load factor above it (1.0 means grow only when full).
+ * @param min_load_factor the vector is decreased once an erasing leaves its
+ * load factor below it (0.0 means never decrease).
+ */
+typedef struct vector_policy {
+  size_t growth_factor;
+  double max_load_factor;
+  double min_load_factor;
+} vector_policy;
+
+/**
+ * @def VECTOR_DEFAULT_POLICY
+ * The policy new vectors start with.
+ */
+#define VECTOR_DEFAULT_POLICY \
+  ((vector_policy) {VECTOR_GROWTH_FACTOR, VECTOR_MAX_LOAD_FACTOR, \
+                    VECTOR_MIN_LOAD_FACTOR})
+
 /**
  * @typedef vector_elem_cpy
  * Function which receive an element of the type stored in the vector
@@ -50,25 +72,53 @@ typedef int (*vector_elem_cmp)(const void *, const void *);
  */
 typedef void (*vector_elem_free)(void **);
 
+/**
+ * @typedef vector_elem_copy_into
+ * Optional function of a by-value vector, which copies the element at src
+ * into the (uninitialized) element storage at dst. memcpy is used if NULL.
+ */
+typedef void (*vector_elem_copy_into)(void *dst, const void *src);
+
+/**
+ * @typedef vector_elem_destroy
+ * Optional function of a by-value vector, which releases what an element
+ * stored in the vector owns (not the element storage itself).
+ */
+typedef void (*vector_elem_destroy)(void *);
+
 /**
  * @struct vector - a generic vector struct.
  * @param capacity - the capacity of the vector.
  * @param size - the current size of the vector.
- * @param data - the values stored inside the vector.
+ * @param data - the values stored inside the vector (pointers to them, or
+ * for a by-value vector the elements themselves, see bytes).
+ * @param bytes - by-value vectors: the contiguous elements.
  * @param elem_copy_func - a function which copies (returns
  * a dynamically allocates copy) of elements of the type stored in the vector.
  * @param elem_cmp_func - a function which compares the elements
  * stored in the vector.
  * @param elem_free_func - a function which frees the elements stored
  * in the vector.
+ * @param policy - the capacity management rules of the vector.
+ * @param elem_size - the size of an element of a by-value vector, 0 for a
+ * vector of pointers to dynamically allocated elements.
+ * @param elem_copy_into, elem_destroy - optional copy / destroy hooks of
+ * a by-value vector.
  */
 typedef struct vector {
   size_t capacity;
   size_t size;
-  void **data;
+  union {
+    void **data;
+    unsigned char *bytes;
+  };
   vector_elem_cpy elem_copy_func;
   vector_elem_cmp elem_cmp_func;
   vector_elem_free elem_free_func;
+  vector_policy policy;
+  size_t elem_size;
+  vector_elem_copy_into elem_copy_into;
+  vector_elem_destroy elem_destroy;
 } vector;
 
 /**
@@ -83,6 +133,22 @@ typedef struct vector {
 vector *vector_alloc(vector_elem_cpy elem_copy_func, vector_elem_cmp elem_cmp_func,
                      vector_elem_free elem_free_func);
 
+/**
+ * Dynamically allocates a new by-value vector, which stores its elements
+ * contiguously (no allocation per element). vector_at / vector_find work
+ * with pointers into the vector's buffer, valid until it is resized.
+ * @param elem_size the size of an element.
+ * @param elem_cmp_func func which is used to compare elements stored in the
+ * vector (memcmp of elem_size bytes if NULL).
+ * @param elem_copy_into optional copy hook (memcpy if NULL).
+ * @param elem_destroy optional destroy hook (nothing if NULL).
+ * @return pointer to dynamically allocated vector.
+ * @if_fail return NULL.
+ */
+vector *vector_alloc_by_value(size_t elem_size, vector_elem_cmp elem_cmp_func,
+                              vector_elem_copy_into elem_copy_into,
+                              vector_elem_destroy elem_destroy);
+
 /**
  * Frees a vector and the elements the vector itself allocated.
  * @param p_vector pointer to dynamically allocated pointer to vector.
@@ -94,7 +160,7 @@ void vector_free(vector **p_vector);
  * @param vector pointer to a vector.
  * @param ind the index of the element we want to get.
  * @return the element at the given index if exists (the element itself, not a copy of it),
- * NULL otherwise.
+ * NULL otherwise. For a by-value vector, a pointer into its buffer.
  */
 void *vector_at(const vector *vector, size_t ind);
 
@@ -110,11 +176,61 @@ int vector_find(const vector *vector, const void *value);
 /**
  * Adds a new value to the back (index vector_size) of the vector.
  * @param vector a pointer to vector.
- * @param value the value to be added to the vector.
+ * @param value the value to be added to the vector (copied into the buffer
+ * of a by-value vector).
  * @return 1 if the adding has been done successfully, 0 otherwise.
  */
 int vector_push_back(vector *vector, const void *value);
 
+/**
+ * Adds the given value itself (not a copy of it) to the back of the vector.
+ * The vector takes ownership of value, and frees it with elem_free_func.
+ * @param vector a pointer to vector.
+ * @param value a dynamically allocated element to be added to the vector.
+ * Not supported by by-value vectors.
+ * @return 1 if the adding has been done successfully, 0 otherwise (value is
+ * then still owned by the caller).
+ */
+int vector_push_back_ptr(vector *vector, void *value);
+
+/**
+ * Adds copies of n values to the back of the vector, growing its capacity
+ * at most once.
+ * @param vector a pointer to vector.
+ * @param values an array of n values to be added to the vector.
+ * @param n the number of values.
+ * @return 1 if the adding has been done successfully, 0 otherwise (then the
+ * vector is left unchanged, its capacity included).
+ */
+int vector_push_back_n(vector *vector, const void *const *values, size_t n);
+
+/**
+ * Ensures the vector can hold at least capacity elements, with a single
+ * resize at most.
+ * @param vector a pointer to vector.
+ * @param capacity the minimal capacity.
+ * @return 1 if the process has succeeded, 0 else.
+ */
+int vector_reserve(vector *vector, size_t capacity);
+
+/**
+ * Decreases the capacity of the vector to its size (at least 1).
+ * @param vector a pointer to vector.
+ * @return 1 if the process has succeeded, 0 else.
+ */
+int vector_shrink_to_fit(vector *vector);
+
+/**
+ * Sets the capacity management rules of the vector (applied from the next
+ * insertion or erasing on).
+ * @param vector a pointer to vector.
+ * @param policy the new policy (growth_factor >= 2,
+ * 0 <= min_load_factor < max_load_factor / growth_factor,
+ * max_load_factor <= 1).
+ * @return 1 if the policy is valid and was set, 0 else.
+ */
+int vector_set_policy(vector *vector, vector_policy policy);
+
 /**
  * This function returns the load factor of the vector.
  * @param vector a vector.
@@ -132,7 +248,18 @@ double vector_get_load_factor(const vector *vector);
 int vector_erase(vector *vector, size_t ind);
 
 /**
- * Deletes all the elements in the vector.
+ * Removes the element at the given index from the vector, without freeing
+ * it. alters the indices of the remaining elements like vector_erase.
+ * @param vector a pointer to vector.
+ * @param ind the index of the element to be removed.
+ * Not supported by by-value vectors (use vector_at, then vector_erase).
+ * @return the removed element (the caller now owns it), NULL if failed.
+ */
+void *vector_extract(vector *vector, size_t ind);
+
+/**
+ * Deletes all the elements in the vector, and decreases its capacity back
+ * to VECTOR_INITIAL_CAP (if it was larger) with a single resize.
  * @param vector vector a pointer to vector.
  */
 void vector_clear(vector *vector);